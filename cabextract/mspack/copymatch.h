@@ -0,0 +1 @@
+../../libmspack/mspack/copymatch.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../libmspack/mspack/step.c
\ No newline at end of file
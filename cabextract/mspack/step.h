@@ -0,0 +1 @@
+../../libmspack/mspack/step.h
\ No newline at end of file
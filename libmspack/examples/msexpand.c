@@ -10,13 +10,138 @@
 #include <mspack.h>
 #include <error.h>
 
+/* expands many files into a directory, like EXPAND.EXE -R. The SZDD files
+ * are expanded with decompress_batch(), on up to the given number of
+ * threads, and any that aren't SZDD files are then tried as KWAJ files.
+ * Each output file is first written with the name of its input file, then
+ * renamed with a trailing "_" replaced by the SZDD missing character, if
+ * the file had one */
+static int expand_all(struct msszdd_decompressor *szddd,
+                      struct mskwaj_decompressor *kwajd,
+                      char *inputs[], int num_files, const char *dir,
+                      int threads)
+{
+    struct msszddd_batch *files;
+    const char *base;
+    char *output, *renamed;
+    size_t len;
+    int i, j, err, failed = 0;
+
+    if (!(files = (struct msszddd_batch *) calloc(num_files, sizeof(*files)))) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (i = 0; i < num_files; i++) {
+        base = strrchr(inputs[i], '/');
+        base = base ? base + 1 : inputs[i];
+        if (!(output = (char *) malloc(strlen(dir) + strlen(base) + 2))) {
+            fprintf(stderr, "out of memory\n");
+            failed = 1;
+            break;
+        }
+        sprintf(output, "%s/%s", dir, base);
+        files[i].input  = inputs[i];
+        files[i].output = output;
+    }
+
+    /* inputs with the same name would be written to the same output file
+     * at the same time, so refuse them */
+    for (i = 0; i < num_files && !failed; i++) {
+        for (j = i + 1; j < num_files; j++) {
+            if (!strcmp(files[i].output, files[j].output)) {
+                fprintf(stderr, "%s and %s would both expand to %s\n",
+                        files[i].input, files[j].input, files[i].output);
+                failed = 1;
+                break;
+            }
+        }
+    }
+
+    if (!failed) {
+        szddd->decompress_batch(szddd, files, num_files, threads);
+        for (i = 0; i < num_files; i++) {
+            err = files[i].error;
+            /* if not SZDD file, try decompressing as KWAJ */
+            if (err == MSPACK_ERR_SIGNATURE) {
+                err = kwajd->decompress(kwajd, files[i].input, files[i].output);
+            }
+            if (err != MSPACK_ERR_OK) {
+                fprintf(stderr, "%s -> %s: %s\n", files[i].input,
+                        files[i].output, error_msg(err));
+                failed = 1;
+                continue;
+            }
+
+            /* put back the missing character, unless there is none, it's
+             * '_' itself, or it would overwrite another output file */
+            len = strlen(files[i].output);
+            if (!files[i].missing_char || files[i].missing_char == '_' ||
+                files[i].output[len - 1] != '_')
+            {
+                continue;
+            }
+            if (!(renamed = (char *) malloc(len + 1))) {
+                fprintf(stderr, "out of memory\n");
+                failed = 1;
+                continue;
+            }
+            strcpy(renamed, files[i].output);
+            renamed[len - 1] = files[i].missing_char;
+            for (j = 0; j < num_files; j++) {
+                if (!strcmp(renamed, files[j].output)) break;
+            }
+            if (j < num_files) {
+                fprintf(stderr, "%s: not renamed to %s, %s expands to it\n",
+                        files[i].output, renamed, files[j].input);
+                failed = 1;
+            }
+            else if (rename(files[i].output, renamed)) {
+                perror(renamed);
+                failed = 1;
+            }
+            free(renamed);
+        }
+    }
+
+    for (i = 0; i < num_files; i++) free((void *) files[i].output);
+    free(files);
+    return failed;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s <input file> <output file>\n"
+            "       %s -j <threads> <input files> <output directory>\n",
+            prog, prog);
+}
+
 int main(int argc, char *argv[]) {
     struct msszdd_decompressor *szddd;
     struct mskwaj_decompressor *kwajd;
-    int err;
+    const char *prog = argv[0];
+    int err, threads = 0;
 
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <input file> <output file>\n", argv[0]);
+    if (argc >= 2 && !strcmp(argv[1], "-j")) {
+        char *end;
+        long n = (argc >= 3) ? strtol(argv[2], &end, 10) : 0;
+        if (argc < 3 || *argv[2] == '\0' || *end != '\0' ||
+            n < 1 || n > 64)
+        {
+            fprintf(stderr, "%s: -j needs a number of threads from 1 to 64\n",
+                    prog);
+            usage(prog);
+            return 1;
+        }
+        threads = (int) n;
+        argv += 2;
+        argc -= 2;
+        if (argc < 3) {
+            usage(prog);
+            return 1;
+        }
+    }
+    else if (argc != 3) {
+        usage(prog);
         return 1;
     }
 
@@ -28,13 +153,19 @@ int main(int argc, char *argv[]) {
     kwajd = mspack_create_kwaj_decompressor(NULL);
 
     if (szddd && kwajd) {
-        err = szddd->decompress(szddd, argv[1], argv[2]);
-        /* if not SZDD file, try decompressing as KWAJ */
-        if (err == MSPACK_ERR_SIGNATURE) {
-            err = kwajd->decompress(kwajd, argv[1], argv[2]);
+        if (threads) {
+            err = expand_all(szddd, kwajd, &argv[1], argc - 2,
+                             argv[argc - 1], threads);
         }
-        if (err != MSPACK_ERR_OK) {
-            fprintf(stderr, "%s -> %s: %s\n", argv[1], argv[2], error_msg(err));
+        else {
+            err = szddd->decompress(szddd, argv[1], argv[2]);
+            /* if not SZDD file, try decompressing as KWAJ */
+            if (err == MSPACK_ERR_SIGNATURE) {
+                err = kwajd->decompress(kwajd, argv[1], argv[2]);
+            }
+            if (err != MSPACK_ERR_OK) {
+                fprintf(stderr, "%s -> %s: %s\n", argv[1], argv[2], error_msg(err));
+            }
         }
     }
     else {
@@ -101,10 +101,12 @@ struct mscabd_decompress_state {
   struct mspack_system sys;          /* special I/O code for decompressor    */
   int comp_type;                     /* type of compression used by folder   */
   int (*decompress)(void *, off_t);  /* decompressor code                    */
+  int (*skip)(void *, off_t);        /* decompressor code, output unwanted   */
   void *state;                       /* decompressor state                   */
   struct mscabd_cabinet_p *incab;    /* cabinet where input data comes from  */
   struct mspack_file *infh;          /* input file handle                    */
   struct mspack_file *outfh;         /* output file handle                   */
+  unsigned char *o_ptr, *o_end;      /* or output buffer position, end       */
   unsigned char *i_ptr, *i_end;      /* input data consumed, end             */
   unsigned char input[CAB_INPUTBUF]; /* one input block of data              */
 };
@@ -113,8 +115,9 @@ struct mscab_decompressor_p {
   struct mscab_decompressor base;
   struct mscabd_decompress_state *d;
   struct mspack_system *system;
-  int buf_size, searchbuf_size, fix_mszip, salvage; /* params */
+  int buf_size, searchbuf_size, fix_mszip, salvage, threads, max_repairs;
   int error, read_error;
+  struct mscabd_repairs repairs;
 };
 
 struct mscabd_cabinet_p {
@@ -106,6 +106,12 @@ static int cabd_can_merge_folders(
 static int cabd_extract(
   struct mscab_decompressor *base, struct mscabd_file *file,
   const char *filename);
+static int cabd_extract_to_buffer(
+  struct mscab_decompressor *base, struct mscabd_file *file,
+  void *buffer, size_t length);
+static int cabd_extract_to(
+  struct mscab_decompressor_p *self, struct mscabd_file *file,
+  const char *filename, unsigned char *buffer, size_t length);
 static int cabd_init_decomp(
   struct mscab_decompressor_p *self, unsigned int ct);
 static void cabd_free_decomp(
@@ -114,6 +120,10 @@ static int cabd_sys_read(
   struct mspack_file *file, void *buffer, int bytes);
 static int cabd_sys_write(
   struct mspack_file *file, void *buffer, int bytes);
+#ifdef HAVE_PTHREAD
+static int cabd_read_mszip_block(
+  struct mspack_file *file, unsigned char **data, unsigned int *length);
+#endif
 static int cabd_sys_read_block(
   struct mspack_system *sys, struct mscabd_decompress_state *d, int *out,
   int ignore_cksum, int ignore_blocksize);
@@ -129,8 +139,16 @@ static int lzxd_decompress_wrapper(
   void *state, off_t bytes);
 static int qtmd_decompress_wrapper(
   void *state, off_t bytes);
+static int mszipd_skip_wrapper(
+  void *state, off_t bytes);
+static int lzxd_skip_wrapper(
+  void *state, off_t bytes);
+static int qtmd_skip_wrapper(
+  void *state, off_t bytes);
 static int noned_decompress(
   void *state, off_t bytes);
+static int noned_skip(
+  void *state, off_t bytes);
 static void noned_free(
   struct noned_state *state);
 
@@ -139,6 +157,8 @@ static int cabd_param(
 
 static int cabd_error(
   struct mscab_decompressor *base);
+static int cabd_repairs(
+  struct mscab_decompressor *base, struct mscabd_repairs *repairs);
 
 
 /***************************************
@@ -163,6 +183,8 @@ struct mscab_decompressor *
     self->base.append     = &cabd_append;
     self->base.set_param  = &cabd_param;
     self->base.last_error = &cabd_error;
+    self->base.extract_to_buffer = &cabd_extract_to_buffer;
+    self->base.last_repairs = &cabd_repairs;
     self->system          = sys;
     self->d               = NULL;
     self->error           = MSPACK_ERR_OK;
@@ -171,6 +193,12 @@ struct mscab_decompressor *
     self->fix_mszip       = 0;
     self->buf_size        = 4096;
     self->salvage         = 0;
+    self->threads         = 1;
+    self->max_repairs     = 0;
+
+    self->repairs.blocks      = 0;
+    self->repairs.first_block = 0;
+    self->repairs.bytes       = 0;
   }
   return (struct mscab_decompressor *) self;
 }
@@ -1068,20 +1096,45 @@ static int cabd_can_merge_folders(struct mspack_system *sys,
 
 
 /***************************************
- * CABD_EXTRACT
+ * CABD_EXTRACT, CABD_EXTRACT_TO_BUFFER
  ***************************************
- * extracts a file from a cabinet
+ * extracts a file from a cabinet, either to a file or to memory
  */
 static int cabd_extract(struct mscab_decompressor *base,
                         struct mscabd_file *file, const char *filename)
 {
   struct mscab_decompressor_p *self = (struct mscab_decompressor_p *) base;
+  if (!self) return MSPACK_ERR_ARGS;
+  return cabd_extract_to(self, file, filename, NULL, 0);
+}
+
+static int cabd_extract_to_buffer(struct mscab_decompressor *base,
+                                  struct mscabd_file *file,
+                                  void *buffer, size_t length)
+{
+  struct mscab_decompressor_p *self = (struct mscab_decompressor_p *) base;
+  if (!self) return MSPACK_ERR_ARGS;
+  if (!buffer) return self->error = MSPACK_ERR_ARGS;
+  return cabd_extract_to(self, file, NULL, (unsigned char *) buffer, length);
+}
+
+/* writes the file to the named file or, if buffer isn't NULL, the first
+ * length bytes of it to the buffer */
+static int cabd_extract_to(struct mscab_decompressor_p *self,
+                           struct mscabd_file *file, const char *filename,
+                           unsigned char *buffer, size_t length)
+{
   struct mscabd_folder_p *fol;
   struct mspack_system *sys;
-  struct mspack_file *fh;
+  struct mspack_file *fh = NULL;
+  struct mszipd_stream *zip = NULL;
   unsigned int filelen;
+  int skip_failed = 0;
+
+  self->repairs.blocks      = 0;
+  self->repairs.first_block = 0;
+  self->repairs.bytes       = 0;
 
-  if (!self) return MSPACK_ERR_ARGS;
   if (!file) return self->error = MSPACK_ERR_ARGS;
 
   sys = self->system;
@@ -1104,6 +1157,7 @@ static int cabd_extract(struct mscab_decompressor *base,
       return self->error = MSPACK_ERR_DATAFORMAT;
     }
   }
+  if (buffer && length < filelen) filelen = (unsigned int) length;
 
   /* extraction impossible if no folder, or folder needs predecessor */
   if (!fol || fol->merge_prev) {
@@ -1176,8 +1230,17 @@ static int cabd_extract(struct mscab_decompressor *base,
     self->read_error = MSPACK_ERR_OK;
   }
 
+  /* count MS-ZIP repairs for this file only */
+  if ((self->d->comp_type & cffoldCOMPTYPE_MASK) == cffoldCOMPTYPE_MSZIP) {
+    zip = (struct mszipd_stream *) self->d->state;
+    zip->repaired_blocks = 0;
+    zip->first_repaired  = 0;
+    zip->repaired_bytes  = 0;
+    zip->max_repairs     = (unsigned int) self->max_repairs;
+  }
+
   /* open file for output */
-  if (!(fh = sys->open(sys, filename, MSPACK_SYS_OPEN_WRITE))) {
+  if (!buffer && !(fh = sys->open(sys, filename, MSPACK_SYS_OPEN_WRITE))) {
     return self->error = MSPACK_ERR_OPEN;
   }
 
@@ -1188,27 +1251,45 @@ static int cabd_extract(struct mscab_decompressor *base,
     off_t bytes;
     int error;
     /* get to correct offset.
-     * - use NULL fh to say 'no writing' to cabd_sys_write()
+     * - skip() decodes without writing, so advance self->d->offset here
      * - if cabd_sys_read() has an error, it will set self->read_error
      *   and pass back MSPACK_ERR_READ
      */
     self->d->outfh = NULL;
+    self->d->o_ptr = self->d->o_end = NULL;
     if ((bytes = file->offset - self->d->offset)) {
-        error = self->d->decompress(self->d->state, bytes);
+        error = self->d->skip(self->d->state, bytes);
         self->error = (error == MSPACK_ERR_READ) ? self->read_error : error;
+        if (!self->error) self->d->offset = file->offset;
+        else skip_failed = 1;
     }
 
     /* if getting to the correct offset was error free, unpack file */
     if (!self->error) {
       self->d->outfh = fh;
+      if (buffer) {
+        self->d->o_ptr = buffer;
+        self->d->o_end = &buffer[filelen];
+      }
       error = self->d->decompress(self->d->state, filelen);
       self->error = (error == MSPACK_ERR_READ) ? self->read_error : error;
     }
   }
 
+  if (zip) {
+    self->repairs.blocks      = zip->repaired_blocks;
+    self->repairs.first_block = zip->first_repaired;
+    self->repairs.bytes       = zip->repaired_bytes;
+  }
+
+  /* a failed skip() leaves the stream somewhere between self->d->offset
+   * and the file, so the next extract() must start the folder again */
+  if (skip_failed) cabd_free_decomp(self);
+
   /* close output file */
-  sys->close(fh);
+  if (fh) sys->close(fh);
   self->d->outfh = NULL;
+  self->d->o_ptr = self->d->o_end = NULL;
 
   return self->error;
 }
@@ -1232,20 +1313,34 @@ static int cabd_init_decomp(struct mscab_decompressor_p *self, unsigned int ct)
   switch (ct & cffoldCOMPTYPE_MASK) {
   case cffoldCOMPTYPE_NONE:
     self->d->decompress = &noned_decompress;
+    self->d->skip       = &noned_skip;
     self->d->state = noned_init(&self->d->sys, fh, fh, self->buf_size);
     break;
   case cffoldCOMPTYPE_MSZIP:
     self->d->decompress = &mszipd_decompress_wrapper;
+    self->d->skip       = &mszipd_skip_wrapper;
     self->d->state = mszipd_init(&self->d->sys, fh, fh, self->buf_size,
                                  self->fix_mszip);
+#ifdef HAVE_PTHREAD
+    /* decode blocks in parallel if asked. If that can't be set up, they
+     * are decoded one at a time */
+    if (self->d->state && self->threads > 1 &&
+        !self->fix_mszip && !self->salvage)
+    {
+      mszipd_set_parallel((struct mszipd_stream *) self->d->state,
+                          self->threads, &cabd_read_mszip_block);
+    }
+#endif
     break;
   case cffoldCOMPTYPE_QUANTUM:
     self->d->decompress = &qtmd_decompress_wrapper;
+    self->d->skip       = &qtmd_skip_wrapper;
     self->d->state = qtmd_init(&self->d->sys, fh, fh, (int) (ct >> 8) & 0x1f,
                                self->buf_size);
     break;
   case cffoldCOMPTYPE_LZX:
     self->d->decompress = &lzxd_decompress_wrapper;
+    self->d->skip       = &lzxd_skip_wrapper;
     self->d->state = lzxd_init(&self->d->sys, fh, fh, (int) (ct >> 8) & 0x1f, 0,
                                self->buf_size, (off_t)0,0);
     break;
@@ -1265,6 +1360,7 @@ static void cabd_free_decomp(struct mscab_decompressor_p *self) {
   case cffoldCOMPTYPE_LZX:     lzxd_free((struct lzxd_stream *) self->d->state);    break;
   }
   self->d->decompress = NULL;
+  self->d->skip       = NULL;
   self->d->state      = NULL;
 }
 
@@ -1277,8 +1373,8 @@ static void cabd_free_decomp(struct mscab_decompressor_p *self) {
  *
  * cabd_sys_write is the internal writer function which the decompressors
  * use. it either writes data to disk (self->d->outfh) with the real
- * sys->write() function, or does nothing with the data when
- * self->d->outfh == NULL. advances self->d->offset
+ * sys->write() function, copies it to memory (self->d->o_ptr), or does
+ * nothing with the data when both are NULL. advances self->d->offset
  */
 static int cabd_sys_read(struct mspack_file *file, void *buffer, int bytes) {
   struct mscab_decompressor_p *self = (struct mscab_decompressor_p *) file;
@@ -1350,9 +1446,46 @@ static int cabd_sys_write(struct mspack_file *file, void *buffer, int bytes) {
   if (self->d->outfh) {
     return self->system->write(self->d->outfh, buffer, bytes);
   }
+  if (self->d->o_ptr) {
+    if (bytes > self->d->o_end - self->d->o_ptr) return -1;
+    self->system->copy(buffer, self->d->o_ptr, (size_t) bytes);
+    self->d->o_ptr += bytes;
+  }
   return bytes;
 }
 
+#ifdef HAVE_PTHREAD
+/***************************************
+ * CABD_READ_MSZIP_BLOCK
+ ***************************************
+ * gives the MS-ZIP decompressor one whole data block at a time, when it
+ * decodes blocks in parallel (see mszipd_set_parallel())
+ */
+static int cabd_read_mszip_block(struct mspack_file *file,
+                                 unsigned char **data, unsigned int *length)
+{
+  struct mscab_decompressor_p *self = (struct mscab_decompressor_p *) file;
+  int outlen;
+
+  /* no more blocks is not an error until the decompressor needs one */
+  *length = 0;
+  if (self->d->block >= self->d->folder->base.num_blocks) {
+    return MSPACK_ERR_OK;
+  }
+  self->d->block++;
+
+  self->read_error = cabd_sys_read_block(self->system, self->d, &outlen,
+                                         0, 0);
+  if (self->read_error) return MSPACK_ERR_READ;
+  self->d->outlen += outlen;
+
+  *data   = self->d->i_ptr;
+  *length = (unsigned int) (self->d->i_end - self->d->i_ptr);
+  self->d->i_ptr = self->d->i_end;
+  return MSPACK_ERR_OK;
+}
+#endif
+
 /***************************************
  * CABD_SYS_READ_BLOCK
  ***************************************
@@ -1479,7 +1612,7 @@ static unsigned int cabd_checksum(unsigned char *data, unsigned int bytes,
 }
 
 /***************************************
- * {MSZIP,LZX,QTM}D_DECOMPRESS_WRAPPER
+ * {MSZIP,LZX,QTM}D_{DECOMPRESS,SKIP}_WRAPPER
  ***************************************
  * UBSan complains about calling a function like int foo(struct foo*, off_t)
  * through a pointer like (int (*)(void *, off_t)) so do it indirectly
@@ -1493,9 +1626,18 @@ static int lzxd_decompress_wrapper(void *state, off_t bytes) {
 static int qtmd_decompress_wrapper(void *state, off_t bytes) {
   return qtmd_decompress((struct qtmd_stream *)state, bytes);
 }
+static int mszipd_skip_wrapper(void *state, off_t bytes) {
+  return mszipd_skip((struct mszipd_stream *)state, bytes);
+}
+static int lzxd_skip_wrapper(void *state, off_t bytes) {
+  return lzxd_skip((struct lzxd_stream *)state, bytes);
+}
+static int qtmd_skip_wrapper(void *state, off_t bytes) {
+  return qtmd_skip((struct qtmd_stream *)state, bytes);
+}
 
 /***************************************
- * NONED_INIT, NONED_DECOMPRESS, NONED_FREE
+ * NONED_INIT, NONED_DECOMPRESS, NONED_SKIP, NONED_FREE
  ***************************************
  * the "not compressed" method decompressor
  */
@@ -1541,6 +1683,17 @@ static int noned_decompress(void *state, off_t bytes) {
   return MSPACK_ERR_OK;
 }
 
+static int noned_skip(void *state, off_t bytes) {
+  struct noned_state *s = (struct noned_state *) state;
+  int run;
+  while (bytes > 0) {
+    run = (bytes > s->bufsize) ? s->bufsize : (int) bytes;
+    if (s->sys->read(s->i, &s->buf[0], run) != run) return MSPACK_ERR_READ;
+    bytes -= run;
+  }
+  return MSPACK_ERR_OK;
+}
+
 static void noned_free(struct noned_state *state) {
   struct mspack_system *sys;
   if (state) {
@@ -1575,6 +1728,14 @@ static int cabd_param(struct mscab_decompressor *base, int param, int value) {
   case MSCABD_PARAM_SALVAGE:
     self->salvage = value;
     break;
+  case MSCABD_PARAM_THREADS:
+    if (value < 1) return MSPACK_ERR_ARGS;
+    self->threads = value;
+    break;
+  case MSCABD_PARAM_MAXREPAIRS:
+    if (value < 0) return MSPACK_ERR_ARGS;
+    self->max_repairs = value;
+    break;
   default:
     return MSPACK_ERR_ARGS;
   }
@@ -1590,3 +1751,17 @@ static int cabd_error(struct mscab_decompressor *base) {
   struct mscab_decompressor_p *self = (struct mscab_decompressor_p *) base;
   return (self) ? self->error : MSPACK_ERR_ARGS;
 }
+
+/***************************************
+ * CABD_REPAIRS
+ ***************************************
+ * returns the MS-ZIP repairs made by the last extraction
+ */
+static int cabd_repairs(struct mscab_decompressor *base,
+                        struct mscabd_repairs *repairs)
+{
+  struct mscab_decompressor_p *self = (struct mscab_decompressor_p *) base;
+  if (!self || !repairs) return MSPACK_ERR_ARGS;
+  *repairs = self->repairs;
+  return MSPACK_ERR_OK;
+}
@@ -107,10 +107,12 @@ struct mschmd_decompress_state {
   off_t length;                      /* uncompressed length of LZX stream    */
   off_t offset;                      /* uncompressed offset within stream    */
   off_t inoffset;                    /* offset in input file                 */
+  off_t reset_interval;              /* bytes between LZX reset points       */
   struct lzxd_stream *state;         /* LZX decompressor state               */
   struct mspack_system sys;          /* special I/O code for decompressor    */
   struct mspack_file *infh;          /* input file handle                    */
   struct mspack_file *outfh;         /* output file handle                   */
+  unsigned char *o_ptr, *o_end;      /* or output buffer position, end       */
 };
 
 struct mschm_decompressor_p {
@@ -38,6 +38,12 @@ static inline int compare(
 static int chmd_extract(
   struct mschm_decompressor *base, struct mschmd_file *file,
   const char *filename);
+static int chmd_extract_to_buffer(
+  struct mschm_decompressor *base, struct mschmd_file *file,
+  void *buffer, size_t length);
+static int chmd_extract_to(
+  struct mschm_decompressor_p *self, struct mschmd_file *file,
+  const char *filename, unsigned char *buffer, size_t length);
 static int chmd_sys_write(
   struct mspack_file *file, void *buffer, int bytes);
 static int chmd_init_decomp(
@@ -91,6 +97,7 @@ struct mschm_decompressor *
     self->base.last_error = &chmd_error;
     self->base.fast_open  = &chmd_fast_open;
     self->base.fast_find  = &chmd_fast_find;
+    self->base.extract_to_buffer = &chmd_extract_to_buffer;
     self->system          = sys;
     self->error           = MSPACK_ERR_OK;
     self->d               = NULL;
@@ -899,23 +906,46 @@ static inline int compare(const char *s1, const char *s2, int l1, int l2) {
 
 
 /***************************************
- * CHMD_EXTRACT
+ * CHMD_EXTRACT, CHMD_EXTRACT_TO_BUFFER
  ***************************************
- * extracts a file from a CHM helpfile
+ * extracts a file from a CHM helpfile, either to a file or to memory
  */
 static int chmd_extract(struct mschm_decompressor *base,
                         struct mschmd_file *file, const char *filename)
 {
   struct mschm_decompressor_p *self = (struct mschm_decompressor_p *) base;
+  if (!self) return MSPACK_ERR_ARGS;
+  return chmd_extract_to(self, file, filename, NULL, 0);
+}
+
+static int chmd_extract_to_buffer(struct mschm_decompressor *base,
+                                  struct mschmd_file *file,
+                                  void *buffer, size_t length)
+{
+  struct mschm_decompressor_p *self = (struct mschm_decompressor_p *) base;
+  if (!self) return MSPACK_ERR_ARGS;
+  if (!buffer) return self->error = MSPACK_ERR_ARGS;
+  return chmd_extract_to(self, file, NULL, (unsigned char *) buffer, length);
+}
+
+/* writes the file to the named file or, if buffer isn't NULL, the first
+ * length bytes of it to the buffer */
+static int chmd_extract_to(struct mschm_decompressor_p *self,
+                           struct mschmd_file *file, const char *filename,
+                           unsigned char *buffer, size_t length)
+{
   struct mspack_system *sys;
   struct mschmd_header *chm;
-  struct mspack_file *fh;
-  off_t bytes;
+  struct mspack_file *fh = NULL;
+  off_t bytes, filelen;
 
-  if (!self) return MSPACK_ERR_ARGS;
   if (!file || !file->section) return self->error = MSPACK_ERR_ARGS;
   sys = self->system;
   chm = file->section->chm;
+  filelen = file->length;
+  if (buffer && (off_t) length >= 0 && (off_t) length < filelen) {
+    filelen = (off_t) length;
+  }
 
   /* create decompression state if it doesn't exist */
   if (!self->d) {
@@ -928,6 +958,8 @@ static int chmd_extract(struct mschm_decompressor *base,
     self->d->sys.write = &chmd_sys_write;
     self->d->infh      = NULL;
     self->d->outfh     = NULL;
+    self->d->o_ptr     = NULL;
+    self->d->o_end     = NULL;
   }
 
   /* open input chm file if not open, or the open one is a different chm */
@@ -942,13 +974,13 @@ static int chmd_extract(struct mschm_decompressor *base,
   }
 
   /* open file for output */
-  if (!(fh = sys->open(sys, filename, MSPACK_SYS_OPEN_WRITE))) {
+  if (!buffer && !(fh = sys->open(sys, filename, MSPACK_SYS_OPEN_WRITE))) {
     return self->error = MSPACK_ERR_OPEN;
   }
 
   /* if file is empty, simply creating it is enough */
-  if (!file->length) {
-    sys->close(fh);
+  if (!filelen) {
+    if (fh) sys->close(fh);
     return self->error = MSPACK_ERR_OK;
   }
 
@@ -964,20 +996,25 @@ static int chmd_extract(struct mschm_decompressor *base,
     }
     else {
       unsigned char buf[512];
-      off_t length = file->length;
+      off_t length = filelen;
       off_t maxlen = chm->length - sys->tell(self->d->infh);
       if (length > maxlen) {
         sys->message(fh, "WARNING; file is %" LD " bytes longer than CHM file",
                      length - maxlen);
       }
       while (length > 0) {
-        int run = sizeof(buf);
+        /* read straight into the output buffer, if there is one */
+        unsigned char *p = (buffer) ? buffer : &buf[0];
+        int run = (buffer) ? (1 << 20) : (int) sizeof(buf);
         if ((off_t)run > length) run = (int)length;
-        if (sys->read(self->d->infh, &buf[0], run) != run) {
+        if (sys->read(self->d->infh, p, run) != run) {
           self->error = MSPACK_ERR_READ;
           break;
         }
-        if (sys->write(fh, &buf[0], run) != run) {
+        if (buffer) {
+          buffer += run;
+        }
+        else if (sys->write(fh, p, run) != run) {
           self->error = MSPACK_ERR_WRITE;
           break;
         }
@@ -987,15 +1024,18 @@ static int chmd_extract(struct mschm_decompressor *base,
     break;
 
   case 1: /* MSCompressed section file */
-    /* (re)initialise compression state if not yet initialised,
-     * or we have advanced too far and have to backtrack
+    /* initialise compression state if not yet initialised, or seek to
+     * the nearest reset point if we have advanced too far and have to
+     * backtrack, or if there is a reset point we can skip ahead to
      */
-    if (!self->d->state || (file->offset < self->d->offset)) {
-      if (self->d->state) {
-        lzxd_free(self->d->state);
+    if (!self->d->state || (file->offset < self->d->offset) ||
+        (file->offset - self->d->offset) >= self->d->reset_interval)
+    {
+      if (chmd_init_decomp(self, file)) {
+        if (self->d->state) lzxd_free(self->d->state);
         self->d->state = NULL;
+        break;
       }
-      if (chmd_init_decomp(self, file)) break;
     }
 
     /* check file offset is not impossible */
@@ -1010,15 +1050,17 @@ static int chmd_extract(struct mschm_decompressor *base,
       break;
     }
 
-    /* get to correct offset. */
+    /* get to correct offset. lzxd_skip() doesn't write, so advance
+     * self->d->offset here */
     self->d->outfh = NULL;
     if ((bytes = file->offset - self->d->offset)) {
-      self->error = lzxd_decompress(self->d->state, bytes);
+      self->error = lzxd_skip(self->d->state, bytes);
+      if (!self->error) self->d->offset = file->offset;
     }
 
     /* if getting to the correct offset was error free, unpack file */
     if (!self->error) {
-      off_t length = file->length;
+      off_t length = filelen;
       off_t maxlen = self->d->length - file->offset;
       if (length > maxlen) {
         sys->message(fh, "WARNING; file is %" LD " bytes longer than "
@@ -1026,7 +1068,12 @@ static int chmd_extract(struct mschm_decompressor *base,
         length = maxlen + 1; /* should decompress but still error out */
       }
       self->d->outfh = fh;
+      if (buffer) {
+        self->d->o_ptr = buffer;
+        self->d->o_end = &buffer[length];
+      }
       self->error = lzxd_decompress(self->d->state, length);
+      self->d->o_ptr = self->d->o_end = NULL;
     }
 
     /* save offset in input source stream, in case there is a section 0
@@ -1041,7 +1088,7 @@ static int chmd_extract(struct mschm_decompressor *base,
     break;
   }
 
-  sys->close(fh);
+  if (fh) sys->close(fh);
   return self->error;
 }
 
@@ -1050,8 +1097,8 @@ static int chmd_extract(struct mschm_decompressor *base,
  ***************************************
  * chmd_sys_write is the internal writer function which the decompressor
  * uses. If either writes data to disk (self->d->outfh) with the real
- * sys->write() function, or does nothing with the data when
- * self->d->outfh == NULL. advances self->d->offset.
+ * sys->write() function, copies it to memory (self->d->o_ptr), or does
+ * nothing with the data when both are NULL. advances self->d->offset.
  */
 static int chmd_sys_write(struct mspack_file *file, void *buffer, int bytes) {
   struct mschm_decompressor_p *self = (struct mschm_decompressor_p *) file;
@@ -1059,6 +1106,11 @@ static int chmd_sys_write(struct mspack_file *file, void *buffer, int bytes) {
   if (self->d->outfh) {
     return self->system->write(self->d->outfh, buffer, bytes);
   }
+  if (self->d->o_ptr) {
+    if (bytes > self->d->o_end - self->d->o_ptr) return -1;
+    self->system->copy(buffer, self->d->o_ptr, (size_t) bytes);
+    self->d->o_ptr += bytes;
+  }
   return bytes;
 }
 
@@ -1066,7 +1118,7 @@ static int chmd_sys_write(struct mspack_file *file, void *buffer, int bytes) {
  * CHMD_INIT_DECOMP
  ***************************************
  * Initialises the LZX decompressor to decompress the compressed stream,
- * from the nearest reset offset and length that is needed for the given
+ * or moves an existing one, to the nearest reset offset before the given
  * file.
  */
 static int chmd_init_decomp(struct mschm_decompressor_p *self,
@@ -1165,24 +1217,38 @@ static int chmd_init_decomp(struct mschm_decompressor_p *self,
     if (err) return self->error = err;
   }
 
+  /* if the stream is already between the reset point and the file, it
+   * is quicker to carry on from where it is */
+  self->d->reset_interval = reset_interval;
+  if (self->d->state && self->d->offset <= file->offset &&
+      self->d->offset >= (off_t) entry * LZX_FRAME_SIZE)
+  {
+    return self->error = MSPACK_ERR_OK;
+  }
+
   /* get offset of compressed data stream:
    * = offset of uncompressed section from start of file
    * + offset of compressed stream from start of uncompressed section
    * + offset of chosen reset interval from start of compressed stream */
   self->d->inoffset = file->section->chm->sec0.offset + sec->content->offset + offset;
 
-  /* set start offset and overall remaining stream length */
+  /* set start offset and overall stream length */
   self->d->offset = entry * LZX_FRAME_SIZE;
   self->d->length = length;
-  length -= self->d->offset;
-
-  /* initialise LZX stream */
-  self->d->state = lzxd_init(&self->d->sys, self->d->infh,
-                             (struct mspack_file *) self, window_bits,
-                             reset_interval / LZX_FRAME_SIZE,
-                             4096, length, 0);
-  if (!self->d->state) self->error = MSPACK_ERR_NOMEMORY;
-  return self->error;
+
+  /* initialise LZX stream, then move it to the reset point */
+  if (!self->d->state) {
+    self->d->state = lzxd_init(&self->d->sys, self->d->infh,
+                               (struct mspack_file *) self, window_bits,
+                               reset_interval / LZX_FRAME_SIZE,
+                               4096, length, 0);
+    if (!self->d->state) return self->error = MSPACK_ERR_NOMEMORY;
+  }
+  else {
+    lzxd_set_output_length(self->d->state, length);
+  }
+  return self->error = lzxd_seek(self->d->state, (unsigned int) entry,
+                                 self->d->inoffset);
 }
 
 /***************************************
@@ -0,0 +1,66 @@
+/* This file is part of libmspack.
+ * (C) 2003-2026 Stuart Caie.
+ *
+ * libmspack is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License (LGPL) version 2.1
+ *
+ * For further details, see the file COPYING.LIB distributed with libmspack
+ */
+
+#ifndef MSPACK_COPYMATCH_H
+#define MSPACK_COPYMATCH_H 1
+
+/* copy_match(dest, src, length) copies a match of length bytes from src
+ * to dest, with the same result as copying one byte at a time:
+ *
+ *   while (length--) *dest++ = *src++;
+ *
+ * src may be before dest and overlap it, in which case the bytes between
+ * them repeat as a pattern. src may also be after dest, as with matches
+ * that refer to the oldest part of a window. Only dest[0] to
+ * dest[length-1] are written; the bytes after them may still be needed
+ * as the source of later matches, so they are never overwritten.
+ *
+ * With GCC or clang, 8 bytes are copied at a time. If src is less than 8
+ * bytes before dest, the pattern is first extended until a whole copy of
+ * it is at least 8 bytes back, which can be copied from instead.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+# define COPY_MATCH_WORD(d, s) do {                                    \
+    unsigned long long w_; __builtin_memcpy(&w_, (s), 8);               \
+    __builtin_memcpy((d), &w_, 8);                                      \
+} while (0)
+#endif
+
+static inline void copy_match(unsigned char *dest, const unsigned char *src,
+                              unsigned int length)
+{
+#ifdef COPY_MATCH_WORD
+  const unsigned char *start = src;
+  if (length >= 8) {
+    if (src < dest && (dest - src) < 8) {
+      /* copy until the pattern (dest - src bytes long) has been repeated
+       * enough that src can move back a whole number of patterns */
+      unsigned int dist = (unsigned int) (dest - src);
+      unsigned int back = ((7 + dist) / dist) * dist;
+      unsigned int n = back - dist;
+      length -= n;
+      while (n--) *dest++ = *src++;
+      src = dest - back;
+    }
+    while (length >= 8) {
+      COPY_MATCH_WORD(dest, src);
+      dest += 8; src += 8; length -= 8;
+    }
+    if (length && src < dest && (src - start) + length >= 8) {
+      /* finish with 8 bytes that end at the end of the match. Some are
+       * written again, but with the same values */
+      COPY_MATCH_WORD(dest + length - 8, src + length - 8);
+      return;
+    }
+  }
+#endif
+  while (length--) *dest++ = *src++;
+}
+
+#endif
@@ -57,32 +57,12 @@ struct mskwajd_header_p {
 #define KWAJ_LITERAL_SYMS   (256)
 
 /* define decoding table sizes */
-#define KWAJ_TABLESIZE (1 << KWAJ_TABLEBITS)
-#if KWAJ_TABLESIZE < (KWAJ_MATCHLEN1_SYMS * 2)
-# define KWAJ_MATCHLEN1_TBLSIZE (KWAJ_MATCHLEN1_SYMS * 4)
-#else
-# define KWAJ_MATCHLEN1_TBLSIZE (KWAJ_TABLESIZE + (KWAJ_MATCHLEN1_SYMS * 2))
-#endif
-#if KWAJ_TABLESIZE < (KWAJ_MATCHLEN2_SYMS * 2)
-# define KWAJ_MATCHLEN2_TBLSIZE (KWAJ_MATCHLEN2_SYMS * 4)
-#else
-# define KWAJ_MATCHLEN2_TBLSIZE (KWAJ_TABLESIZE + (KWAJ_MATCHLEN2_SYMS * 2))
-#endif
-#if KWAJ_TABLESIZE < (KWAJ_LITLEN_SYMS * 2)
-# define KWAJ_LITLEN_TBLSIZE (KWAJ_LITLEN_SYMS * 4)
-#else
-# define KWAJ_LITLEN_TBLSIZE (KWAJ_TABLESIZE + (KWAJ_LITLEN_SYMS * 2))
-#endif
-#if KWAJ_TABLESIZE < (KWAJ_OFFSET_SYMS * 2)
-# define KWAJ_OFFSET_TBLSIZE (KWAJ_OFFSET_SYMS * 4)
-#else
-# define KWAJ_OFFSET_TBLSIZE (KWAJ_TABLESIZE + (KWAJ_OFFSET_SYMS * 2))
-#endif
-#if KWAJ_TABLESIZE < (KWAJ_LITERAL_SYMS * 2)
-# define KWAJ_LITERAL_TBLSIZE (KWAJ_LITERAL_SYMS * 4)
-#else
-# define KWAJ_LITERAL_TBLSIZE (KWAJ_TABLESIZE + (KWAJ_LITERAL_SYMS * 2))
-#endif
+#define KWAJ_TBLSIZE(syms) HUFF_TABLESIZE(syms, KWAJ_TABLEBITS, 16)
+#define KWAJ_MATCHLEN1_TBLSIZE KWAJ_TBLSIZE(KWAJ_MATCHLEN1_SYMS)
+#define KWAJ_MATCHLEN2_TBLSIZE KWAJ_TBLSIZE(KWAJ_MATCHLEN2_SYMS)
+#define KWAJ_LITLEN_TBLSIZE    KWAJ_TBLSIZE(KWAJ_LITLEN_SYMS)
+#define KWAJ_OFFSET_TBLSIZE    KWAJ_TBLSIZE(KWAJ_OFFSET_SYMS)
+#define KWAJ_LITERAL_TBLSIZE   KWAJ_TBLSIZE(KWAJ_LITERAL_SYMS)
 
 struct kwajd_stream {
     /* I/O buffering */
@@ -90,7 +70,8 @@ struct kwajd_stream {
     struct mspack_file *input;
     struct mspack_file *output;
     unsigned char *i_ptr, *i_end;
-    unsigned int bit_buffer, bits_left;
+    unsigned long bit_buffer;
+    unsigned int bits_left;
     int input_end;
 
     /* huffman code lengths */
@@ -381,6 +381,10 @@ static int kwajd_error(struct mskwaj_decompressor *base)
     }                                                   \
     INJECT_BITS(*i_ptr++, 8);                           \
 } while (0)
+#define READ_BYTES_FAST do {                                \
+    INJECT_BITS(FETCH_BE_BYTES(i_ptr), BITS_FAST_BITS);     \
+    i_ptr += BITS_FAST_BITS / 8;                            \
+} while (0)
 #include <readbits.h>
 
 /* import huffman-reading macros and code */
@@ -388,7 +392,6 @@ static int kwajd_error(struct mskwaj_decompressor *base)
 #define MAXSYMBOLS(tbl)     KWAJ_##tbl##_SYMS
 #define HUFF_TABLE(tbl,idx) lzh->tbl##_table[idx]
 #define HUFF_LEN(tbl,idx)   lzh->tbl##_len[idx]
-#define HUFF_ERROR          return MSPACK_ERR_DATAFORMAT
 #include <readhuff.h>
 
 /* In the KWAJ LZH format, there is no special 'eof' marker, it just
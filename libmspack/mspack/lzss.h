@@ -23,6 +23,20 @@ extern "C" {
 #define LZSS_MODE_MSHELP  (1)
 #define LZSS_MODE_QBASIC  (2)
 
+/* Output is decoded into a buffer, after a copy of the last
+ * LZSS_WINDOW_SIZE bytes of output, so matches are copied from earlier in
+ * the buffer rather than around a circular window. Once LZSS_OUTPUT_SIZE
+ * or more bytes are waiting, they are written out together and
+ * the last LZSS_WINDOW_SIZE bytes are moved to the start of the buffer.
+ * This is checked for before each control byte, so there's enough room
+ * after that for the output of one control byte: 8 matches of 18 bytes */
+#define LZSS_OUTPUT_SIZE (32768)
+#define LZSS_OUTPUT_MAX  (8 * 18)
+
+/* the size of the buffer lzss_decompress_buf() needs */
+#define LZSS_BUFFER_SIZE(input_buffer_size) (LZSS_WINDOW_SIZE + \
+    LZSS_OUTPUT_SIZE + LZSS_OUTPUT_MAX + (input_buffer_size))
+
 /**
  * Decompresses an LZSS stream.
  *
@@ -59,6 +73,23 @@ extern int lzss_decompress(struct mspack_system *system,
                            int input_buffer_size,
                            int mode);
 
+/**
+ * Decompresses an LZSS stream, like lzss_decompress(), using the given
+ * buffer rather than allocating one. This lets the same buffer be used
+ * for many streams.
+ *
+ * @param buf  a buffer of at least LZSS_BUFFER_SIZE(input_buffer_size)
+ *             bytes. Its contents don't matter, and it can be used again
+ *             once this returns.
+ * @see lzss_decompress() for the other parameters and return value
+ */
+extern int lzss_decompress_buf(struct mspack_system *system,
+                               struct mspack_file *input,
+                               struct mspack_file *output,
+                               unsigned char *buf,
+                               int input_buffer_size,
+                               int mode);
+
 #ifdef __cplusplus
 }
 #endif
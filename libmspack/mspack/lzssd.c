@@ -13,25 +13,40 @@
 
 #include <system.h>
 #include <lzss.h>
+#include <copymatch.h>
+
+/* the number of input bytes that follow each control byte: 1 for each
+ * set bit (a literal) and 2 for each clear bit (a match) */
+#define B2(n) 16-(n), 15-(n), 15-(n), 14-(n)
+#define B4(n) B2(n), B2(n+1), B2(n+1), B2(n+2)
+#define B6(n) B4(n), B4(n+1), B4(n+1), B4(n+2)
+static const unsigned char lzss_group_bytes[256] = {
+    B6(0), B6(1), B6(1), B6(2)
+};
+#undef B2
+#undef B4
+#undef B6
 
 #define ENSURE_BYTES do {                               \
     if (i_ptr >= i_end) {                               \
         read = system->read(input, &inbuf[0],           \
                             input_buffer_size);         \
         if (read <= 0) {                                \
-            system->free(window);                       \
-            return (read < 0) ? MSPACK_ERR_READ         \
-                              : MSPACK_ERR_OK;          \
+            err = (read < 0) ? MSPACK_ERR_READ          \
+                             : MSPACK_ERR_OK;           \
+            goto done;                                  \
         }                                               \
         i_ptr = &inbuf[0]; i_end = &inbuf[read];        \
     }                                                   \
 } while (0)
 
-#define WRITE_BYTE do {                                 \
-    if (system->write(output, &window[pos], 1) != 1) {  \
-        system->free(window);                           \
-        return MSPACK_ERR_WRITE;                        \
-    }                                                   \
+/* copies a match from mpos in the window. If mpos is where the output is
+ * in the window, it's the whole window size back */
+#define COPY_MATCH do {                                                 \
+    dist = ((pos_base + (unsigned int) (o - out) - mpos - 1)            \
+            & (LZSS_WINDOW_SIZE - 1)) + 1;                              \
+    copy_match(o, o - dist, len);                                       \
+    o += len;                                                           \
 } while (0)
 
 int lzss_decompress(struct mspack_system *system,
@@ -40,54 +55,100 @@ int lzss_decompress(struct mspack_system *system,
                     int input_buffer_size,
                     int mode)
 {
-    unsigned char *window, *inbuf, *i_ptr, *i_end;
-    unsigned int pos, i, c, invert, mpos, len;
-    int read;
+    unsigned char *buf;
+    int err;
+
+    if (!system || input_buffer_size < 1) return MSPACK_ERR_ARGS;
+    buf = (unsigned char *) system->alloc(system,
+        LZSS_BUFFER_SIZE(input_buffer_size));
+    if (!buf) return MSPACK_ERR_NOMEMORY;
+    err = lzss_decompress_buf(system, input, output, buf,
+                              input_buffer_size, mode);
+    system->free(buf);
+    return err;
+}
+
+int lzss_decompress_buf(struct mspack_system *system,
+                        struct mspack_file *input,
+                        struct mspack_file *output,
+                        unsigned char *buf,
+                        int input_buffer_size,
+                        int mode)
+{
+    unsigned char *out, *o, *o_end, *inbuf, *i_ptr, *i_end;
+    unsigned int pos_base, i, c, invert, mpos, len, dist;
+    int read, err = MSPACK_ERR_OK;
 
     /* check parameters */
-    if (!system || input_buffer_size < 1 || (mode != LZSS_MODE_EXPAND &&
-        mode != LZSS_MODE_MSHELP && mode != LZSS_MODE_QBASIC))
+    if (!system || !buf || input_buffer_size < 1 ||
+        (mode != LZSS_MODE_EXPAND && mode != LZSS_MODE_MSHELP &&
+         mode != LZSS_MODE_QBASIC))
     {
         return MSPACK_ERR_ARGS;
     }
 
-    /* allocate memory */
-    window = (unsigned char *) system->alloc(system, LZSS_WINDOW_SIZE + input_buffer_size);
-    if (!window) return MSPACK_ERR_NOMEMORY;
-
-    /* initialise decompression */
-    inbuf = &window[LZSS_WINDOW_SIZE];
-    memset(window, LZSS_WINDOW_FILL, (size_t) LZSS_WINDOW_SIZE);
-    pos = LZSS_WINDOW_SIZE - ((mode == LZSS_MODE_QBASIC) ? 18 : 16);
+    /* initialise decompression. The output at out is at pos_base in the
+     * window, and the output at o is at pos_base + (o - out) */
+    out   = &buf[LZSS_WINDOW_SIZE];
+    o_end = &out[LZSS_OUTPUT_SIZE];
+    inbuf = &o_end[LZSS_OUTPUT_MAX];
+    memset(buf, LZSS_WINDOW_FILL, (size_t) LZSS_WINDOW_SIZE);
+    pos_base = LZSS_WINDOW_SIZE - ((mode == LZSS_MODE_QBASIC) ? 18 : 16);
     invert = (mode == LZSS_MODE_MSHELP) ? ~0 : 0;
     i_ptr = i_end = &inbuf[0];
+    o = out;
 
     /* loop forever; exit condition is in ENSURE_BYTES macro */
     for (;;) {
-        ENSURE_BYTES; c = *i_ptr++ ^ invert;
-        for (i = 0x01; i & 0xFF; i <<= 1) {
-            if (c & i) {
-                /* literal */
-                ENSURE_BYTES; window[pos] = *i_ptr++;
-                WRITE_BYTE;
-                pos++; pos &= LZSS_WINDOW_SIZE - 1;
+        if (o >= o_end) {
+            len = (unsigned int) (o - out);
+            if (system->write(output, out, (int) len) != (int) len) {
+                return MSPACK_ERR_WRITE;
             }
-            else {
-                /* match */
-                ENSURE_BYTES; mpos = *i_ptr++;
-                ENSURE_BYTES; mpos |= (*i_ptr & 0xF0) << 4;
-                len = (*i_ptr++ & 0x0F) + 3;
-                while (len--) {
-                    window[pos] = window[mpos];
-                    WRITE_BYTE;
-                    pos++;  pos  &= LZSS_WINDOW_SIZE - 1;
-                    mpos++; mpos &= LZSS_WINDOW_SIZE - 1;
+            system->copy(o - LZSS_WINDOW_SIZE, buf, LZSS_WINDOW_SIZE);
+            pos_base += len;
+            o = out;
+        }
+
+        ENSURE_BYTES; c = (*i_ptr++ ^ invert) & 0xFF;
+        if ((unsigned int) (i_end - i_ptr) >= lzss_group_bytes[c]) {
+            /* all input for this control byte is here, no need to check */
+            for (i = 0x01; i & 0xFF; i <<= 1) {
+                if (c & i) {
+                    /* literal */
+                    *o++ = *i_ptr++;
+                }
+                else {
+                    /* match */
+                    mpos = i_ptr[0] | ((i_ptr[1] & 0xF0) << 4);
+                    len  = (i_ptr[1] & 0x0F) + 3;
+                    i_ptr += 2;
+                    COPY_MATCH;
+                }
+            }
+        }
+        else {
+            for (i = 0x01; i & 0xFF; i <<= 1) {
+                if (c & i) {
+                    /* literal */
+                    ENSURE_BYTES; *o++ = *i_ptr++;
+                }
+                else {
+                    /* match */
+                    ENSURE_BYTES; mpos = *i_ptr++;
+                    ENSURE_BYTES; mpos |= (*i_ptr & 0xF0) << 4;
+                    len = (*i_ptr++ & 0x0F) + 3;
+                    COPY_MATCH;
                 }
             }
         }
     }
 
-    /* not reached */
-    system->free(window);
-    return MSPACK_ERR_OK;
+done:
+    /* write out what remains */
+    len = (unsigned int) (o - out);
+    if (len && system->write(output, out, (int) len) != (int) len) {
+        err = MSPACK_ERR_WRITE;
+    }
+    return err;
 }
@@ -42,9 +42,32 @@ extern "C" {
 #define LZX_ALIGNED_MAXSYMBOLS  (LZX_ALIGNED_NUM_ELEMENTS)
 #define LZX_ALIGNED_TABLEBITS   (7)
 #define LZX_LENTABLE_SAFETY (64)  /* table decoding overruns are allowed */
+#define LZX_TABLESIZE(tbl) HUFF_TABLESIZE(LZX_##tbl##_MAXSYMBOLS, \
+                                          LZX_##tbl##_TABLEBITS, 16)
+
+/* if non-zero, up to three literals can be decoded with one lookup of
+ * this many bits (see make_multi_table() in readhuff.h), e.g. 12. If zero,
+ * only the main tree's regular table is used, one symbol at a time */
+#ifndef LZX_MAINTREE_MULTIBITS
+# define LZX_MAINTREE_MULTIBITS (0)
+#endif
 
 #define LZX_FRAME_SIZE (32768) /* the size of a frame in LZX */
 
+/* if LZX_PROFILE is defined when building lzxd.c, lzxd_decompress() adds
+ * the CPU cycles spent in each phase of decoding to prof_ticks[] (or clock()
+ * ticks, on CPUs without a cycle counter). Timing every match copy slows
+ * decoding down, so only use it to see where the time goes */
+#define LZX_PROF_HEADER (0) /* block headers and building huffman tables */
+#define LZX_PROF_DECODE (1) /* decoding blocks, including LZX_PROF_COPY     */
+#define LZX_PROF_COPY   (2) /* copying matches                              */
+#define LZX_PROF_E8     (3) /* Intel E8 translation and undoing it          */
+#define LZX_PROF_WRITE  (4) /* writing output with system->write()          */
+#define LZX_PROF_PHASES (5)
+
+struct mspack_step;       /* see step.h */
+struct lzxd_step_state;
+
 struct lzxd_stream {
   struct mspack_system *sys;      /* I/O routines                            */
   struct mspack_file   *input;    /* input file handle                       */
@@ -54,7 +77,9 @@ struct lzxd_stream {
   off_t   length;                 /* overall decompressed length of stream   */
 
   unsigned char *window;          /* decoding window                         */
+  unsigned char *window_end;      /* end of window, or shared reference data */
   unsigned int   window_size;     /* window size                             */
+  unsigned int   window_alloc;    /* bytes of the window allocated so far    */
   unsigned int   ref_data_size;   /* LZX DELTA reference data size           */
   unsigned int   num_offsets;     /* number of match_offset entries in table */
   unsigned int   window_posn;     /* decompression offset within window      */
@@ -73,12 +98,14 @@ struct lzxd_stream {
   unsigned char  header_read;     /* have we started decoding at all yet?    */
   unsigned char  input_end;       /* have we reached the end of input?       */
   unsigned char  is_delta;        /* does stream follow LZX DELTA spec?      */
+  unsigned char  shared_ref;      /* is reference data shared (not window)?  */
 
   int error;
 
   /* I/O buffering */
   unsigned char *inbuf, *i_ptr, *i_end, *o_ptr, *o_end;
-  unsigned int  bit_buffer, bits_left, inbuf_size;
+  unsigned long bit_buffer;
+  unsigned int  bits_left, inbuf_size;
 
   /* huffman code lengths */
   unsigned char PRETREE_len  [LZX_PRETREE_MAXSYMBOLS  + LZX_LENTABLE_SAFETY];
@@ -87,18 +114,33 @@ struct lzxd_stream {
   unsigned char ALIGNED_len  [LZX_ALIGNED_MAXSYMBOLS  + LZX_LENTABLE_SAFETY];
 
   /* huffman decoding tables */
-  unsigned short PRETREE_table [(1 << LZX_PRETREE_TABLEBITS) +
-                                (LZX_PRETREE_MAXSYMBOLS * 2)];
-  unsigned short MAINTREE_table[(1 << LZX_MAINTREE_TABLEBITS) +
-                                (LZX_MAINTREE_MAXSYMBOLS * 2)];
-  unsigned short LENGTH_table  [(1 << LZX_LENGTH_TABLEBITS) +
-                                (LZX_LENGTH_MAXSYMBOLS * 2)];
-  unsigned short ALIGNED_table [(1 << LZX_ALIGNED_TABLEBITS) +
-                                (LZX_ALIGNED_MAXSYMBOLS * 2)];
+  unsigned short PRETREE_table [LZX_TABLESIZE(PRETREE)];
+  unsigned short MAINTREE_table[LZX_TABLESIZE(MAINTREE)];
+  unsigned short LENGTH_table  [LZX_TABLESIZE(LENGTH)];
+  unsigned short ALIGNED_table [LZX_TABLESIZE(ALIGNED)];
+#if LZX_MAINTREE_MULTIBITS
+  unsigned int   MAINTREE_multi[1 << LZX_MAINTREE_MULTIBITS];
+#endif
   unsigned char LENGTH_empty;
 
-  /* this is used purely for doing the intel E8 transform */
-  unsigned char  e8_buf[LZX_FRAME_SIZE];
+  /* have the code lengths changed since the tables were last built? */
+  unsigned char MAINTREE_changed;
+  unsigned char LENGTH_changed;
+
+  /* the intel E8 transform is done in the window, and undone once the
+   * frame has been written. These say where to undo it, if needed */
+  unsigned char *e8_frame;
+  unsigned int   e8_length;
+  signed int     e8_curpos, e8_filesize;
+
+  /* used instead if the transform can't be undone (negative filesize) */
+  unsigned char *e8_buf;
+
+  /* time spent in each phase, only counted if built with LZX_PROFILE */
+  unsigned long long prof_ticks[LZX_PROF_PHASES];
+
+  /* state for lzxd_step(), allocated on first use */
+  struct lzxd_step_state *step;
 };
 
 /**
@@ -131,8 +173,10 @@ struct lzxd_stream {
  *                           advance. It is used to correctly perform the
  *                           Intel E8 transformation, which must stop 6
  *                           bytes before the very end of the
- *                           decompressed stream. It is not otherwise used
- *                           or adhered to. If the full decompressed
+ *                           decompressed stream, and to allocate no more
+ *                           window than a short stream needs. The window
+ *                           grows as needed if more is decoded, so it is
+ *                           not otherwise adhered to. If the full decompressed
  *                           length is known in advance, set it here.
  *                           If it is NOT known, use the value 0, and call
  *                           lzxd_set_output_length() once it is
@@ -152,10 +196,95 @@ extern struct lzxd_stream *lzxd_init(struct mspack_system *system,
                                      off_t output_length,
                                      char is_delta);
 
+/**
+ * Makes an LZX DELTA stream read its reference data from memory, instead
+ * of from a private copy in its window as lzxd_set_reference_data() does.
+ *
+ * The reference data is only ever read, so many streams can share the
+ * same buffer, and the stream's window is shrunk to only hold the output.
+ * This means the output must fit in the window alongside the reference
+ * data without wrapping around it, as it does in OAB patches.
+ *
+ * Call this before the first call to lzxd_decompress(), instead of
+ * lzxd_set_reference_data(). The data must remain allocated and unchanged
+ * until lzxd_free() is called.
+ *
+ * @param lzx    the LZX stream to apply this reference data to
+ * @param data   the reference data
+ * @param length the length of the reference data. Must be shorter than
+ *               the LZX window size.
+ * @return an error code, or MSPACK_ERR_OK if successful
+ */
+extern int lzxd_share_reference_data(struct lzxd_stream *lzx,
+                                     const unsigned char *data,
+                                     unsigned int length);
+
 /* see description of output_length in lzxd_init() */
 extern void lzxd_set_output_length(struct lzxd_stream *lzx,
                                    off_t output_length);
 
+/**
+ * Moves an LZX stream to a reset point, so decoding can start from there
+ * instead of from the start of the stream.
+ *
+ * The LZX bitstream restarts every reset_interval frames (see
+ * lzxd_init()), and nothing after a reset refers to anything before it.
+ * If the compressed offset of a reset is known, e.g. from a CHM reset
+ * table, lzxd_seek() seeks the input there using system->seek(), and
+ * the next lzxd_decompress() call writes output starting from that frame.
+ * All previous state is discarded, including any error. Intel E8
+ * translation positions count from the last reset point, as they do when
+ * decoding straight through, so the output is the same either way.
+ *
+ * @param lzx       the LZX stream to move
+ * @param frame     the frame to move to. This must be a multiple of the
+ *                  stream's reset interval, or 0 if it has none.
+ * @param in_offset the offset in the input file of the compressed data
+ *                  for that frame, as given to system->seek()
+ * @return an error code, or MSPACK_ERR_OK if successful
+ */
+extern int lzxd_seek(struct lzxd_stream *lzx, unsigned int frame,
+                     off_t in_offset);
+
+/**
+ * Saves the state of an LZX stream, so decoding can later resume from
+ * this point with lzxd_restore(), without decoding everything before it.
+ *
+ * This saves the whole window, the repeated offsets, huffman code lengths
+ * and position in the bitstream, as they are after the last call to
+ * lzxd_decompress(). The position of the LZX input is found with
+ * system->tell(), using the mspack_system given to lzxd_init().
+ *
+ * @param lzx    the LZX stream to save
+ * @param system an mspack_system implementation to use with the
+ *               output param. Only write() will be called.
+ * @param output an output file handle to write the checkpoint to
+ * @return an error code, or MSPACK_ERR_OK if successful
+ */
+extern int lzxd_checkpoint(struct lzxd_stream *lzx,
+                           struct mspack_system *system,
+                           struct mspack_file *output);
+
+/**
+ * Restores the state of an LZX stream saved by lzxd_checkpoint(). The
+ * stream must have the same window size, reset interval and LZX DELTA
+ * setting as the one that was saved, and read the same input. The input
+ * is moved to where it was using system->seek(), using the mspack_system
+ * given to lzxd_init().
+ *
+ * If an error is returned, the stream is unusable, as with errors from
+ * lzxd_decompress().
+ *
+ * @param lzx    the LZX stream to restore
+ * @param system an mspack_system implementation to use with the
+ *               input param. Only read() will be called.
+ * @param input  an input file handle to read the checkpoint from
+ * @return an error code, or MSPACK_ERR_OK if successful
+ */
+extern int lzxd_restore(struct lzxd_stream *lzx,
+                        struct mspack_system *system,
+                        struct mspack_file *input);
+
 /**
  * Reads LZX DELTA reference data into the window and allows
  * lzxd_decompress() to reference it.
@@ -205,6 +334,67 @@ extern int lzxd_set_reference_data(struct lzxd_stream *lzx,
  */
 extern int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes);
 
+/**
+ * Decompresses more of an LZX stream, like lzxd_decompress(), but throws
+ * the output away rather than writing it.
+ *
+ * This is for getting to a point further on in the stream. Frames which
+ * are thrown away in full are not written or Intel E8 translated, so
+ * only the cost of decoding them remains.
+ *
+ * @param lzx       LZX decompression state, as allocated by lzxd_init().
+ * @param out_bytes the number of bytes of data to skip.
+ * @return an error code, or MSPACK_ERR_OK if successful
+ */
+extern int lzxd_skip(struct lzxd_stream *lzx, off_t out_bytes);
+
+/**
+ * Decompresses more of an LZX stream from and to memory buffers, in pull
+ * mode (see step.h), without calling system->read() or system->write().
+ *
+ * Takes input from step->next_in, and puts output at step->next_out,
+ * until step->avail_out is zero, the stream ends, or all input has been
+ * used, whichever comes first. The stream ends once the output length
+ * given to lzxd_init() or lzxd_set_output_length() has been output or, if
+ * that isn't known, when all input has been used and step->end_of_input
+ * is set.
+ *
+ * Don't mix this with lzxd_decompress(), lzxd_seek() or checkpoints on
+ * the same stream, as the input they read is not the input given here.
+ *
+ * @param lzx  LZX decompression state, as allocated by lzxd_init().
+ * @param step the input and output buffers
+ * @return MSPACK_ERR_OK if step->avail_out is zero, MSPACK_STEP_END if the
+ *         stream has ended, MSPACK_STEP_NEED_INPUT if all input has been
+ *         used, or an error code
+ */
+extern int lzxd_step(struct lzxd_stream *lzx, struct mspack_step *step);
+
+/* methods for lzxd_e8_translate() */
+#define LZX_E8_AUTO   (0) /* the fastest method this CPU supports */
+#define LZX_E8_SCALAR (1) /* one byte at a time, works everywhere */
+#define LZX_E8_SSE2   (2) /* 16 bytes at a time, x86 with SSE2 only */
+#define LZX_E8_AVX2   (3) /* 32 bytes at a time, x86 with AVX2 only */
+#define LZX_E8_UNDO   (16) /* add to reverse a translation (filesize > 0) */
+
+/**
+ * Performs the Intel E8 translation on one frame of decompressed data,
+ * or reverses it. lzxd_decompress() does this itself, it is exposed so
+ * that the different methods can be tested against each other.
+ *
+ * @param data     the frame of data to translate in-place
+ * @param length   the length of the frame, in bytes
+ * @param curpos   the offset of the frame within the output stream
+ * @param filesize the Intel E8 translation file size
+ * @param method   one of the LZX_E8_* methods
+ * @return MSPACK_ERR_OK, or MSPACK_ERR_ARGS if the method is not supported
+ *         by this build of libmspack or this CPU, or if asked to undo a
+ *         translation with a filesize that isn't positive
+ */
+extern int lzxd_e8_translate(unsigned char *data, unsigned int length,
+                             signed int curpos, signed int filesize,
+                             int method);
+
 /**
  * Frees all state associated with an LZX data stream. This will call
  * system->free() using the system pointer given in lzxd_init().
@@ -14,6 +14,9 @@
 
 #include <system.h>
 #include <lzx.h>
+#include <copymatch.h>
+#include <step.h>
+#include <stddef.h>
 
 /* Microsoft's LZX document (in cab-sdk.exe) and their implementation
  * of the com.ms.util.cab Java package do not concur.
@@ -89,6 +92,10 @@
     READ_IF_NEEDED; b1 = *i_ptr++;      \
     INJECT_BITS((b1 << 8) | b0, 16);    \
 } while (0)
+#define READ_BYTES_FAST do {                                    \
+    INJECT_BITS(FETCH_LE16_WORDS(i_ptr), BITS_FAST_BITS);       \
+    i_ptr += BITS_FAST_BITS / 8;                                \
+} while (0)
 #include <readbits.h>
 
 /* import huffman-reading macros and code */
@@ -96,7 +103,10 @@
 #define MAXSYMBOLS(tbl)     LZX_##tbl##_MAXSYMBOLS
 #define HUFF_TABLE(tbl,idx) lzx->tbl##_table[idx]
 #define HUFF_LEN(tbl,idx)   lzx->tbl##_len[idx]
-#define HUFF_ERROR          return lzx->error = MSPACK_ERR_DECRUNCH
+#if LZX_MAINTREE_MULTIBITS
+# define MULTIBITS(tbl)      LZX_##tbl##_MULTIBITS
+# define HUFF_MULTI(tbl,idx) lzx->tbl##_multi[idx]
+#endif
 #include <readhuff.h>
 
 /* BUILD_TABLE(tbl) builds a huffman lookup table from code lengths */
@@ -124,23 +134,64 @@
     }                                                                   \
 } while (0)
 
+/* LZX_WINDOW_MAX(lzx) is the most the window can grow to, which doesn't
+ * include shared reference data (see lzxd_share_reference_data()) */
+#define LZX_WINDOW_MAX(lzx) ((lzx)->window_size - \
+    ((lzx)->shared_ref ? (lzx)->ref_data_size : 0))
+
+/* PROF_START(t) and PROF_END(t, phase) add the time between them to
+ * lzx->prof_ticks[phase], if built with LZX_PROFILE (see lzx.h).
+ * PROF_VAR(t) declares t */
+#ifdef LZX_PROFILE
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define PROF_CLOCK() __builtin_ia32_rdtsc()
+# else
+#  include <time.h>
+#  define PROF_CLOCK() ((unsigned long long) clock())
+# endif
+# define PROF_VAR(t) unsigned long long t;
+# define PROF_START(t) (t) = PROF_CLOCK()
+# define PROF_END(t, phase) lzx->prof_ticks[phase] += PROF_CLOCK() - (t)
+#else
+# define PROF_VAR(t)
+# define PROF_START(t)
+# define PROF_END(t, phase)
+#endif
+
+/* UNREAD_WORDS puts any whole 16-bit words left in the bit buffer back
+ * into the input buffer, so uncompressed blocks can be read from it
+ * directly. The bit buffer may hold words from an input buffer that has
+ * since been refilled, so lzxd_init() allocates room for up to
+ * sizeof(bitbuf_type) bytes before the start of inbuf.
+ */
+#define UNREAD_WORDS do {                               \
+    i_ptr -= bits_left >> 3;                            \
+    for (i = 0; bits_left >= 16; i += 2) {              \
+        j = PEEK_BITS(16); REMOVE_BITS(16);             \
+        i_ptr[i] = j & 0xFF; i_ptr[i + 1] = j >> 8;     \
+    }                                                   \
+} while (0)
+
 /* READ_LENGTHS(tablename, first, last) reads in code lengths for symbols
  * first to last in the given table. The code lengths are stored in their
- * own special LZX way.
+ * own special LZX way. If any length differs from before, tbl_changed is
+ * set to say the table must be rebuilt.
  */
 #define READ_LENGTHS(tbl, first, last) do {             \
   STORE_BITS;                                           \
   if (lzxd_read_lens(lzx, &HUFF_LEN(tbl, 0), (first),   \
-    (unsigned int)(last))) return lzx->error;           \
+    (unsigned int)(last), &lzx->tbl##_changed))         \
+    return lzx->error;                                  \
   RESTORE_BITS;                                         \
 } while (0)
 
 static int lzxd_read_lens(struct lzxd_stream *lzx, unsigned char *lens,
-                          unsigned int first, unsigned int last)
+                          unsigned int first, unsigned int last,
+                          unsigned char *changed)
 {
   DECLARE_HUFF_VARS;
   unsigned int x, y;
-  int z;
+  int z, diff = 0;
 
   RESTORE_BITS;
   
@@ -156,28 +207,30 @@ static int lzxd_read_lens(struct lzxd_stream *lzx, unsigned char *lens,
     if (z == 17) {
       /* code = 17, run of ([read 4 bits]+4) zeros */
       READ_BITS(y, 4); y += 4;
-      while (y--) lens[x++] = 0;
+      while (y--) { diff |= lens[x]; lens[x++] = 0; }
     }
     else if (z == 18) {
       /* code = 18, run of ([read 5 bits]+20) zeros */
       READ_BITS(y, 5); y += 20;
-      while (y--) lens[x++] = 0;
+      while (y--) { diff |= lens[x]; lens[x++] = 0; }
     }
     else if (z == 19) {
       /* code = 19, run of ([read 1 bit]+4) [read huffman symbol] */
       READ_BITS(y, 1); y += 4;
       READ_HUFFSYM(PRETREE, z);
       z = lens[x] - z; if (z < 0) z += 17;
-      while (y--) lens[x++] = z;
+      while (y--) { diff |= lens[x] ^ z; lens[x++] = z; }
     }
     else {
       /* code = 0 to 16, delta current length entry */
+      diff |= z;
       z = lens[x] - z; if (z < 0) z += 17;
       lens[x++] = z;
     }
   }
 
   STORE_BITS;
+  if (diff) *changed = 1;
 
   return MSPACK_ERR_OK;
 }
@@ -254,6 +307,189 @@ static const unsigned int position_base[290] = {
     33161216, 33292288, 33423360
 };
 
+/* READ_DELTA_LENGTH adds the LZX DELTA extra length to match_length */
+#define READ_DELTA_LENGTH do {                                          \
+    int extra_len = 0;                                                  \
+    ENSURE_BITS(3); /* 4 entry huffman tree */                          \
+    if (PEEK_BITS(1) == 0) {                                            \
+        REMOVE_BITS(1); /* '0' -> 8 extra length bits */                \
+        READ_BITS(extra_len, 8);                                        \
+    }                                                                   \
+    else if (PEEK_BITS(2) == 2) {                                       \
+        REMOVE_BITS(2); /* '10' -> 10 extra length bits + 0x100 */      \
+        READ_BITS(extra_len, 10);                                       \
+        extra_len += 0x100;                                             \
+    }                                                                   \
+    else if (PEEK_BITS(3) == 6) {                                       \
+        REMOVE_BITS(3); /* '110' -> 12 extra length bits + 0x500 */     \
+        READ_BITS(extra_len, 12);                                       \
+        extra_len += 0x500;                                             \
+    }                                                                   \
+    else {                                                              \
+        REMOVE_BITS(3); /* '111' -> 15 extra length bits */             \
+        READ_BITS(extra_len, 15);                                       \
+    }                                                                   \
+    match_length += extra_len;                                          \
+} while (0)
+
+/* COPY_MATCH copies a match of match_length bytes, match_offset bytes
+ * back, to window_posn in the window. It doesn't update window_posn */
+#define COPY_MATCH do {                                                 \
+    if ((window_posn + match_length) > lzx->window_alloc) {             \
+        D(("match ran over window wrap"))                               \
+        return lzx->error = MSPACK_ERR_DECRUNCH;                        \
+    }                                                                   \
+                                                                        \
+    PROF_START(prof_m);                                                 \
+    rundest = &window[window_posn];                                     \
+    i = match_length;                                                   \
+    /* does match offset wrap the window? */                            \
+    if (match_offset > window_posn) {                                   \
+        if ((off_t)match_offset > lzx->offset &&                        \
+            (match_offset - window_posn) > lzx->ref_data_size)          \
+        {                                                               \
+            D(("match offset beyond LZX stream"))                       \
+            return lzx->error = MSPACK_ERR_DECRUNCH;                    \
+        }                                                               \
+        /* j = length from match offset to end of window */             \
+        j = match_offset - window_posn;                                 \
+        if (j > (int) lzx->window_size) {                               \
+            D(("match offset beyond window boundaries"))                \
+            return lzx->error = MSPACK_ERR_DECRUNCH;                    \
+        }                                                               \
+        runsrc = lzx->window_end - j;                                   \
+        if (j < i) {                                                    \
+            /* if match goes over the window edge, do two copy runs */  \
+            copy_match(rundest, runsrc, j);                             \
+            rundest += j; i -= j;                                       \
+            runsrc = window;                                            \
+        }                                                               \
+        copy_match(rundest, runsrc, i);                                 \
+    }                                                                   \
+    else {                                                              \
+        copy_match(rundest, rundest - match_offset, i);                 \
+    }                                                                   \
+    PROF_END(prof_m, LZX_PROF_COPY);                                    \
+} while (0)
+
+/* lzxd_decode_fast() decodes symbols without checking the input buffer
+ * (see ENSURE_BITS_FAST), so it must stop once there is less input left
+ * than the largest symbol could need: a main tree code, a length tree
+ * code and 17 offset bits. The rare LZX DELTA extra lengths are read
+ * with the regular macros.
+ */
+#define LZX_FAST_INPUT BITS_FAST_INPUT(16 + 16 + 17)
+
+/* DECODE_FAST calls lzxd_decode_fast() on the current block */
+#define DECODE_FAST do {                                                \
+    STORE_BITS;                                                         \
+    lzx->window_posn = window_posn;                                     \
+    lzx->R0 = R0; lzx->R1 = R1; lzx->R2 = R2;                           \
+    if (lzxd_decode_fast(lzx, &this_run)) return lzx->error;            \
+    RESTORE_BITS;                                                       \
+    window_posn = lzx->window_posn;                                     \
+    R0 = lzx->R0; R1 = lzx->R1; R2 = lzx->R2;                           \
+} while (0)
+
+static int lzxd_decode_fast(struct lzxd_stream *lzx, int *run) {
+  DECLARE_HUFF_VARS;
+  unsigned char *window = lzx->window, *runsrc, *rundest;
+  unsigned int window_posn = lzx->window_posn, match_offset;
+  unsigned int R0 = lzx->R0, R1 = lzx->R1, R2 = lzx->R2;
+  int this_run = *run, main_element, length_footer, verbatim_bits;
+  int aligned_bits, extra, match_length, i, j;
+#if LZX_MAINTREE_MULTIBITS
+  unsigned int multi;
+#endif
+  PROF_VAR(prof_m)
+
+  RESTORE_BITS;
+  while (this_run > 0 && (i_end - i_ptr) >= LZX_FAST_INPUT) {
+#if LZX_MAINTREE_MULTIBITS
+    /* decode up to three literals at once, if they fit in this run */
+    ENSURE_BITS_FAST(HUFF_MAXBITS);
+    PEEK_HUFFMULTI(MAINTREE, multi);
+    if ((i = HUFF_MULTI_COUNT(multi)) != 0 && i <= this_run) {
+      REMOVE_BITS(HUFF_MULTI_BITS(multi));
+      window[window_posn] = HUFF_MULTI_SYM(multi, 0);
+      if (i > 1) window[window_posn + 1] = HUFF_MULTI_SYM(multi, 1);
+      if (i > 2) window[window_posn + 2] = HUFF_MULTI_SYM(multi, 2);
+      window_posn += i;
+      this_run -= i;
+      continue;
+    }
+    if (i == 0 && HUFF_MULTI_BITS(multi)) {
+      main_element = HUFF_MULTI_ONE(multi);
+      REMOVE_BITS(HUFF_MULTI_BITS(multi));
+    }
+    else {
+      DECODE_HUFFSYM(MAINTREE, main_element);
+    }
+#else
+    READ_HUFFSYM_FAST(MAINTREE, main_element);
+#endif
+    if (main_element < LZX_NUM_CHARS) {
+      /* literal: 0 to LZX_NUM_CHARS-1 */
+      window[window_posn++] = main_element;
+      this_run--;
+      continue;
+    }
+
+    /* match: LZX_NUM_CHARS + ((slot<<3) | length_header (3 bits)) */
+    main_element -= LZX_NUM_CHARS;
+
+    /* get match length */
+    match_length = main_element & LZX_NUM_PRIMARY_LENGTHS;
+    if (match_length == LZX_NUM_PRIMARY_LENGTHS) {
+      if (lzx->LENGTH_empty) {
+        D(("LENGTH symbol needed but tree is empty"))
+        return lzx->error = MSPACK_ERR_DECRUNCH;
+      }
+      READ_HUFFSYM_FAST(LENGTH, length_footer);
+      match_length += length_footer;
+    }
+    match_length += LZX_MIN_MATCH;
+
+    /* get match offset */
+    switch ((match_offset = (main_element >> 3))) {
+    case 0: match_offset = R0; break;
+    case 1: match_offset = R1; R1=R0; R0 = match_offset; break;
+    case 2: match_offset = R2; R2=R0; R0 = match_offset; break;
+    default:
+      extra = (match_offset >= 36) ? 17 : extra_bits[match_offset];
+      match_offset = position_base[match_offset] - 2;
+      if (extra >= 3 && lzx->block_type == LZX_BLOCKTYPE_ALIGNED) {
+        if (extra > 3) {
+          READ_BITS_FAST(verbatim_bits, extra - 3); /* 1-14 bits */
+          match_offset += verbatim_bits << 3;
+        }
+        READ_HUFFSYM_FAST(ALIGNED, aligned_bits);
+        match_offset += aligned_bits;
+      }
+      else if (extra) {
+        READ_BITS_FAST(verbatim_bits, extra); /* 1-17 bits */
+        match_offset += verbatim_bits;
+      }
+      /* update repeated offset LRU queue */
+      R2 = R1; R1 = R0; R0 = match_offset;
+    }
+
+    /* LZX DELTA uses max match length to signal even longer match */
+    if (match_length == LZX_MAX_MATCH && lzx->is_delta) {
+      READ_DELTA_LENGTH;
+    }
+
+    COPY_MATCH;
+    this_run    -= match_length;
+    window_posn += match_length;
+  }
+  STORE_BITS;
+  lzx->window_posn = window_posn;
+  lzx->R0 = R0; lzx->R1 = R1; lzx->R2 = R2;
+  *run = this_run;
+  return MSPACK_ERR_OK;
+}
+
 static void lzxd_reset_state(struct lzxd_stream *lzx) {
   int i;
 
@@ -267,10 +503,174 @@ static void lzxd_reset_state(struct lzxd_stream *lzx) {
   /* initialise tables to 0 (because deltas will be applied to them) */
   for (i = 0; i < LZX_MAINTREE_MAXSYMBOLS; i++) lzx->MAINTREE_len[i] = 0;
   for (i = 0; i < LZX_LENGTH_MAXSYMBOLS; i++)   lzx->LENGTH_len[i]   = 0;
+  lzx->MAINTREE_changed = 1;
+  lzx->LENGTH_changed   = 1;
+}
+
+/*-------- Intel E8 translation --------*/
+
+/* On x86 with GCC or clang, SSE2 and AVX2 versions of the E8 translation
+ * are built, and the best one the CPU supports is chosen at runtime.
+ * Define LZX_NO_SIMD to build only the portable version. */
+#if !defined(LZX_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+# define LZX_E8_SIMD 1
+# include <immintrin.h>
+#endif
+
+/* translates the E8 call at data[pos], then returns the position after it.
+ * If undo is set, the translation is reversed instead. The translated
+ * offsets from -curpos to filesize-1 are exactly the ones that were
+ * translated, so this can be done if filesize is positive. */
+static inline unsigned int lzxd_e8_call(unsigned char *data,
+                                        unsigned int pos,
+                                        signed int curpos,
+                                        signed int filesize,
+                                        int undo)
+{
+  signed int off = (int) EndGetI32(&data[pos + 1]);
+  curpos += (int) pos;
+  if ((off >= -curpos) && (off < filesize)) {
+    if (!undo) off = (off >= 0) ? off - curpos : off + filesize;
+    else       off = (off < filesize - curpos) ? off + curpos : off - filesize;
+    data[pos + 1] = (unsigned char) off;
+    data[pos + 2] = (unsigned char) (off >> 8);
+    data[pos + 3] = (unsigned char) (off >> 16);
+    data[pos + 4] = (unsigned char) (off >> 24);
+  }
+  return pos + 5;
+}
+
+/* the reference version: looks at every byte in turn. Starts looking at
+ * [pos], translates any calls up to [end] and returns the position after
+ * the last translated call, or [end] */
+static unsigned int lzxd_e8_scalar(unsigned char *data, unsigned int pos,
+                                   unsigned int end, signed int curpos,
+                                   signed int filesize, int undo)
+{
+  while (pos < end) {
+    if (data[pos] != 0xE8) pos++;
+    else pos = lzxd_e8_call(data, pos, curpos, filesize, undo);
+  }
+  return pos;
+}
+
+#if LZX_E8_SIMD
+/* the vector versions compare a whole vector of bytes with 0xE8 at once,
+ * then translate the calls found, skipping any 0xE8 bytes that were part
+ * of the previous call's operand. Translating a call only alters bytes
+ * that are skipped anyway, so the comparison results stay valid. */
+#define E8_TRANSLATE_MASK(mask, base) do {                              \
+    while (mask) {                                                      \
+      i = (base) + (unsigned int) __builtin_ctz(mask);                  \
+      if (i >= pos) pos = lzxd_e8_call(data, i, curpos, filesize, undo); \
+      mask &= mask - 1;                                                 \
+    }                                                                   \
+} while (0)
+
+__attribute__((target("sse2")))
+static unsigned int lzxd_e8_sse2(unsigned char *data, unsigned int pos,
+                                 unsigned int end, signed int curpos,
+                                 signed int filesize, int undo)
+{
+  const __m128i e8 = _mm_set1_epi8((char) 0xE8);
+  unsigned int base, i, mask;
+  for (base = pos; base + 16 <= end; base += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) &data[base]);
+    mask = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, e8));
+    E8_TRANSLATE_MASK(mask, base);
+  }
+  return lzxd_e8_scalar(data, (pos > base) ? pos : base, end,
+                        curpos, filesize, undo);
+}
+
+__attribute__((target("avx2")))
+static unsigned int lzxd_e8_avx2(unsigned char *data, unsigned int pos,
+                                 unsigned int end, signed int curpos,
+                                 signed int filesize, int undo)
+{
+  const __m256i e8 = _mm256_set1_epi8((char) 0xE8);
+  unsigned int base, i, mask;
+  for (base = pos; base + 32 <= end; base += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) &data[base]);
+    mask = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, e8));
+    E8_TRANSLATE_MASK(mask, base);
+  }
+  return lzxd_e8_scalar(data, (pos > base) ? pos : base, end,
+                        curpos, filesize, undo);
+}
+#endif
+
+int lzxd_e8_translate(unsigned char *data, unsigned int length,
+                      signed int curpos, signed int filesize, int method)
+{
+  /* no E8 leader is looked for in the last 10 bytes */
+  unsigned int end = (length > 10) ? length - 10 : 0;
+  int undo = method & LZX_E8_UNDO;
+
+  method &= ~LZX_E8_UNDO;
+  if (undo && filesize <= 0) return MSPACK_ERR_ARGS;
+
+#if LZX_E8_SIMD
+  if (method == LZX_E8_AUTO) {
+    method = __builtin_cpu_supports("avx2") ? LZX_E8_AVX2
+           : __builtin_cpu_supports("sse2") ? LZX_E8_SSE2 : LZX_E8_SCALAR;
+  }
+  switch (method) {
+  case LZX_E8_SCALAR:
+    lzxd_e8_scalar(data, 0, end, curpos, filesize, undo);
+    return MSPACK_ERR_OK;
+  case LZX_E8_SSE2:
+    if (!__builtin_cpu_supports("sse2")) break;
+    lzxd_e8_sse2(data, 0, end, curpos, filesize, undo);
+    return MSPACK_ERR_OK;
+  case LZX_E8_AVX2:
+    if (!__builtin_cpu_supports("avx2")) break;
+    lzxd_e8_avx2(data, 0, end, curpos, filesize, undo);
+    return MSPACK_ERR_OK;
+  }
+#else
+  if (method == LZX_E8_AUTO || method == LZX_E8_SCALAR) {
+    lzxd_e8_scalar(data, 0, end, curpos, filesize, undo);
+    return MSPACK_ERR_OK;
+  }
+#endif
+  return MSPACK_ERR_ARGS;
 }
 
 /*-------- main LZX code --------*/
 
+/* grows the window to at least the given size. The size at least doubles
+ * each time, so a long stream doesn't copy the window many times */
+static int lzxd_grow_window(struct lzxd_stream *lzx, unsigned int size) {
+  unsigned int max = LZX_WINDOW_MAX(lzx), alloc = lzx->window_alloc;
+  unsigned char *window, *old = lzx->window;
+
+  if (size > max) {
+    D(("window can't grow to %u bytes", size))
+    return MSPACK_ERR_DECRUNCH;
+  }
+  while (alloc < size) alloc <<= 1;
+  if (alloc > max) alloc = max;
+
+  window = (unsigned char *) lzx->sys->alloc(lzx->sys, alloc);
+  if (!window) return MSPACK_ERR_NOMEMORY;
+  lzx->sys->copy(old, window, lzx->window_alloc);
+
+  /* move pointers from the old window to the new one */
+  if (lzx->o_ptr >= old && lzx->o_ptr <= &old[lzx->window_alloc]) {
+    lzx->o_ptr = &window[lzx->o_ptr - old];
+    lzx->o_end = &window[lzx->o_end - old];
+  }
+  if (lzx->e8_frame) lzx->e8_frame = &window[lzx->e8_frame - old];
+  if (!lzx->shared_ref) lzx->window_end = &window[lzx->window_size];
+
+  lzx->sys->free(old);
+  lzx->window = window;
+  lzx->window_alloc = alloc;
+  return MSPACK_ERR_OK;
+}
+
 struct lzxd_stream *lzxd_init(struct mspack_system *system,
                               struct mspack_file *input,
                               struct mspack_file *output,
@@ -281,7 +681,9 @@ struct lzxd_stream *lzxd_init(struct mspack_system *system,
                               char is_delta)
 {
   unsigned int window_size = 1U << window_bits;
+  unsigned int window_alloc = LZX_FRAME_SIZE;
   struct lzxd_stream *lzx;
+  int i;
 
   if (!system) return NULL;
 
@@ -309,15 +711,29 @@ struct lzxd_stream *lzxd_init(struct mspack_system *system,
     return NULL;
   }
 
-  /* allocate decompression window and input buffer */
-  lzx->window = (unsigned char *) system->alloc(system, window_size);
-  lzx->inbuf  = (unsigned char *) system->alloc(system, input_buffer_size);
+  /* a short stream only needs enough window for its output. If the
+   * length isn't known, start with one frame. Either way, the window
+   * grows in lzxd_decompress() if more is needed */
+  if (output_length > (off_t) (window_size - LZX_FRAME_SIZE)) {
+    window_alloc = window_size;
+  }
+  else if (output_length > 0) {
+    window_alloc = ((unsigned int) output_length + LZX_FRAME_SIZE - 1) &
+                   -LZX_FRAME_SIZE;
+  }
+
+  /* allocate decompression window and input buffer (with room before
+   * the input buffer for UNREAD_WORDS) */
+  lzx->window = (unsigned char *) system->alloc(system, window_alloc);
+  lzx->inbuf  = (unsigned char *) system->alloc(system,
+    input_buffer_size + sizeof(bitbuf_type));
   if (!lzx->window || !lzx->inbuf) {
     system->free(lzx->window);
     system->free(lzx->inbuf);
     system->free(lzx);
     return NULL;
   }
+  lzx->inbuf += sizeof(bitbuf_type);
 
   /* initialise decompression state */
   lzx->sys             = system;
@@ -328,7 +744,9 @@ struct lzxd_stream *lzxd_init(struct mspack_system *system,
 
   lzx->inbuf_size      = input_buffer_size;
   lzx->window_size     = 1 << window_bits;
+  lzx->window_alloc    = window_alloc;
   lzx->ref_data_size   = 0;
+  lzx->window_end      = &lzx->window[window_size];
   lzx->window_posn     = 0;
   lzx->frame_posn      = 0;
   lzx->frame           = 0;
@@ -338,8 +756,14 @@ struct lzxd_stream *lzxd_init(struct mspack_system *system,
   lzx->error           = MSPACK_ERR_OK;
   lzx->num_offsets     = position_slots[window_bits - 15] << 3;
   lzx->is_delta        = is_delta;
+  lzx->shared_ref      = 0;
 
-  lzx->o_ptr = lzx->o_end = &lzx->e8_buf[0];
+  lzx->e8_buf          = NULL;
+  lzx->e8_frame        = NULL;
+  lzx->step            = NULL;
+  for (i = 0; i < LZX_PROF_PHASES; i++) lzx->prof_ticks[i] = 0;
+
+  lzx->o_ptr = lzx->o_end = &lzx->window[0];
   lzxd_reset_state(lzx);
   INIT_BITS;
   return lzx;
@@ -368,6 +792,16 @@ int lzxd_set_reference_data(struct lzxd_stream *lzx,
         D(("length > 0 but no system or input"))
         return MSPACK_ERR_ARGS;
     }
+    if (lzx->shared_ref) {
+        D(("stream already uses shared reference data"))
+        return MSPACK_ERR_ARGS;
+    }
+
+    /* reference data goes at the very end of the window */
+    if (length > 0 && lzx->window_alloc < lzx->window_size) {
+        int err = lzxd_grow_window(lzx, lzx->window_size);
+        if (err) return err;
+    }
 
     lzx->ref_data_size = length;
     if (length > 0) {
@@ -381,15 +815,330 @@ int lzxd_set_reference_data(struct lzxd_stream *lzx,
     return MSPACK_ERR_OK;
 }
 
+int lzxd_share_reference_data(struct lzxd_stream *lzx,
+                              const unsigned char *data,
+                              unsigned int length)
+{
+    unsigned char *window;
+
+    if (!lzx || !data) return MSPACK_ERR_ARGS;
+
+    if (!lzx->is_delta) {
+        D(("only LZX DELTA streams support reference data"))
+        return MSPACK_ERR_ARGS;
+    }
+    if (lzx->offset || lzx->shared_ref) {
+        D(("too late to share reference data"))
+        return MSPACK_ERR_ARGS;
+    }
+    if (length == 0 || length >= lzx->window_size) {
+        D(("reference length (%u) leaves no room for output", length))
+        return MSPACK_ERR_ARGS;
+    }
+
+    /* the window only needs room for the output now */
+    if (lzx->window_alloc > lzx->window_size - length) {
+        lzx->window_alloc = lzx->window_size - length;
+        window = (unsigned char *) lzx->sys->alloc(lzx->sys,
+                                                   lzx->window_alloc);
+        if (!window) return MSPACK_ERR_NOMEMORY;
+        lzx->sys->free(lzx->window);
+        lzx->window = window;
+        lzx->o_ptr = lzx->o_end = &window[0];
+    }
+
+    lzx->window_end    = (unsigned char *) &data[length];
+    lzx->ref_data_size = length;
+    lzx->shared_ref    = 1;
+    return MSPACK_ERR_OK;
+}
+
 void lzxd_set_output_length(struct lzxd_stream *lzx, off_t out_bytes) {
   if (lzx && out_bytes > 0) lzx->length = out_bytes;
 }
 
-int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
+int lzxd_seek(struct lzxd_stream *lzx, unsigned int frame, off_t in_offset) {
+  if (!lzx) return MSPACK_ERR_ARGS;
+  if (lzx->reset_interval ? (frame % lzx->reset_interval) : frame) {
+    D(("frame %u is not a reset point", frame))
+    return MSPACK_ERR_ARGS;
+  }
+  if (lzx->sys->seek(lzx->input, in_offset, MSPACK_SYS_SEEK_START)) {
+    return lzx->error = MSPACK_ERR_SEEK;
+  }
+
+  /* the skipped output might have wrapped around the window */
+  if (frame && lzx->window_alloc < lzx->window_size) {
+    int err = lzxd_grow_window(lzx, lzx->window_size);
+    if (err) return lzx->error = err;
+  }
+
+  lzx->offset      = (off_t) frame * LZX_FRAME_SIZE;
+  lzx->frame       = frame;
+  lzx->window_posn = (unsigned int) (lzx->offset & (lzx->window_size - 1));
+  lzx->frame_posn  = lzx->window_posn;
+  lzx->intel_started = 0;
+  lzx->error       = MSPACK_ERR_OK;
+
+  /* nothing is left to write, or to undo the E8 translation of */
+  lzx->o_ptr = lzx->o_end = &lzx->window[0];
+  lzx->e8_frame = NULL;
+
+  lzxd_reset_state(lzx);
+  INIT_BITS;
+  return MSPACK_ERR_OK;
+}
+
+/*-------- checkpoints --------*/
+
+/* a checkpoint is a header of LZX_CHECKPOINT_HDR bytes, holding the
+ * fields below as little-endian 32 or 64 bit values, then the main,
+ * length and aligned tree code lengths, the unread input bytes, the
+ * e8_buf frame (if output was pending from it) and the allocated part
+ * of the window, which never includes shared reference data */
+#define LZX_CHECKPOINT_MAGIC (0x4B43584C) /* "LXCK" */
+#define LZX_CHECKPOINT_HDR   (38 * 4)
+#define LZX_CHECKPOINT_LENS  (LZX_MAINTREE_MAXSYMBOLS + \
+                              LZX_LENGTH_MAXSYMBOLS + LZX_ALIGNED_MAXSYMBOLS)
+#define LZX_NO_E8_FRAME      (0xFFFFFFFF)
+
+#define PUT32(v) do {                                   \
+    unsigned int v_ = (unsigned int) (v);               \
+    p[0] = v_ & 0xFF;         p[1] = (v_ >> 8) & 0xFF;  \
+    p[2] = (v_ >> 16) & 0xFF; p[3] = v_ >> 24; p += 4;  \
+} while (0)
+#define PUT64(v) do {                                                   \
+    PUT32((unsigned long long) (v)); PUT32((unsigned long long) (v) >> 32); \
+} while (0)
+#define GET32(v) do { (v) = EndGetI32(p); p += 4; } while (0)
+#define GET64(v) do { (v) = EndGetI64(p); p += 8; } while (0)
+
+int lzxd_checkpoint(struct lzxd_stream *lzx, struct mspack_system *system,
+                    struct mspack_file *output)
+{
+  unsigned char hdr[LZX_CHECKPOINT_HDR], *p = &hdr[0];
+  unsigned int in_bytes, in_e8buf;
+  off_t in_offset;
+
+  if (!lzx || !system || !output) return MSPACK_ERR_ARGS;
+  if (lzx->error) return lzx->error;
+
+  /* the input will be read again from where it is now */
+  if ((in_offset = lzx->sys->tell(lzx->input)) < 0) return MSPACK_ERR_SEEK;
+  in_bytes = (unsigned int) (lzx->i_end - lzx->i_ptr);
+  in_e8buf = lzx->e8_buf && lzx->o_ptr >= lzx->e8_buf &&
+             lzx->o_ptr <= &lzx->e8_buf[LZX_FRAME_SIZE];
+
+  PUT32(LZX_CHECKPOINT_MAGIC);
+  PUT32(lzx->window_size);
+  PUT32(lzx->reset_interval);
+  PUT32(lzx->is_delta);
+  PUT32(lzx->ref_data_size);
+  PUT32(lzx->shared_ref);
+  PUT32(lzx->window_alloc);
+  PUT64(lzx->offset);
+  PUT64(lzx->length);
+  PUT64(in_offset);
+  PUT32(lzx->window_posn);
+  PUT32(lzx->frame_posn);
+  PUT32(lzx->frame);
+  PUT32(lzx->R0);
+  PUT32(lzx->R1);
+  PUT32(lzx->R2);
+  PUT32(lzx->block_length);
+  PUT32(lzx->block_remaining);
+  PUT32(lzx->intel_filesize);
+  PUT32(lzx->intel_started);
+  PUT32(lzx->block_type);
+  PUT32(lzx->header_read);
+  PUT32(lzx->input_end);
+  PUT32(lzx->LENGTH_empty);
+  PUT64(lzx->bit_buffer);
+  PUT32(lzx->bits_left);
+  PUT32(in_bytes);
+  PUT32(in_e8buf);
+  PUT32(lzx->o_ptr - (in_e8buf ? lzx->e8_buf : lzx->window));
+  PUT32(lzx->o_end - (in_e8buf ? lzx->e8_buf : lzx->window));
+  PUT32(lzx->e8_frame ? (unsigned int) (lzx->e8_frame - lzx->window)
+                      : LZX_NO_E8_FRAME);
+  PUT32(lzx->e8_length);
+  PUT32(lzx->e8_curpos);
+  PUT32(lzx->e8_filesize);
+
+  if (system->write(output, hdr, LZX_CHECKPOINT_HDR) != LZX_CHECKPOINT_HDR ||
+      system->write(output, lzx->MAINTREE_len, LZX_MAINTREE_MAXSYMBOLS) !=
+      LZX_MAINTREE_MAXSYMBOLS ||
+      system->write(output, lzx->LENGTH_len, LZX_LENGTH_MAXSYMBOLS) !=
+      LZX_LENGTH_MAXSYMBOLS ||
+      system->write(output, lzx->ALIGNED_len, LZX_ALIGNED_MAXSYMBOLS) !=
+      LZX_ALIGNED_MAXSYMBOLS ||
+      system->write(output, lzx->i_ptr, (int) in_bytes) != (int) in_bytes ||
+      (in_e8buf && system->write(output, lzx->e8_buf, LZX_FRAME_SIZE) !=
+       LZX_FRAME_SIZE) ||
+      system->write(output, lzx->window, (int) lzx->window_alloc) !=
+      (int) lzx->window_alloc)
+  {
+    return MSPACK_ERR_WRITE;
+  }
+  return MSPACK_ERR_OK;
+}
+
+/* rebuilds the huffman tables from the code lengths for the rest of the
+ * current block, or marks them to be rebuilt when the next block starts */
+static int lzxd_rebuild_tables(struct lzxd_stream *lzx) {
+  int i;
+
+  lzx->MAINTREE_changed = 1;
+  lzx->LENGTH_changed   = 1;
+  if (lzx->block_remaining && lzx->block_type != LZX_BLOCKTYPE_UNCOMPRESSED) {
+    if (lzx->block_type == LZX_BLOCKTYPE_ALIGNED) {
+      BUILD_TABLE(ALIGNED);
+    }
+    BUILD_TABLE(MAINTREE);
+#if LZX_MAINTREE_MULTIBITS
+    make_multi_table(MAXSYMBOLS(MAINTREE), TABLEBITS(MAINTREE),
+                     MULTIBITS(MAINTREE), LZX_NUM_CHARS,
+                     &HUFF_LEN(MAINTREE,0), &HUFF_TABLE(MAINTREE,0),
+                     &HUFF_MULTI(MAINTREE,0));
+#endif
+    BUILD_TABLE_MAYBE_EMPTY(LENGTH);
+    lzx->MAINTREE_changed = 0;
+    lzx->LENGTH_changed   = 0;
+  }
+  return MSPACK_ERR_OK;
+}
+
+int lzxd_restore(struct lzxd_stream *lzx, struct mspack_system *system,
+                 struct mspack_file *input)
+{
+  unsigned char hdr[LZX_CHECKPOINT_HDR], *p = &hdr[0], *o_base;
+  unsigned int x, in_bytes, in_e8buf, o_ptr, o_end, e8_frame, w_alloc;
+  unsigned long long in_offset;
+  int i;
+
+  if (!lzx || !system || !input) return MSPACK_ERR_ARGS;
+
+  /* from here on, any failure leaves the stream unusable */
+  if (system->read(input, hdr, LZX_CHECKPOINT_HDR) != LZX_CHECKPOINT_HDR) {
+    return lzx->error = MSPACK_ERR_READ;
+  }
+  GET32(x);
+  if (x != LZX_CHECKPOINT_MAGIC) return lzx->error = MSPACK_ERR_SIGNATURE;
+  GET32(x);
+  if (x != lzx->window_size) goto bad_args;
+  GET32(x);
+  if (x != lzx->reset_interval) goto bad_args;
+  GET32(x);
+  if (x != (unsigned int) lzx->is_delta) goto bad_args;
+  GET32(x);
+  if (lzx->shared_ref && x != lzx->ref_data_size) goto bad_args;
+  lzx->ref_data_size = x;
+  GET32(x);
+  if (x != (unsigned int) lzx->shared_ref) goto bad_args;
+  GET32(w_alloc);
+  GET64(lzx->offset);
+  GET64(lzx->length);
+  GET64(in_offset);
+  GET32(lzx->window_posn);
+  GET32(lzx->frame_posn);
+  GET32(lzx->frame);
+  GET32(lzx->R0);
+  GET32(lzx->R1);
+  GET32(lzx->R2);
+  GET32(lzx->block_length);
+  GET32(lzx->block_remaining);
+  GET32(lzx->intel_filesize);
+  GET32(lzx->intel_started);
+  GET32(lzx->block_type);
+  GET32(lzx->header_read);
+  GET32(lzx->input_end);
+  GET32(lzx->LENGTH_empty);
+  GET64(lzx->bit_buffer);
+  GET32(lzx->bits_left);
+  GET32(in_bytes);
+  GET32(in_e8buf);
+  GET32(o_ptr);
+  GET32(o_end);
+  GET32(e8_frame);
+  GET32(lzx->e8_length);
+  GET32(lzx->e8_curpos);
+  GET32(lzx->e8_filesize);
+
+  /* check the checkpoint is consistent with this stream. A window that
+   * was never fully allocated has never wrapped */
+  x = in_e8buf ? LZX_FRAME_SIZE : w_alloc;
+  if (w_alloc > LZX_WINDOW_MAX(lzx) ||
+      (w_alloc < lzx->window_size && lzx->offset > (off_t) w_alloc) ||
+      lzx->window_posn >= lzx->window_size || lzx->window_posn > w_alloc ||
+      lzx->frame_posn >= lzx->window_size || lzx->frame_posn > w_alloc ||
+      lzx->ref_data_size > lzx->window_size ||
+      lzx->block_type > LZX_BLOCKTYPE_UNCOMPRESSED ||
+      lzx->bits_left > BITBUF_WIDTH ||
+      in_bytes > lzx->inbuf_size + sizeof(bitbuf_type) ||
+      o_ptr > o_end || o_end > x ||
+      (e8_frame != LZX_NO_E8_FRAME &&
+       (e8_frame > w_alloc || lzx->e8_length > w_alloc - e8_frame)))
+  {
+    D(("checkpoint doesn't match stream"))
+    return lzx->error = MSPACK_ERR_DATAFORMAT;
+  }
+
+  if (w_alloc > lzx->window_alloc) {
+    if ((i = lzxd_grow_window(lzx, w_alloc))) return lzx->error = i;
+  }
+
+  if (in_e8buf && !lzx->e8_buf) {
+    lzx->e8_buf = (unsigned char *) lzx->sys->alloc(lzx->sys, LZX_FRAME_SIZE);
+    if (!lzx->e8_buf) return lzx->error = MSPACK_ERR_NOMEMORY;
+  }
+  o_base = in_e8buf ? lzx->e8_buf : lzx->window;
+  lzx->o_ptr = &o_base[o_ptr];
+  lzx->o_end = &o_base[o_end];
+  lzx->e8_frame = (e8_frame == LZX_NO_E8_FRAME) ? NULL
+                : &lzx->window[e8_frame];
+
+  /* unread input goes at the start of inbuf, or as near as will fit */
+  lzx->i_ptr = (in_bytes <= lzx->inbuf_size) ? &lzx->inbuf[0]
+             : &lzx->inbuf[lzx->inbuf_size] - in_bytes;
+  lzx->i_end = &lzx->i_ptr[in_bytes];
+
+  if (system->read(input, lzx->MAINTREE_len, LZX_MAINTREE_MAXSYMBOLS) !=
+      LZX_MAINTREE_MAXSYMBOLS ||
+      system->read(input, lzx->LENGTH_len, LZX_LENGTH_MAXSYMBOLS) !=
+      LZX_LENGTH_MAXSYMBOLS ||
+      system->read(input, lzx->ALIGNED_len, LZX_ALIGNED_MAXSYMBOLS) !=
+      LZX_ALIGNED_MAXSYMBOLS ||
+      system->read(input, lzx->i_ptr, (int) in_bytes) != (int) in_bytes ||
+      (in_e8buf && system->read(input, lzx->e8_buf, LZX_FRAME_SIZE) !=
+       LZX_FRAME_SIZE) ||
+      system->read(input, lzx->window, (int) w_alloc) != (int) w_alloc)
+  {
+    return lzx->error = MSPACK_ERR_READ;
+  }
+
+  /* continue reading the LZX input from where the checkpoint was made */
+  if (lzx->sys->seek(lzx->input, (off_t) in_offset, MSPACK_SYS_SEEK_START)) {
+    return lzx->error = MSPACK_ERR_SEEK;
+  }
+
+  lzx->error = MSPACK_ERR_OK;
+  return lzxd_rebuild_tables(lzx);
+
+bad_args:
+  D(("checkpoint is for a different kind of stream"))
+  return lzx->error = MSPACK_ERR_ARGS;
+}
+
+/* decodes out_bytes of output, and writes it unless skip is non-zero. When
+ * skipping, frames that are skipped whole are neither E8 translated nor
+ * written; the last frame may be partly wanted, so it is translated */
+static int lzxd_decode(struct lzxd_stream *lzx, off_t out_bytes, int skip) {
   DECLARE_HUFF_VARS;
   unsigned char *window, *runsrc, *rundest, buf[12], warned = 0;
-  unsigned int frame_size, end_frame, window_posn, R0, R1, R2;
-  int bytes_todo, this_run, i, j;
+  unsigned int frame_size, end_frame, window_posn, R0, R1, R2, e8_frame;
+  int bytes_todo, this_run, i, j, e8_curpos;
+  PROF_VAR(prof_t)
+  PROF_VAR(prof_m)
 
   /* easy answers */
   if (!lzx || (out_bytes < 0)) return MSPACK_ERR_ARGS;
@@ -399,9 +1148,11 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
   i = lzx->o_end - lzx->o_ptr;
   if ((off_t) i > out_bytes) i = (int) out_bytes;
   if (i) {
-    if (lzx->sys->write(lzx->output, lzx->o_ptr, i) != i) {
+    PROF_START(prof_t);
+    if (!skip && lzx->sys->write(lzx->output, lzx->o_ptr, i) != i) {
       return lzx->error = MSPACK_ERR_WRITE;
     }
+    PROF_END(prof_t, LZX_PROF_WRITE);
     lzx->o_ptr  += i;
     lzx->offset += i;
     out_bytes   -= i;
@@ -419,6 +1170,16 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
   end_frame = (unsigned int)((lzx->offset + out_bytes) / LZX_FRAME_SIZE) + 1;
 
   while (lzx->frame < end_frame) {
+    /* the previous frame has been written out, so undo its E8 translation
+     * before any matches can refer to it */
+    if (lzx->e8_frame) {
+      PROF_START(prof_t);
+      lzxd_e8_translate(lzx->e8_frame, lzx->e8_length, lzx->e8_curpos,
+                        lzx->e8_filesize, LZX_E8_AUTO | LZX_E8_UNDO);
+      lzx->e8_frame = NULL;
+      PROF_END(prof_t, LZX_PROF_E8);
+    }
+
     /* have we reached the reset interval? (if there is one?) */
     if (lzx->reset_interval && ((lzx->frame % lzx->reset_interval) == 0)) {
       if (lzx->block_remaining) {
@@ -460,15 +1221,26 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
       frame_size = lzx->length - lzx->offset;
     }
 
+    /* grow the window if the frame doesn't fit in it yet. With shared
+     * reference data, it can't grow into the reference data */
+    if ((lzx->frame_posn + frame_size) > lzx->window_alloc) {
+      if ((i = lzxd_grow_window(lzx, lzx->frame_posn + frame_size))) {
+        return lzx->error = i;
+      }
+      window = lzx->window;
+    }
+
     /* decode until one more frame is available */
     bytes_todo = lzx->frame_posn + frame_size - window_posn;
     while (bytes_todo > 0) {
       /* initialise new block, if one is needed */
       if (lzx->block_remaining == 0) {
+        PROF_START(prof_t);
         /* realign if previous block was an odd-sized UNCOMPRESSED block */
         if ((lzx->block_type == LZX_BLOCKTYPE_UNCOMPRESSED) &&
             (lzx->block_length & 1))
         {
+          UNREAD_WORDS;
           READ_IF_NEEDED;
           i_ptr++;
         }
@@ -487,15 +1259,29 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
           BUILD_TABLE(ALIGNED);
           /* rest of aligned header is same as verbatim */ /*@fallthrough@*/
         case LZX_BLOCKTYPE_VERBATIM:
-          /* read lengths of and build main huffman decoding tree */
+          /* read lengths of and build main huffman decoding tree. The
+           * lengths are deltas from the previous block's, and encoders
+           * often repeat a tree exactly; the old table is kept if so */
           READ_LENGTHS(MAINTREE, 0, 256);
           READ_LENGTHS(MAINTREE, 256, LZX_NUM_CHARS + lzx->num_offsets);
-          BUILD_TABLE(MAINTREE);
+          if (lzx->MAINTREE_changed) {
+            BUILD_TABLE(MAINTREE);
+#if LZX_MAINTREE_MULTIBITS
+            make_multi_table(MAXSYMBOLS(MAINTREE), TABLEBITS(MAINTREE),
+                             MULTIBITS(MAINTREE), LZX_NUM_CHARS,
+                             &HUFF_LEN(MAINTREE,0), &HUFF_TABLE(MAINTREE,0),
+                             &HUFF_MULTI(MAINTREE,0));
+#endif
+            lzx->MAINTREE_changed = 0;
+          }
           /* if the literal 0xE8 is anywhere in the block... */
           if (lzx->MAINTREE_len[0xE8] != 0) lzx->intel_started = 1;
           /* read lengths of and build lengths huffman decoding tree */
           READ_LENGTHS(LENGTH, 0, LZX_NUM_SECONDARY_LENGTHS);
-          BUILD_TABLE_MAYBE_EMPTY(LENGTH);
+          if (lzx->LENGTH_changed) {
+            BUILD_TABLE_MAYBE_EMPTY(LENGTH);
+            lzx->LENGTH_changed = 0;
+          }
           break;
 
         case LZX_BLOCKTYPE_UNCOMPRESSED:
@@ -504,7 +1290,9 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
 
           /* read 1-16 (not 0-15) bits to align to bytes */
           if (bits_left == 0) ENSURE_BITS(16);
-          bits_left = 0; bit_buffer = 0;
+          i = (bits_left & 15) ? (bits_left & 15) : 16;
+          REMOVE_BITS(i);
+          UNREAD_WORDS;
 
           /* read 12 bytes of stored R0 / R1 / R2 values */
           for (rundest = &buf[0], i = 0; i < 12; i++) {
@@ -520,6 +1308,7 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
           D(("bad block type"))
           return lzx->error = MSPACK_ERR_DECRUNCH;
         }
+        PROF_END(prof_t, LZX_PROF_HEADER);
       }
 
       /* decode more of the block:
@@ -532,6 +1321,7 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
       lzx->block_remaining -= this_run;
 
       /* decode at least this_run bytes */
+      PROF_START(prof_t);
       switch (lzx->block_type) {
       case LZX_BLOCKTYPE_ALIGNED:
       case LZX_BLOCKTYPE_VERBATIM:
@@ -539,6 +1329,13 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
           int main_element, length_footer, verbatim_bits, aligned_bits, extra;
           int match_length;
           unsigned int match_offset;
+
+          /* decode without input checks while there's plenty of input */
+          if ((i_end - i_ptr) >= LZX_FAST_INPUT) {
+            DECODE_FAST;
+            if (this_run <= 0) break;
+          }
+
           READ_HUFFSYM(MAINTREE, main_element);
           if (main_element < LZX_NUM_CHARS) {
             /* literal: 0 to LZX_NUM_CHARS-1 */
@@ -587,64 +1384,10 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
 
             /* LZX DELTA uses max match length to signal even longer match */
             if (match_length == LZX_MAX_MATCH && lzx->is_delta) {
-                int extra_len = 0;
-                ENSURE_BITS(3); /* 4 entry huffman tree */
-                if (PEEK_BITS(1) == 0) {
-                    REMOVE_BITS(1); /* '0' -> 8 extra length bits */
-                    READ_BITS(extra_len, 8);
-                }
-                else if (PEEK_BITS(2) == 2) {
-                    REMOVE_BITS(2); /* '10' -> 10 extra length bits + 0x100 */
-                    READ_BITS(extra_len, 10);
-                    extra_len += 0x100;
-                }
-                else if (PEEK_BITS(3) == 6) {
-                    REMOVE_BITS(3); /* '110' -> 12 extra length bits + 0x500 */
-                    READ_BITS(extra_len, 12);
-                    extra_len += 0x500;
-                }
-                else {
-                    REMOVE_BITS(3); /* '111' -> 15 extra length bits */
-                    READ_BITS(extra_len, 15);
-                }
-                match_length += extra_len;
-            }
-
-            if ((window_posn + match_length) > lzx->window_size) {
-              D(("match ran over window wrap"))
-              return lzx->error = MSPACK_ERR_DECRUNCH;
-            }
-
-            /* copy match */
-            rundest = &window[window_posn];
-            i = match_length;
-            /* does match offset wrap the window? */
-            if (match_offset > window_posn) {
-              if ((off_t)match_offset > lzx->offset &&
-                  (match_offset - window_posn) > lzx->ref_data_size)
-              {
-                D(("match offset beyond LZX stream"))
-                return lzx->error = MSPACK_ERR_DECRUNCH;
-              }
-              /* j = length from match offset to end of window */
-              j = match_offset - window_posn;
-              if (j > (int) lzx->window_size) {
-                D(("match offset beyond window boundaries"))
-                return lzx->error = MSPACK_ERR_DECRUNCH;
-              }
-              runsrc = &window[lzx->window_size - j];
-              if (j < i) {
-                /* if match goes over the window edge, do two copy runs */
-                i -= j; while (j-- > 0) *rundest++ = *runsrc++;
-                runsrc = window;
-              }
-              while (i-- > 0) *rundest++ = *runsrc++;
-            }
-            else {
-              runsrc = rundest - match_offset;
-              while (i-- > 0) *rundest++ = *runsrc++;
+              READ_DELTA_LENGTH;
             }
 
+            COPY_MATCH;
             this_run    -= match_length;
             window_posn += match_length;
           }
@@ -673,6 +1416,7 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
       default:
         return lzx->error = MSPACK_ERR_DECRUNCH; /* might as well */
       }
+      PROF_END(prof_t, LZX_PROF_DECODE);
 
       /* did the final match overrun our desired this_run length? */
       if (this_run < 0) {
@@ -703,44 +1447,55 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
       return lzx->error = MSPACK_ERR_DECRUNCH;
     }
 
+    /* E8 positions count from the last reset, which starts the
+     * translation again, as chmlib's LZXreset() does */
+    e8_frame  = lzx->reset_interval ? lzx->frame % lzx->reset_interval
+                                    : lzx->frame;
+    e8_curpos = (int) (lzx->offset -
+                       (off_t) (lzx->frame - e8_frame) * LZX_FRAME_SIZE);
+
     /* does this intel block _really_ need decoding? */
-    if (lzx->intel_started && lzx->intel_filesize &&
-        (lzx->frame < 32768) && (frame_size > 10))
+    PROF_START(prof_t);
+    if (skip && out_bytes >= (off_t) frame_size) {
+      lzx->o_ptr = &lzx->window[lzx->frame_posn];
+    }
+    else if (lzx->intel_started && lzx->intel_filesize &&
+        (e8_frame < 32768) && (frame_size > 10))
     {
-      unsigned char *data    = &lzx->e8_buf[0];
-      unsigned char *dataend = &lzx->e8_buf[frame_size - 10];
-      signed int curpos      = (int) lzx->offset;
-      signed int filesize    = lzx->intel_filesize;
-      signed int abs_off, rel_off;
-
-      /* copy e8 block to the e8 buffer and tweak if needed */
-      lzx->o_ptr = data;
-      lzx->sys->copy(&lzx->window[lzx->frame_posn], data, frame_size);
-
-      while (data < dataend) {
-        if (*data++ != 0xE8) { curpos++; continue; }
-        abs_off = (int) EndGetI32(data);
-        if ((abs_off >= -curpos) && (abs_off < filesize)) {
-          rel_off = (abs_off >= 0) ? abs_off - curpos : abs_off + filesize;
-          data[0] = (unsigned char) rel_off;
-          data[1] = (unsigned char) (rel_off >> 8);
-          data[2] = (unsigned char) (rel_off >> 16);
-          data[3] = (unsigned char) (rel_off >> 24);
+      lzx->o_ptr = &lzx->window[lzx->frame_posn];
+      if (lzx->intel_filesize > 0) {
+        /* translate the frame in the window, and undo it later */
+        lzx->e8_frame    = lzx->o_ptr;
+        lzx->e8_length   = frame_size;
+        lzx->e8_curpos   = e8_curpos;
+        lzx->e8_filesize = lzx->intel_filesize;
+      }
+      else {
+        /* the translation can't be undone, so translate a copy */
+        if (!lzx->e8_buf) {
+          lzx->e8_buf = (unsigned char *) lzx->sys->alloc(lzx->sys,
+                                                          LZX_FRAME_SIZE);
+          if (!lzx->e8_buf) return lzx->error = MSPACK_ERR_NOMEMORY;
         }
-        data += 4;
-        curpos += 5;
+        lzx->sys->copy(lzx->o_ptr, lzx->e8_buf, frame_size);
+        lzx->o_ptr = lzx->e8_buf;
       }
+      lzxd_e8_translate(lzx->o_ptr, frame_size, e8_curpos,
+                        lzx->intel_filesize, LZX_E8_AUTO);
     }
     else {
       lzx->o_ptr = &lzx->window[lzx->frame_posn];
     }
     lzx->o_end = &lzx->o_ptr[frame_size];
+    PROF_END(prof_t, LZX_PROF_E8);
 
     /* write a frame */
+    PROF_START(prof_t);
     i = (out_bytes < (off_t)frame_size) ? (unsigned int)out_bytes : frame_size;
-    if (lzx->sys->write(lzx->output, lzx->o_ptr, i) != i) {
+    if (!skip && lzx->sys->write(lzx->output, lzx->o_ptr, i) != i) {
       return lzx->error = MSPACK_ERR_WRITE;
     }
+    PROF_END(prof_t, LZX_PROF_WRITE);
     lzx->o_ptr  += i;
     lzx->offset += i;
     out_bytes   -= i;
@@ -770,12 +1525,156 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
   return MSPACK_ERR_OK;
 }
 
+int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
+  return lzxd_decode(lzx, out_bytes, 0);
+}
+
+int lzxd_skip(struct lzxd_stream *lzx, off_t out_bytes) {
+  return lzxd_decode(lzx, out_bytes, 1);
+}
+
+/*-------- pull-mode decoding --------*/
+
+/* lzxd_step() marks the start of each frame before decoding it, saving
+ * everything in the stream before the huffman tables; the tables are built
+ * again from the saved code lengths. Once the window has wrapped, or if it
+ * holds reference data, the part of it the frame will be decoded into is
+ * saved too, as matches in the frame may refer to what was there before */
+#define LZX_STEP_SAVED offsetof(struct lzxd_stream, PRETREE_table)
+
+struct lzxd_step_state {
+  struct mspack_stepper *st;
+  unsigned char saved[LZX_STEP_SAVED];
+  unsigned char *window;          /* the saved part of the window            */
+  unsigned int window_len;        /* length of the saved part                */
+};
+
+static int lzxd_step_mark(struct lzxd_stream *lzx, struct lzxd_step_state *ss) {
+  unsigned int len = 0;
+
+  if (lzx->offset >= (off_t) lzx->window_size ||
+      (lzx->ref_data_size && !lzx->shared_ref))
+  {
+    if (!ss->window) {
+      ss->window = (unsigned char *) lzx->sys->alloc(lzx->sys, LZX_FRAME_SIZE);
+      if (!ss->window) return MSPACK_ERR_NOMEMORY;
+    }
+    len = lzx->window_alloc - lzx->frame_posn;
+    if (len > LZX_FRAME_SIZE) len = LZX_FRAME_SIZE;
+    lzx->sys->copy(&lzx->window[lzx->frame_posn], ss->window, len);
+  }
+  ss->window_len = len;
+  lzx->sys->copy(lzx, ss->saved, LZX_STEP_SAVED);
+  stepper_mark(ss->st, lzx->i_ptr, lzx->i_end);
+  return MSPACK_ERR_OK;
+}
+
+static int lzxd_step_rollback(struct lzxd_stream *lzx,
+                              struct lzxd_step_state *ss)
+{
+  /* the window may have grown since the mark, so keep the new one */
+  unsigned char *window = lzx->window, *window_end = lzx->window_end;
+  unsigned int window_alloc = lzx->window_alloc;
+  struct mspack_system *sys = lzx->sys;
+  int err;
+
+  sys->copy(ss->saved, lzx, LZX_STEP_SAVED);
+  lzx->window       = window;
+  lzx->window_end   = window_end;
+  lzx->window_alloc = window_alloc;
+  lzx->o_ptr = lzx->o_end = &window[0];
+  if (ss->window_len) {
+    sys->copy(ss->window, &window[lzx->frame_posn], ss->window_len);
+  }
+
+  /* the previous frame's E8 translation was undone after the mark, so
+   * e8_frame is already NULL, as it should be */
+  err = stepper_rollback(ss->st, lzx->inbuf, lzx->inbuf_size,
+                         &lzx->i_ptr, &lzx->i_end);
+  if (err) return lzx->error = err;
+  if ((err = lzxd_rebuild_tables(lzx))) return err;
+  return MSPACK_STEP_NEED_INPUT;
+}
+
+int lzxd_step(struct lzxd_stream *lzx, struct mspack_step *step) {
+  struct lzxd_step_state *ss;
+  struct mspack_system *sys;
+  struct mspack_file *input, *output;
+  unsigned int i;
+  int err = MSPACK_ERR_OK;
+
+  if (!lzx || !step) return MSPACK_ERR_ARGS;
+  if (lzx->error) return lzx->error;
+
+  if (!(ss = lzx->step)) {
+    ss = (struct lzxd_step_state *) lzx->sys->alloc(lzx->sys, sizeof(*ss));
+    if (!ss) return MSPACK_ERR_NOMEMORY;
+    if (!(ss->st = stepper_init(lzx->sys, lzx->inbuf_size))) {
+      lzx->sys->free(ss);
+      return MSPACK_ERR_NOMEMORY;
+    }
+    ss->window = NULL;
+    lzx->step = ss;
+  }
+
+  /* read and write the step's buffers rather than the stream's files */
+  sys    = lzx->sys;
+  input  = lzx->input;
+  output = lzx->output;
+  lzx->sys   = &ss->st->sys;
+  lzx->input = lzx->output = (struct mspack_file *) ss->st;
+  stepper_begin(ss->st, step);
+
+  while (step->avail_out > 0) {
+    /* copy out anything already decoded */
+    if ((i = (unsigned int) (lzx->o_end - lzx->o_ptr)) != 0) {
+      if (i > step->avail_out) i = step->avail_out;
+      sys->copy(lzx->o_ptr, step->next_out, i);
+      lzx->o_ptr      += i;
+      lzx->offset     += i;
+      step->next_out  += i;
+      step->avail_out -= i;
+      continue;
+    }
+
+    /* the stream ends at its length, or if that isn't known, when all
+     * input has been used */
+    if (lzx->length ? (lzx->offset >= lzx->length) :
+        (stepper_input_done(ss->st) && (lzx->input_end ||
+         (lzx->i_ptr == lzx->i_end && lzx->bits_left == 0))))
+    {
+      err = MSPACK_STEP_END;
+      break;
+    }
+
+    /* decode the next frame, and output one byte of it. If the input
+     * runs out, go back to the start of the frame */
+    if ((err = lzxd_step_mark(lzx, ss))) break;
+    if ((err = lzxd_decompress(lzx, 1))) {
+      if (ss->st->starved) err = lzxd_step_rollback(lzx, ss);
+      break;
+    }
+  }
+
+  stepper_end(ss->st);
+  lzx->sys    = sys;
+  lzx->input  = input;
+  lzx->output = output;
+  return err;
+}
+
 void lzxd_free(struct lzxd_stream *lzx) {
   struct mspack_system *sys;
   if (lzx) {
     sys = lzx->sys;
-    sys->free(lzx->inbuf);
+    if (lzx->step) {
+      stepper_free(lzx->step->st);
+      sys->free(lzx->step->window);
+      sys->free(lzx->step);
+    }
+    sys->free(lzx->inbuf - sizeof(bitbuf_type));
     sys->free(lzx->window);
+    sys->free(lzx->e8_buf);
     sys->free(lzx);
   }
 }
@@ -44,6 +44,13 @@
                       ((unsigned int) ((unsigned char *)(a))[3]))
 #define EndGetM16(a) ((((a)[0])<<8)|((a)[1]))
 
+/* the number of entries needed in a table for make_decode_table() in
+ * readhuff.h. Each second-level table is up to 1+2^(maxbits-nbits) entries
+ * long, and holds at least 1+maxbits-nbits codes, except possibly the last */
+#define HUFF_TABLESIZE(nsyms, nbits, maxbits) ((1 << (nbits)) +      \
+    (nsyms) * ((1 << ((maxbits) - (nbits))) + 1) /                      \
+    ((maxbits) - (nbits) + 1) + (1 << ((maxbits) - (nbits))) + 1)
+
 /* D(("formatstring", args)) prints debug messages if DEBUG defined */
 #if DEBUG
  /* http://gcc.gnu.org/onlinedocs/gcc/Function-Names.html */
@@ -133,6 +133,11 @@
  * compressor/decompressor is called simultaneously. libmspack will
  * not do this locking for you.
  *
+ * If libmspack was built with thread support and #MSCABD_PARAM_THREADS
+ * is set, a CAB decompressor's extract() method will start threads of
+ * its own. They only call the mspack_system's copy() method, so that
+ * must be multithreading-safe.
+ *
  * Example of incorrect behaviour:
  * - thread 1 calls mspack_create_cab_decompressor()
  * - thread 1 calls open()
@@ -941,6 +946,44 @@ struct mscabd_file {
  * will be ignored. Available only in CAB decoder version 2 and above.
  */
 #define MSCABD_PARAM_SALVAGE   (3)
+/** mscab_decompressor::set_param() parameter: number of threads to use?
+ * If more than 1, extract() will read ahead several data blocks of MS-ZIP
+ * compressed folders and decode them at once, with up to this many
+ * threads. This has no effect if libmspack was built without thread
+ * support, or if #MSCABD_PARAM_FIXMSZIP or #MSCABD_PARAM_SALVAGE are set.
+ * The default value is 1. Available only in CAB decoder version 4 and
+ * above.
+ */
+#define MSCABD_PARAM_THREADS   (4)
+/** mscab_decompressor::set_param() parameter: most MS-ZIP blocks to repair?
+ * If #MSCABD_PARAM_FIXMSZIP is set, extract() will repair no more than this
+ * many damaged data blocks, and will fail with #MSPACK_ERR_DECRUNCH on
+ * the next one. The default value is 0 (no limit). Available only in CAB
+ * decoder version 5 and above.
+ */
+#define MSCABD_PARAM_MAXREPAIRS (5)
+
+/**
+ * The repairs made to MS-ZIP data by the most recent extract().
+ *
+ * If #MSCABD_PARAM_FIXMSZIP is set, data blocks which can't be decoded
+ * are replaced with zero bytes, rather than failing extraction. This
+ * counts the blocks replaced while extracting one file, including those
+ * decoded before the file's data to get to its offset.
+ *
+ * @see mscab_decompressor::last_repairs()
+ */
+struct mscabd_repairs {
+  /** The number of damaged data blocks that were replaced. */
+  unsigned int blocks;
+
+  /** The index of the first replaced block in its folder, counting from 0.
+   * Only valid if #blocks is not 0. */
+  unsigned int first_block;
+
+  /** The number of zero bytes put in place of lost data. */
+  off_t bytes;
+};
 
 /** TODO */
 struct mscab_compressor {
@@ -1152,6 +1195,9 @@ struct mscab_decompressor {
    * - #MSCABD_PARAM_DECOMPBUF: How many bytes should be used as an input
    *   bit buffer by decompressors? The minimum value is 4. The default
    *   value is 4096.
+   * - #MSCABD_PARAM_MAXREPAIRS: How many damaged MS-ZIP blocks should
+   *   extract() repair before giving up? The default value is 0 (no
+   *   limit).
    *
    * @param  self     a self-referential pointer to the mscab_decompressor
    *                  instance being called
@@ -1177,6 +1223,52 @@ struct mscab_decompressor {
    * @see open(), search()
    */
   int (*last_error)(struct mscab_decompressor *self);
+
+  /**
+   * Extracts a file from a cabinet or cabinet set to memory.
+   *
+   * This works like extract(), but rather than writing the file with
+   * mspack_system::open(), mspack_system::write() and
+   * mspack_system::close(), it copies the file's data from the
+   * decompressor straight into the given buffer.
+   *
+   * If the buffer is smaller than the file, only the first
+   * <tt>length</tt> bytes of the file are extracted. Otherwise, the first
+   * mscabd_file::length bytes of the buffer are filled.
+   *
+   * Available only in CAB decoder version 3 and above.
+   *
+   * @param  self     a self-referential pointer to the mscab_decompressor
+   *                  instance being called
+   * @param  file     the file to be decompressed
+   * @param  buffer   the buffer to write the file to
+   * @param  length   the size of the buffer, in bytes
+   * @return an error code, or MSPACK_ERR_OK if successful
+   * @see extract()
+   */
+  int (*extract_to_buffer)(struct mscab_decompressor *self,
+                           struct mscabd_file *file,
+                           void *buffer,
+                           size_t length);
+
+  /**
+   * Gets the repairs made by the most recent extract() or
+   * extract_to_buffer().
+   *
+   * The repairs are only made if #MSCABD_PARAM_FIXMSZIP is set. The
+   * counts are for one file; they start again from 0 with each call to
+   * extract(), whether or not it succeeds.
+   *
+   * Available only in CAB decoder version 5 and above.
+   *
+   * @param  self     a self-referential pointer to the mscab_decompressor
+   *                  instance being called
+   * @param  repairs  a structure to fill with the repairs made
+   * @return MSPACK_ERR_OK, or MSPACK_ERR_ARGS if repairs is NULL
+   * @see extract(), set_param()
+   */
+  int (*last_repairs)(struct mscab_decompressor *self,
+                      struct mscabd_repairs *repairs);
 };
 
 /* --- support for .CHM (HTMLHelp) file format ----------------------------- */
@@ -1721,6 +1813,33 @@ struct mschm_decompressor {
                    const char *filename,
                    struct mschmd_file *f_ptr,
                    int f_size);
+
+  /**
+   * Extracts a file from a CHM helpfile to memory.
+   *
+   * This works like extract(), but rather than writing the file with
+   * mspack_system::open(), mspack_system::write() and
+   * mspack_system::close(), it copies the file's data from the
+   * decompressor straight into the given buffer.
+   *
+   * If the buffer is smaller than the file, only the first
+   * <tt>length</tt> bytes of the file are extracted. Otherwise, the first
+   * mschmd_file::length bytes of the buffer are filled.
+   *
+   * Available only in CHM decoder version 3 and above.
+   *
+   * @param  self     a self-referential pointer to the mschm_decompressor
+   *                  instance being called
+   * @param  file     the file to be decompressed
+   * @param  buffer   the buffer to write the file to
+   * @param  length   the size of the buffer, in bytes
+   * @return an error code, or MSPACK_ERR_OK if successful
+   * @see extract()
+   */
+  int (*extract_to_buffer)(struct mschm_decompressor *self,
+                           struct mschmd_file *file,
+                           void *buffer,
+                           size_t length);
 };
 
 /* --- support for .LIT (EBook) file format -------------------------------- */
@@ -1782,6 +1901,27 @@ struct msszddd_header {
   char missing_char;
 };
 
+/**
+ * One file for msszdd_decompressor::decompress_batch() to decompress.
+ */
+struct msszddd_batch {
+  /** The filename of the input SZDD file. This is passed directly to
+   * mspack_system::open(). */
+  const char *input;
+
+  /** The filename to write the decompressed data to. This is passed
+   * directly to mspack_system::open(). */
+  const char *output;
+
+  /** Set by decompress_batch() to an error code, or MSPACK_ERR_OK if this
+   * file was decompressed successfully. */
+  int error;
+  /** Set by decompress_batch() to the missing character from this file's
+   * header, or the null character if none was stored or the header
+   * couldn't be read. See msszddd_header::missing_char. */
+  char missing_char;
+};
+
 /**
  * A compressor for the SZDD file format.
  *
@@ -1962,6 +2102,39 @@ struct msszdd_decompressor {
    * @see open(), extract(), decompress()
    */
   int (*last_error)(struct msszdd_decompressor *self);
+
+  /**
+   * Decompresses a list of SZDD files, each to its own output file.
+   *
+   * Each file is decompressed as decompress() would, but the memory
+   * needed is allocated once for the whole list, rather than once for
+   * every file, so this is quicker for many small files.
+   *
+   * If threads is more than 1, up to that many files are decompressed at
+   * once, each on its own thread. The mspack_system methods will then be
+   * called from several threads at the same time, though never for the
+   * same file handle, so they must be thread-safe. The default
+   * mspack_system is. If libmspack was built without thread support, the
+   * files are decompressed one at a time.
+   *
+   * Every file in the list is tried, whether or not others fail, and the
+   * result for each is left in its msszddd_batch::error. The list and
+   * the filenames must not change until this returns. Available only in
+   * SZDD decoder version 2 and above.
+   *
+   * @param  self      a self-referential pointer to the msszdd_decompressor
+   *                   instance being called
+   * @param  files     the files to decompress
+   * @param  num_files the number of files in the list
+   * @param  threads   the most threads to decompress files on, at least 1
+   * @return the error code of the first file in the list that failed, or
+   *         MSPACK_ERR_OK if all files were decompressed successfully
+   * @see decompress()
+   */
+  int (*decompress_batch)(struct msszdd_decompressor *self,
+                          struct msszddd_batch *files,
+                          int num_files,
+                          int threads);
 };
 
 /* --- support for KWAJ file format ---------------------------------------- */
@@ -25,22 +25,28 @@ extern "C" {
 #define MSZIP_DISTANCE_MAXSYMBOLS (32)    /* distance huffman tree */
 #define MSZIP_DISTANCE_TABLEBITS  (6)
 
-/* if there are less direct lookup entries than symbols, the longer
- * code pointers will be <= maxsymbols. This must not happen, or we
- * will decode entries badly */
-#if (1 << MSZIP_LITERAL_TABLEBITS) < (MSZIP_LITERAL_MAXSYMBOLS * 2)
-# define MSZIP_LITERAL_TABLESIZE (MSZIP_LITERAL_MAXSYMBOLS * 4)
-#else
-# define MSZIP_LITERAL_TABLESIZE ((1 << MSZIP_LITERAL_TABLEBITS) + \
-                                  (MSZIP_LITERAL_MAXSYMBOLS * 2))
+/* if non-zero, up to three literals can be decoded with one lookup of
+ * this many bits (see make_multi_table() in readhuff.h), e.g. 11. If zero,
+ * only the literal tree's regular table is used, one symbol at a time */
+#ifndef MSZIP_LITERAL_MULTIBITS
+# define MSZIP_LITERAL_MULTIBITS  (0)
 #endif
 
-#if (1 << MSZIP_DISTANCE_TABLEBITS) < (MSZIP_DISTANCE_MAXSYMBOLS * 2)
-# define MSZIP_DISTANCE_TABLESIZE (MSZIP_DISTANCE_MAXSYMBOLS * 4)
-#else
-# define MSZIP_DISTANCE_TABLESIZE ((1 << MSZIP_DISTANCE_TABLEBITS) + \
-                                  (MSZIP_DISTANCE_MAXSYMBOLS * 2))
-#endif
+/* decoding table sizes. Deflate codes are no longer than 15 bits */
+#define MSZIP_LITERAL_TABLESIZE  HUFF_TABLESIZE(MSZIP_LITERAL_MAXSYMBOLS, \
+                                                MSZIP_LITERAL_TABLEBITS, 15)
+#define MSZIP_DISTANCE_TABLESIZE HUFF_TABLESIZE(MSZIP_DISTANCE_MAXSYMBOLS, \
+                                                MSZIP_DISTANCE_TABLEBITS, 15)
+
+struct mspack_step;                     /* see step.h */
+struct mszipd_step_state;
+struct mszipd_zlib_state;
+struct mszipd_par_state;
+
+/* a match logged while decoding blocks in parallel */
+struct mszipd_match {
+  unsigned short posn, length, distance;
+};
 
 struct mszipd_stream {
   struct mspack_system *sys;            /* I/O routines          */
@@ -48,14 +54,15 @@ struct mszipd_stream {
   struct mspack_file   *output;         /* output file handle    */
   unsigned int window_posn;             /* offset within window  */
 
-  /* inflate() will call this whenever the window should be emptied. */
+  /* zip_inflate() will call this whenever the window should be emptied. */
   int (*flush_window)(struct mszipd_stream *, unsigned int);
 
   int error, repair_mode, bytes_output;
 
   /* I/O buffering */
   unsigned char *inbuf, *i_ptr, *i_end, *o_ptr, *o_end, input_end;
-  unsigned int bit_buffer, bits_left, inbuf_size;
+  unsigned long bit_buffer;
+  unsigned int bits_left, inbuf_size;
 
 
   /* huffman code lengths */
@@ -65,9 +72,34 @@ struct mszipd_stream {
   /* huffman decoding tables */
   unsigned short LITERAL_table [MSZIP_LITERAL_TABLESIZE];
   unsigned short DISTANCE_table[MSZIP_DISTANCE_TABLESIZE];
+#if MSZIP_LITERAL_MULTIBITS
+  unsigned int   LITERAL_multi [1 << MSZIP_LITERAL_MULTIBITS];
+#endif
 
   /* 32kb history window */
   unsigned char window[MSZIP_FRAME_SIZE];
+
+  /* state for mszipd_step(), allocated on first use */
+  struct mszipd_step_state *step;
+
+  /* state for inflating with zlib, allocated on first use */
+  struct mszipd_zlib_state *zlib;
+
+  /* if not NULL, matches are logged here rather than copied */
+  struct mszipd_match *matches;
+  unsigned int num_matches;
+
+  /* state for decoding blocks in parallel, see mszipd_set_parallel() */
+  struct mszipd_par_state *par;
+
+  /* index of the block being decoded, counting from 0 */
+  unsigned int block;
+
+  /* repair mode: blocks repaired and bytes of zeros put in their place,
+   * the first block repaired, and the most blocks to repair before giving
+   * up (0 for no limit). The caller may reset these at any time */
+  unsigned int repaired_blocks, first_repaired, max_repairs;
+  off_t repaired_bytes;
 };
 
 /* allocates MS-ZIP decompression stream for decoding the given stream.
@@ -88,6 +120,28 @@ extern struct mszipd_stream *mszipd_init(struct mspack_system *system,
                                         int input_buffer_size,
                                         int repair_mode);
 
+/* makes mszipd_decompress() and mszipd_skip() decode several blocks at
+ * once, using up to the given number of threads, rather than reading
+ * input with system->read().
+ * - read_block(input, &data, &length) is called, with the input file handle
+ *   given in mszipd_init(), to get the data of each block, starting with
+ *   its "CK" signature. It should return MSPACK_ERR_OK, setting length to 0
+ *   if there are no more blocks, or return an error code. The data only
+ *   needs to stay valid until the next call.
+ * - blocks are read ahead and their Huffman codes decoded in parallel, then
+ *   their matches are copied one block at a time, as they can refer to the
+ *   block before. Threads other than the caller only call system->copy().
+ *   They're started when first needed and kept until mszipd_free().
+ * - each block is decoded on its own, so one block's data can't carry on
+ *   into the next. Repair mode is not supported.
+ * - without thread support (HAVE_PTHREAD), blocks are still decoded this
+ *   way, but only by the calling thread.
+ * - must be called before anything is decoded. Returns MSPACK_ERR_OK,
+ *   MSPACK_ERR_ARGS or MSPACK_ERR_NOMEMORY.
+ */
+extern int mszipd_set_parallel(struct mszipd_stream *zip, int threads,
+  int (*read_block)(struct mspack_file *, unsigned char **, unsigned int *));
+
 /* decompresses, or decompresses more of, an MS-ZIP stream.
  *
  * - out_bytes of data will be decompressed and the function will return
@@ -108,6 +162,37 @@ extern struct mszipd_stream *mszipd_init(struct mspack_system *system,
  */
 extern int mszipd_decompress(struct mszipd_stream *zip, off_t out_bytes);
 
+/* decompresses more of an MS-ZIP stream, like mszipd_decompress(), but
+ * throws the output away rather than writing it, to get to a point further
+ * on in the stream without calling system->write().
+ */
+extern int mszipd_skip(struct mszipd_stream *zip, off_t out_bytes);
+
+/* decompresses more of an MS-ZIP stream from and to memory buffers, in
+ * pull mode (see step.h), without calling system->read() or system->write().
+ *
+ * - takes input from step->next_in, and puts output at step->next_out,
+ *   until step->avail_out is zero, the stream ends, or all input has been
+ *   used, whichever comes first.
+ *
+ * - the stream ends when all input has been used and step->end_of_input
+ *   is set.
+ *
+ * - returns MSPACK_ERR_OK if step->avail_out is zero, MSPACK_STEP_END if
+ *   the stream has ended, MSPACK_STEP_NEED_INPUT if all input has been
+ *   used, or an error code.
+ *
+ * - blocks are decoded whole. The 32kb window is copied before every
+ *   block, and if the input runs out part way through a block, the block
+ *   is decoded again from its start once there is more input. Giving
+ *   input in pieces much smaller than a compressed block therefore costs
+ *   a block's decoding for every piece; give at least a few kilobytes at
+ *   a time where possible.
+ *
+ * - don't mix this with mszipd_decompress() on the same stream.
+ */
+extern int mszipd_step(struct mszipd_stream *zip, struct mspack_step *step);
+
 /* decompresses an entire MS-ZIP stream in a KWAJ file. Acts very much
  * like mszipd_decompress(), but doesn't take an out_bytes parameter
  */
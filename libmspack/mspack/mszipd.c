@@ -14,6 +14,15 @@
 
 #include <system.h>
 #include <mszip.h>
+#include <copymatch.h>
+#include <step.h>
+#include <stddef.h>
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
 
 /* import bit-reading macros and code */
 #define BITS_TYPE struct mszipd_stream
@@ -24,6 +33,10 @@
     READ_IF_NEEDED;             \
     INJECT_BITS(*i_ptr++, 8);   \
 } while (0)
+#define READ_BYTES_FAST do {                                \
+    INJECT_BITS(FETCH_LE_BYTES(i_ptr), BITS_FAST_BITS);     \
+    i_ptr += BITS_FAST_BITS / 8;                            \
+} while (0)
 #include <readbits.h>
 
 /* import huffman macros and code */
@@ -31,7 +44,10 @@
 #define MAXSYMBOLS(tbl)     MSZIP_##tbl##_MAXSYMBOLS
 #define HUFF_TABLE(tbl,idx) zip->tbl##_table[idx]
 #define HUFF_LEN(tbl,idx)   zip->tbl##_len[idx]
-#define HUFF_ERROR          return INF_ERR_HUFFSYM
+#if MSZIP_LITERAL_MULTIBITS
+# define MULTIBITS(tbl)      MSZIP_##tbl##_MULTIBITS
+# define HUFF_MULTI(tbl,idx) zip->tbl##_multi[idx]
+#endif
 #include <readhuff.h>
 
 #define FLUSH_IF_NEEDED do {                            \
@@ -72,11 +88,10 @@ static const unsigned char bitlen_order[19] = {
   16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
 };
 
-/* inflate() error codes */
+/* zip_inflate() error codes */
 #define INF_ERR_BLOCKTYPE   (-1)  /* unknown block type                      */
 #define INF_ERR_COMPLEMENT  (-2)  /* block size complement mismatch          */
 #define INF_ERR_FLUSH       (-3)  /* error from flush_window() callback      */
-#define INF_ERR_BITBUF      (-4)  /* too many bits in bit buffer             */
 #define INF_ERR_SYMLENS     (-5)  /* too many symbols in blocktype 2 header  */
 #define INF_ERR_BITLENTBL   (-6)  /* failed to build bitlens huffman table   */
 #define INF_ERR_LITERALTBL  (-7)  /* failed to build literals huffman table  */
@@ -86,7 +101,6 @@ static const unsigned char bitlen_order[19] = {
 #define INF_ERR_LITCODE     (-11) /* out-of-range literal code               */
 #define INF_ERR_DISTCODE    (-12) /* out-of-range distance code              */
 #define INF_ERR_DISTANCE    (-13) /* somehow, distance is beyond 32k         */
-#define INF_ERR_HUFFSYM     (-14) /* out of bits decoding huffman symbol     */
 
 static int zip_read_lens(struct mszipd_stream *zip) {
   DECLARE_BIT_VARS;
@@ -150,8 +164,144 @@ static int zip_read_lens(struct mszipd_stream *zip) {
   return 0;
 }
 
+/* COPY_MATCH copies a match of length bytes from distance bytes back
+ * in the window, flushing the window as it fills up */
+#define COPY_MATCH do {                                                     \
+    /* match position is window position minus distance. If distance      \
+     * is more than window position numerically, it must 'wrap            \
+     * around' the frame size. */                                         \
+    unsigned int match_posn = ((distance > zip->window_posn) ?            \
+        MSZIP_FRAME_SIZE : 0) + zip->window_posn - distance;              \
+                                                                          \
+    if ((match_posn + length) <= MSZIP_FRAME_SIZE &&                      \
+        (zip->window_posn + length) <= MSZIP_FRAME_SIZE)                  \
+    {                                                                     \
+        /* neither source nor destination wraps, copy it in one go */     \
+        copy_match(&zip->window[zip->window_posn],                        \
+                   &zip->window[match_posn], length);                     \
+        zip->window_posn += length;                                       \
+        FLUSH_IF_NEEDED;                                                  \
+    }                                                                     \
+    else if (length < 12) {                                               \
+        /* short match, use slower loop but no loop setup code */         \
+        while (length--) {                                                \
+            zip->window[zip->window_posn++] = zip->window[match_posn++];  \
+            match_posn &= MSZIP_FRAME_SIZE - 1;                           \
+            FLUSH_IF_NEEDED;                                              \
+        }                                                                 \
+    }                                                                     \
+    else {                                                                \
+        /* longer match, use faster loop but with setup expense */        \
+        do {                                                              \
+            this_run = length;                                            \
+            if ((match_posn + this_run) > MSZIP_FRAME_SIZE)               \
+                this_run = MSZIP_FRAME_SIZE - match_posn;                 \
+            if ((zip->window_posn + this_run) > MSZIP_FRAME_SIZE)         \
+                this_run = MSZIP_FRAME_SIZE - zip->window_posn;           \
+                                                                          \
+            copy_match(&zip->window[zip->window_posn],                    \
+                       &zip->window[match_posn], this_run);               \
+            zip->window_posn += this_run;                                 \
+            match_posn  += this_run;                                      \
+            length -= this_run;                                           \
+            if (match_posn == MSZIP_FRAME_SIZE) match_posn = 0;           \
+            FLUSH_IF_NEEDED;                                              \
+        } while (length > 0);                                             \
+    }                                                                     \
+} while (0)
+
+/* LOG_MATCH is used instead of COPY_MATCH when zip->matches is set. The
+ * match is logged, to be copied later, and the window position moves past
+ * it. A block of no more than MSZIP_FRAME_SIZE bytes can't have more than
+ * MSZIP_MAX_MATCHES matches, nor a match that goes past the end of the
+ * window, so either is an overflow */
+#define MSZIP_MAX_MATCHES (MSZIP_FRAME_SIZE / 3 + 1)
+#define LOG_MATCH do {                                                      \
+    struct mszipd_match *match;                                           \
+    if (zip->num_matches == MSZIP_MAX_MATCHES ||                          \
+        (zip->window_posn + length) > MSZIP_FRAME_SIZE)                   \
+    {                                                                     \
+        return INF_ERR_FLUSH;                                             \
+    }                                                                     \
+    match = &zip->matches[zip->num_matches++];                            \
+    match->posn     = (unsigned short) zip->window_posn;                  \
+    match->length   = (unsigned short) length;                            \
+    match->distance = (unsigned short) distance;                          \
+    zip->window_posn += length;                                           \
+    FLUSH_IF_NEEDED;                                                      \
+} while (0)
+
+/* inflate_fast() decodes symbols without checking the input buffer (see
+ * ENSURE_BITS_FAST), so it must stop once there is less input left than
+ * the largest symbol could need: a 15 bit literal/length code with 5
+ * extra bits and a 15 bit distance code with 13 extra bits.
+ */
+#define MSZIP_FAST_INPUT BITS_FAST_INPUT(15 + 5 + 15 + 13)
+
+/* Decodes the current Huffman-compressed block while there is enough
+ * input, returning 1 if the end of block code was read, 0 if not, or a
+ * zip_inflate() error code.
+ */
+static int inflate_fast(struct mszipd_stream *zip) {
+  DECLARE_HUFF_VARS;
+  unsigned int code, length, distance, this_run;
+
+  RESTORE_BITS;
+  while ((i_end - i_ptr) >= MSZIP_FAST_INPUT) {
+#if MSZIP_LITERAL_MULTIBITS
+    /* decode up to three literals at once, if they fit in the window */
+    ENSURE_BITS_FAST(HUFF_MAXBITS);
+    PEEK_HUFFMULTI(LITERAL, code);
+    if ((length = HUFF_MULTI_COUNT(code)) != 0 &&
+        length <= (MSZIP_FRAME_SIZE - zip->window_posn))
+    {
+      REMOVE_BITS(HUFF_MULTI_BITS(code));
+      zip->window[zip->window_posn] = HUFF_MULTI_SYM(code, 0);
+      if (length > 1) zip->window[zip->window_posn+1] = HUFF_MULTI_SYM(code,1);
+      if (length > 2) zip->window[zip->window_posn+2] = HUFF_MULTI_SYM(code,2);
+      zip->window_posn += length;
+      FLUSH_IF_NEEDED;
+      continue;
+    }
+    if (length == 0 && HUFF_MULTI_BITS(code)) {
+      REMOVE_BITS(HUFF_MULTI_BITS(code));
+      code = HUFF_MULTI_ONE(code);
+    }
+    else {
+      DECODE_HUFFSYM(LITERAL, code);
+    }
+#else
+    READ_HUFFSYM_FAST(LITERAL, code);
+#endif
+    if (code < 256) {
+      zip->window[zip->window_posn++] = (unsigned char) code;
+      FLUSH_IF_NEEDED;
+    }
+    else if (code == 256) {
+      /* END OF BLOCK CODE */
+      STORE_BITS;
+      return 1;
+    }
+    else {
+      code -= 257; /* codes 257-285 are matches */
+      if (code >= 29) return INF_ERR_LITCODE; /* codes 286-287 are illegal */
+      READ_BITS_T_FAST(length, lit_extrabits[code]);
+      length += lit_lengths[code];
+
+      READ_HUFFSYM_FAST(DISTANCE, code);
+      if (code >= 30) return INF_ERR_DISTCODE;
+      READ_BITS_T_FAST(distance, dist_extrabits[code]);
+      distance += dist_offsets[code];
+
+      if (zip->matches) LOG_MATCH; else COPY_MATCH;
+    }
+  }
+  STORE_BITS;
+  return 0;
+}
+
 /* a clean implementation of RFC 1951 / inflate */
-static int inflate(struct mszipd_stream *zip) {
+static int zip_inflate(struct mszipd_stream *zip) {
   DECLARE_HUFF_VARS;
   unsigned int last_block, block_type, distance, length, this_run;
   int i;
@@ -172,16 +322,18 @@ static int inflate(struct mszipd_stream *zip) {
       /* go to byte boundary */
       i = bits_left & 7; REMOVE_BITS(i);
 
-      /* read 4 bytes of data, emptying the bit-buffer if necessary */
-      for (i = 0; (bits_left >= 8); i++) {
-        if (i == 4) return INF_ERR_BITBUF;
-        lens_buf[i] = PEEK_BITS(8);
+      /* put any whole bytes left in the bit buffer back into the input
+       * buffer. mszipd_init() allocates room for this before inbuf */
+      i_ptr -= bits_left >> 3;
+      for (i = 0; bits_left >= 8; i++) {
+        i_ptr[i] = PEEK_BITS(8);
         REMOVE_BITS(8);
       }
-      if (bits_left != 0) return INF_ERR_BITBUF;
-      while (i < 4) {
+
+      /* read 4 bytes of data */
+      for (i = 0; i < 4; i++) {
         READ_IF_NEEDED;
-        lens_buf[i++] = *i_ptr++;
+        lens_buf[i] = *i_ptr++;
       }
 
       /* get the length and its complement */
@@ -207,7 +359,7 @@ static int inflate(struct mszipd_stream *zip) {
     }
     else if ((block_type == 1) || (block_type == 2)) {
       /* Huffman-compressed LZ77 block */
-      unsigned int match_posn, code;
+      unsigned int code;
 
       if (block_type == 1) {
         /* block with fixed Huffman codes */
@@ -232,6 +384,11 @@ static int inflate(struct mszipd_stream *zip) {
       {
         return INF_ERR_LITERALTBL;
       }
+#if MSZIP_LITERAL_MULTIBITS
+      make_multi_table(MSZIP_LITERAL_MAXSYMBOLS, MSZIP_LITERAL_TABLEBITS,
+                       MSZIP_LITERAL_MULTIBITS, 256, &zip->LITERAL_len[0],
+                       &zip->LITERAL_table[0], &zip->LITERAL_multi[0]);
+#endif
 
       if (make_decode_table(MSZIP_DISTANCE_MAXSYMBOLS,MSZIP_DISTANCE_TABLEBITS,
                             &zip->DISTANCE_len[0], &zip->DISTANCE_table[0]))
@@ -241,6 +398,14 @@ static int inflate(struct mszipd_stream *zip) {
 
       /* decode forever until end of block code */
       for (;;) {
+        /* decode without input checks while there's plenty of input */
+        if ((i_end - i_ptr) >= MSZIP_FAST_INPUT) {
+          STORE_BITS;
+          if ((i = inflate_fast(zip)) < 0) return i;
+          RESTORE_BITS;
+          if (i) break; /* end of block code */
+        }
+
         READ_HUFFSYM(LITERAL, code);
         if (code < 256) {
           zip->window[zip->window_posn++] = (unsigned char) code;
@@ -261,40 +426,7 @@ static int inflate(struct mszipd_stream *zip) {
           READ_BITS_T(distance, dist_extrabits[code]);
           distance += dist_offsets[code];
 
-          /* match position is window position minus distance. If distance
-           * is more than window position numerically, it must 'wrap
-           * around' the frame size. */ 
-          match_posn = ((distance > zip->window_posn) ? MSZIP_FRAME_SIZE : 0)
-            + zip->window_posn - distance;
-
-          /* copy match */
-          if (length < 12) {
-            /* short match, use slower loop but no loop setup code */
-            while (length--) {
-              zip->window[zip->window_posn++] = zip->window[match_posn++];
-              match_posn &= MSZIP_FRAME_SIZE - 1;
-              FLUSH_IF_NEEDED;
-            }
-          }
-          else {
-            /* longer match, use faster loop but with setup expense */
-            unsigned char *runsrc, *rundest;
-            do {
-              this_run = length;
-              if ((match_posn + this_run) > MSZIP_FRAME_SIZE)
-                this_run = MSZIP_FRAME_SIZE - match_posn;
-              if ((zip->window_posn + this_run) > MSZIP_FRAME_SIZE)
-                this_run = MSZIP_FRAME_SIZE - zip->window_posn;
-
-              rundest = &zip->window[zip->window_posn]; zip->window_posn += this_run;
-              runsrc  = &zip->window[match_posn];  match_posn  += this_run;
-              length -= this_run;
-              while (this_run--) *rundest++ = *runsrc++;
-              if (match_posn == MSZIP_FRAME_SIZE) match_posn = 0;
-              FLUSH_IF_NEEDED;
-            } while (length > 0);
-          }
-
+          if (zip->matches) LOG_MATCH; else COPY_MATCH;
         } /* else (code >= 257) */
 
       } /* for(;;) -- break point at 'code == 256' */
@@ -315,7 +447,7 @@ static int inflate(struct mszipd_stream *zip) {
   return 0;
 }
 
-/* inflate() calls this whenever the window should be flushed. As
+/* zip_inflate() calls this whenever the window should be flushed. As
  * MSZIP only expands to the size of the window, the implementation used
  * simply keeps track of the amount of data flushed, and if more than 32k
  * is flushed, an error is raised.
@@ -332,6 +464,162 @@ static int mszipd_flush_window(struct mszipd_stream *zip,
   return 0;
 }
 
+#ifdef HAVE_ZLIB
+/* With zlib, blocks are first inflated by zlib, using the previous block
+ * as a preset dictionary. If zlib can't inflate a block, zip_inflate()
+ * decodes it again from the start: zlib inflates into its own buffer, so
+ * the window still has the previous block, and all the input zlib read is
+ * recorded, to be read again from the replay buffer. Both buffers have
+ * room before them for bytes put back from the bit buffer, like inbuf.
+ */
+struct mszipd_zlib_state {
+  z_stream strm;
+  unsigned char out[MSZIP_FRAME_SIZE + 1]; /* one more to detect overflow */
+  unsigned char *record, *replay;          /* input read by zlib, re-read */
+  unsigned int record_len, record_size, replay_size;
+};
+
+static voidpf zlib_alloc(voidpf opaque, uInt items, uInt size) {
+  struct mspack_system *sys = (struct mspack_system *) opaque;
+  return sys->alloc(sys, (size_t) items * size);
+}
+
+static void zlib_free(voidpf opaque, voidpf address) {
+  struct mspack_system *sys = (struct mspack_system *) opaque;
+  sys->free(address);
+}
+
+/* adds len bytes of input to the record */
+static int zlib_record(struct mszipd_stream *zip,
+                       unsigned char *data, unsigned int len)
+{
+  struct mszipd_zlib_state *zs = zip->zlib;
+  struct mspack_system *sys = zip->sys;
+
+  if (zs->record_len + len > zs->record_size) {
+    unsigned int size = (zs->record_len + len) * 2;
+    unsigned char *buf = (unsigned char *) sys->alloc(sys,
+      size + sizeof(bitbuf_type));
+    if (!buf) return MSPACK_ERR_NOMEMORY;
+    buf += sizeof(bitbuf_type);
+    if (zs->record_len) sys->copy(zs->record, buf, zs->record_len);
+    if (zs->record) sys->free(zs->record - sizeof(bitbuf_type));
+    zs->record      = buf;
+    zs->record_size = size;
+  }
+  if (len) sys->copy(data, &zs->record[zs->record_len], len);
+  zs->record_len += len;
+  return MSPACK_ERR_OK;
+}
+
+/* inflates a block with zlib, after a block of dict_len bytes. Returns
+ * 0 if the block was inflated, -1 if it should be decoded by zip_inflate()
+ * instead, or an mspack error code */
+static int zip_inflate_zlib(struct mszipd_stream *zip, unsigned int dict_len) {
+  struct mszipd_zlib_state *zs = zip->zlib;
+  DECLARE_BIT_VARS;
+  unsigned int n;
+  int i, zerr;
+
+  if (!zs) {
+    zs = (struct mszipd_zlib_state *) zip->sys->alloc(zip->sys, sizeof(*zs));
+    if (!zs) return -1;
+    zs->strm.zalloc   = &zlib_alloc;
+    zs->strm.zfree    = &zlib_free;
+    zs->strm.opaque   = (voidpf) zip->sys;
+    zs->strm.next_in  = Z_NULL;
+    zs->strm.avail_in = 0;
+    if (inflateInit2(&zs->strm, -15) != Z_OK) {
+      zip->sys->free(zs);
+      return -1;
+    }
+    zs->record = zs->replay = NULL;
+    zs->record_len = zs->record_size = zs->replay_size = 0;
+    zip->zlib = zs;
+  }
+  else if (inflateReset(&zs->strm) != Z_OK) {
+    return -1;
+  }
+  if (dict_len && inflateSetDictionary(&zs->strm, &zip->window[0],
+                                       dict_len) != Z_OK)
+  {
+    return -1;
+  }
+
+  /* put any whole bytes left in the bit buffer back into the input */
+  RESTORE_BITS;
+  i_ptr -= bits_left >> 3;
+  for (i = 0; bits_left >= 8; i++) {
+    i_ptr[i] = PEEK_BITS(8);
+    REMOVE_BITS(8);
+  }
+  bit_buffer = 0;
+  bits_left = 0;
+
+  zs->record_len     = 0;
+  zs->strm.next_out  = &zs->out[0];
+  zs->strm.avail_out = sizeof(zs->out);
+  do {
+    if (i_ptr >= i_end) {
+      STORE_BITS;
+      if (read_input(zip)) return zip->error;
+      RESTORE_BITS;
+    }
+    zs->strm.next_in  = i_ptr;
+    zs->strm.avail_in = (uInt) (i_end - i_ptr);
+    zerr = inflate(&zs->strm, Z_NO_FLUSH);
+    n = (unsigned int) (zs->strm.next_in - i_ptr);
+    if ((i = zlib_record(zip, i_ptr, n))) return i;
+    i_ptr += n;
+  } while (zerr == Z_OK && zs->strm.avail_out > 0);
+
+  n = (unsigned int) (zs->strm.next_out - &zs->out[0]);
+  if (zerr == Z_STREAM_END && n <= MSZIP_FRAME_SIZE) {
+    zip->sys->copy(&zs->out[0], &zip->window[0], n);
+    zip->bytes_output = (int) n;
+    STORE_BITS;
+    return 0;
+  }
+
+  /* read the block's input again, followed by the rest of the input */
+  if ((i = zlib_record(zip, i_ptr, (unsigned int) (i_end - i_ptr)))) {
+    return i;
+  }
+  i_ptr = zs->replay;
+  n = zs->replay_size;
+  zs->replay      = zs->record;
+  zs->replay_size = zs->record_size;
+  zs->record      = i_ptr;
+  zs->record_size = n;
+
+  i_ptr = zs->replay;
+  i_end = &i_ptr[zs->record_len];
+  STORE_BITS;
+  return -1;
+}
+#endif
+
+/* inflates the next block into the window */
+static int zip_inflate_block(struct mszipd_stream *zip) {
+#ifdef HAVE_ZLIB
+  unsigned int dict_len = zip->bytes_output;
+  int error;
+#endif
+
+  zip->window_posn = 0;
+  zip->bytes_output = 0;
+#ifdef HAVE_ZLIB
+  /* zlib can only use the previous block as a dictionary if it filled the
+   * window. Repair mode and pull-mode decoding need zip_inflate() */
+  if (!zip->repair_mode && !zip->step &&
+      (dict_len == 0 || dict_len == MSZIP_FRAME_SIZE))
+  {
+    if ((error = zip_inflate_zlib(zip, dict_len)) >= 0) return error;
+  }
+#endif
+  return zip_inflate(zip);
+}
+
 struct mszipd_stream *mszipd_init(struct mspack_system *system,
                                   struct mspack_file *input,
                                   struct mspack_file *output,
@@ -351,12 +639,15 @@ struct mszipd_stream *mszipd_init(struct mspack_system *system,
     return NULL;
   }
 
-  /* allocate input buffer */
-  zip->inbuf  = (unsigned char *) system->alloc(system, input_buffer_size);
+  /* allocate input buffer, with room before it for putting back bytes
+   * from the bit buffer */
+  zip->inbuf  = (unsigned char *) system->alloc(system,
+    input_buffer_size + sizeof(bitbuf_type));
   if (!zip->inbuf) {
     system->free(zip);
     return NULL;
   }
+  zip->inbuf += sizeof(bitbuf_type);
 
   /* initialise decompression state */
   zip->sys             = system;
@@ -367,6 +658,17 @@ struct mszipd_stream *mszipd_init(struct mspack_system *system,
   zip->error           = MSPACK_ERR_OK;
   zip->repair_mode     = repair_mode;
   zip->flush_window    = &mszipd_flush_window;
+  zip->bytes_output    = 0;
+  zip->step            = NULL;
+  zip->zlib            = NULL;
+  zip->matches         = NULL;
+  zip->num_matches     = 0;
+  zip->par             = NULL;
+  zip->block           = 0;
+  zip->repaired_blocks = 0;
+  zip->first_repaired  = 0;
+  zip->max_repairs     = 0;
+  zip->repaired_bytes  = 0;
 
   zip->i_ptr = zip->i_end = &zip->inbuf[0];
   zip->o_ptr = zip->o_end = NULL;
@@ -374,12 +676,12 @@ struct mszipd_stream *mszipd_init(struct mspack_system *system,
   return zip;
 }
 
-int mszipd_decompress(struct mszipd_stream *zip, off_t out_bytes) {
-  /* for the bit buffer */
-  register unsigned int bit_buffer;
-  register int bits_left;
-  unsigned char *i_ptr, *i_end;
+static int zip_par_next(struct mszipd_stream *zip);
+static int zip_step_starved(struct mszipd_stream *zip);
 
+/* decodes out_bytes of output, and writes it unless skip is non-zero */
+static int mszipd_decode(struct mszipd_stream *zip, off_t out_bytes, int skip) {
+  DECLARE_BIT_VARS;
   int i, state, error;
 
   /* easy answers */
@@ -390,7 +692,7 @@ int mszipd_decompress(struct mszipd_stream *zip, off_t out_bytes) {
   i = zip->o_end - zip->o_ptr;
   if ((off_t) i > out_bytes) i = (int) out_bytes;
   if (i) {
-    if (zip->sys->write(zip->output, zip->o_ptr, i) != i) {
+    if (!skip && zip->sys->write(zip->output, zip->o_ptr, i) != i) {
       return zip->error = MSPACK_ERR_WRITE;
     }
     zip->o_ptr  += i;
@@ -400,48 +702,59 @@ int mszipd_decompress(struct mszipd_stream *zip, off_t out_bytes) {
 
 
   while (out_bytes > 0) {
-    /* unpack another block */
-    RESTORE_BITS;
-
-    /* skip to next read 'CK' header */
-    i = bits_left & 7; REMOVE_BITS(i); /* align to bytestream */
-    state = 0;
-    do {
-      READ_BITS(i, 8);
-      if (i == 'C') state = 1;
-      else if ((state == 1) && (i == 'K')) state = 2;
-      else state = 0;
-    } while (state != 2);
-
-    /* inflate a block, repair and realign if necessary */
-    zip->window_posn = 0;
-    zip->bytes_output = 0;
-    STORE_BITS;
-    if ((error = inflate(zip))) {
-      D(("inflate error %d", error))
-      if (zip->repair_mode) {
-        /* recover partially-inflated buffers */
-        if (zip->bytes_output == 0 && zip->window_posn > 0) {
-          zip->flush_window(zip, zip->window_posn);
+    if (zip->par) {
+      /* take the next of the blocks inflated in parallel */
+      if ((error = zip_par_next(zip))) {
+        return zip->error = (error > 0) ? error : MSPACK_ERR_DECRUNCH;
+      }
+    }
+    else {
+      /* unpack another block */
+      RESTORE_BITS;
+
+      /* skip to next read 'CK' header */
+      i = bits_left & 7; REMOVE_BITS(i); /* align to bytestream */
+      state = 0;
+      do {
+        READ_BITS(i, 8);
+        if (i == 'C') state = 1;
+        else if ((state == 1) && (i == 'K')) state = 2;
+        else state = 0;
+      } while (state != 2);
+
+      /* inflate a block, repair and realign if necessary */
+      STORE_BITS;
+      if ((error = zip_inflate_block(zip))) {
+        D(("inflate error %d", error))
+        if (zip->repair_mode && !zip_step_starved(zip) &&
+            (zip->max_repairs == 0 || zip->repaired_blocks < zip->max_repairs))
+        {
+          /* recover partially-inflated buffers */
+          if (zip->bytes_output == 0 && zip->window_posn > 0) {
+            zip->flush_window(zip, zip->window_posn);
+          }
+          zip->sys->message(NULL, "MSZIP error, %u bytes of data lost.",
+                            MSZIP_FRAME_SIZE - zip->bytes_output);
+          for (i = zip->bytes_output; i < MSZIP_FRAME_SIZE; i++) {
+            zip->window[i] = '\0';
+          }
+          if (zip->repaired_blocks++ == 0) zip->first_repaired = zip->block;
+          zip->repaired_bytes += MSZIP_FRAME_SIZE - zip->bytes_output;
+          zip->bytes_output = MSZIP_FRAME_SIZE;
         }
-        zip->sys->message(NULL, "MSZIP error, %u bytes of data lost.",
-                          MSZIP_FRAME_SIZE - zip->bytes_output);
-        for (i = zip->bytes_output; i < MSZIP_FRAME_SIZE; i++) {
-          zip->window[i] = '\0';
+        else {
+          return zip->error = (error > 0) ? error : MSPACK_ERR_DECRUNCH;
         }
-        zip->bytes_output = MSZIP_FRAME_SIZE;
-      }
-      else {
-        return zip->error = (error > 0) ? error : MSPACK_ERR_DECRUNCH;
       }
     }
+    zip->block++;
     zip->o_ptr = &zip->window[0];
     zip->o_end = &zip->o_ptr[zip->bytes_output];
 
     /* write a frame */
     i = (out_bytes < (off_t)zip->bytes_output) ?
       (int)out_bytes : zip->bytes_output;
-    if (zip->sys->write(zip->output, zip->o_ptr, i) != i) {
+    if (!skip && zip->sys->write(zip->output, zip->o_ptr, i) != i) {
       return zip->error = MSPACK_ERR_WRITE;
     }
 
@@ -459,6 +772,14 @@ int mszipd_decompress(struct mszipd_stream *zip, off_t out_bytes) {
   return MSPACK_ERR_OK;
 }
 
+int mszipd_decompress(struct mszipd_stream *zip, off_t out_bytes) {
+  return mszipd_decode(zip, out_bytes, 0);
+}
+
+int mszipd_skip(struct mszipd_stream *zip, off_t out_bytes) {
+  return mszipd_decode(zip, out_bytes, 1);
+}
+
 int mszipd_decompress_kwaj(struct mszipd_stream *zip) {
     DECLARE_BIT_VARS;
     int i, error, block_len;
@@ -479,10 +800,8 @@ int mszipd_decompress_kwaj(struct mszipd_stream *zip) {
         READ_BITS(i, 8); if (i != 'K') return MSPACK_ERR_DATAFORMAT;
 
         /* inflate block */
-        zip->window_posn = 0;
-        zip->bytes_output = 0;
         STORE_BITS;
-        if ((error = inflate(zip))) {
+        if ((error = zip_inflate_block(zip))) {
             D(("inflate error %d", error))
             return zip->error = (error > 0) ? error : MSPACK_ERR_DECRUNCH;
         }
@@ -494,11 +813,428 @@ int mszipd_decompress_kwaj(struct mszipd_stream *zip) {
     return MSPACK_ERR_OK;
 }
 
+/*-------- parallel decoding --------*/
+
+/* After mszipd_set_parallel(), mszipd_decode() reads up to MSZIP_PAR_BLOCKS
+ * blocks per thread at a time into slots. Each slot has a stream of its
+ * own, which inflates the slot's block with its matches logged, leaving
+ * just the literals in its window. The threads take every n'th slot.
+ * zip_par_next() then copies the next slot's literals and matches to the
+ * main window, which has the block before it, as zip_inflate() would */
+#define MSZIP_PAR_BLOCKS     (4)
+#define MSZIP_PAR_MAXTHREADS (64)
+
+struct mszipd_par_slot {
+  struct mszipd_stream *zip;          /* stream inflating the block      */
+  unsigned char *data;                /* the block's data                */
+  unsigned int length, size;          /* length of data, size of buffer  */
+  int error;                          /* error from zip_inflate()        */
+};
+
+struct mszipd_par_job {
+  struct mszipd_par_state *par;
+  int first;                          /* first slot this job inflates    */
+#ifdef HAVE_PTHREAD
+  pthread_t thread;
+  unsigned int fill;                  /* last fill this job worked on    */
+#endif
+};
+
+struct mszipd_par_state {
+  int (*read_block)(struct mspack_file *, unsigned char **, unsigned int *);
+  struct mspack_system sys;           /* system for the slots' streams   */
+  struct mszipd_par_slot *slots;
+  struct mszipd_par_job *jobs;
+  int threads, num_slots;             /* max threads, number of slots    */
+  int count, next, stride;            /* slots read, next one, jobs used */
+  int error;                          /* error reading the next block    */
+#ifdef HAVE_PTHREAD
+  /* the threads are started on the first fill and kept until the stream
+   * is freed. Each fill, fill is bumped and go is signalled; the threads
+   * do their jobs, and the last one to finish signals done */
+  pthread_mutex_t lock;
+  pthread_cond_t go, done;
+  unsigned int fill;                  /* number of fills so far          */
+  int started, running;               /* threads started, still working  */
+  int quit;                           /* set when the threads should end */
+#endif
+};
+
+static int zip_par_read(struct mspack_file *file, void *buffer, int bytes) {
+  /* the slots' streams already have all their input */
+  return 0;
+}
+
+static void zip_par_inflate(struct mszipd_par_slot *slot) {
+  struct mszipd_stream *zip = slot->zip;
+  unsigned char *p = slot->data, *end = &slot->data[slot->length];
+
+  /* skip to the 'CK' header */
+  while ((end - p) >= 2 && !(p[0] == 'C' && p[1] == 'K')) p++;
+  if ((end - p) < 2) {
+    slot->error = MSPACK_ERR_DATAFORMAT;
+    return;
+  }
+
+  zip->i_ptr       = &p[2];
+  zip->i_end       = end;
+  zip->bit_buffer  = 0;
+  zip->bits_left   = 0;
+  zip->input_end   = 0;
+  zip->error       = MSPACK_ERR_OK;
+  zip->window_posn = 0;
+  zip->bytes_output = 0;
+  zip->num_matches = 0;
+  slot->error = zip_inflate(zip);
+}
+
+static void zip_par_job(struct mszipd_par_job *job) {
+  struct mszipd_par_state *par = job->par;
+  int i;
+  if (job->first >= par->stride) return;
+  for (i = job->first; i < par->count; i += par->stride) {
+    zip_par_inflate(&par->slots[i]);
+  }
+}
+
+#ifdef HAVE_PTHREAD
+/* a thread in the pool: waits for each fill, does its job, then waits
+ * for the next, until told to quit */
+static void *zip_par_thread(void *arg) {
+  struct mszipd_par_job *job = (struct mszipd_par_job *) arg;
+  struct mszipd_par_state *par = job->par;
+
+  pthread_mutex_lock(&par->lock);
+  for (;;) {
+    while (!par->quit && job->fill == par->fill) {
+      pthread_cond_wait(&par->go, &par->lock);
+    }
+    if (par->quit) break;
+    job->fill = par->fill;
+    pthread_mutex_unlock(&par->lock);
+
+    zip_par_job(job);
+
+    pthread_mutex_lock(&par->lock);
+    if (--par->running == 0) pthread_cond_signal(&par->done);
+  }
+  pthread_mutex_unlock(&par->lock);
+  return NULL;
+}
+#endif
+
+/* reads and inflates the next blocks */
+static int zip_par_fill(struct mszipd_stream *zip) {
+  struct mszipd_par_state *par = zip->par;
+  struct mspack_system *sys = zip->sys;
+  struct mszipd_par_slot *slot;
+  unsigned char *data;
+  unsigned int length;
+  int i, started;
+
+  for (par->count = 0; par->count < par->num_slots; par->count++) {
+    slot = &par->slots[par->count];
+    if ((par->error = par->read_block(zip->input, &data, &length))) break;
+    if (length == 0) {
+      /* there are no more blocks */
+      par->error = MSPACK_ERR_DATAFORMAT;
+      break;
+    }
+    if (length > slot->size) {
+      /* like inbuf, leave room before the data for putting back bytes */
+      if (slot->data) sys->free(slot->data - sizeof(bitbuf_type));
+      slot->data = (unsigned char *) sys->alloc(sys,
+        length + sizeof(bitbuf_type));
+      if (!slot->data) {
+        slot->size = 0;
+        par->error = MSPACK_ERR_NOMEMORY;
+        break;
+      }
+      slot->data += sizeof(bitbuf_type);
+      slot->size = length;
+    }
+    sys->copy(data, slot->data, length);
+    slot->length = length;
+  }
+  par->next = 0;
+  if (par->count == 0) return par->error;
+
+  /* this thread does the first job, and any that can't get a thread */
+  par->stride = (par->count < par->threads) ? par->count : par->threads;
+  started = 1;
+#ifdef HAVE_PTHREAD
+  /* start any more threads needed, then set the pool going */
+  while (par->started + 1 < par->stride) {
+    struct mszipd_par_job *job = &par->jobs[par->started + 1];
+    job->fill = par->fill;
+    if (pthread_create(&job->thread, NULL, &zip_par_thread, job)) break;
+    par->started++;
+  }
+  started += par->started;
+  if (par->started) {
+    pthread_mutex_lock(&par->lock);
+    par->fill++;
+    par->running = par->started;
+    pthread_cond_broadcast(&par->go);
+    pthread_mutex_unlock(&par->lock);
+  }
+#endif
+  for (i = 0; i < par->stride; i++) {
+    if (i == 0 || i >= started) zip_par_job(&par->jobs[i]);
+  }
+#ifdef HAVE_PTHREAD
+  if (par->started) {
+    pthread_mutex_lock(&par->lock);
+    while (par->running > 0) pthread_cond_wait(&par->done, &par->lock);
+    pthread_mutex_unlock(&par->lock);
+  }
+#endif
+  return MSPACK_ERR_OK;
+}
+
+/* puts the next block in the window. Returns 0, an mspack error code, or
+ * a zip_inflate() error code */
+static int zip_par_next(struct mszipd_stream *zip) {
+  struct mszipd_par_state *par = zip->par;
+  struct mszipd_par_slot *slot;
+  struct mszipd_stream *blk;
+  struct mszipd_match *match;
+  unsigned int i, posn, length, distance, this_run;
+  int error;
+
+  if (par->next == par->count) {
+    if (par->error) return par->error;
+    if ((error = zip_par_fill(zip))) return error;
+  }
+  slot = &par->slots[par->next++];
+  if (slot->error) return MSPACK_ERR_DECRUNCH;
+
+  /* copy the literals before each match, then the match */
+  blk = slot->zip;
+  zip->window_posn = 0;
+  zip->bytes_output = 0;
+  for (i = 0, posn = 0; i < blk->num_matches; i++) {
+    match = &blk->matches[i];
+    zip->sys->copy(&blk->window[posn], &zip->window[posn], match->posn - posn);
+    zip->window_posn = posn = match->posn;
+    length   = match->length;
+    distance = match->distance;
+    posn    += length; /* COPY_MATCH uses up length */
+    COPY_MATCH;
+  }
+  zip->sys->copy(&blk->window[posn], &zip->window[posn],
+                 blk->bytes_output - posn);
+  zip->bytes_output = blk->bytes_output;
+  return MSPACK_ERR_OK;
+}
+
+static void zip_par_free(struct mszipd_stream *zip) {
+  struct mszipd_par_state *par = zip->par;
+  struct mspack_system *sys = zip->sys;
+  int i;
+
+#ifdef HAVE_PTHREAD
+  if (par->started) {
+    pthread_mutex_lock(&par->lock);
+    par->quit = 1;
+    pthread_cond_broadcast(&par->go);
+    pthread_mutex_unlock(&par->lock);
+    for (i = 1; i <= par->started; i++) {
+      pthread_join(par->jobs[i].thread, NULL);
+    }
+  }
+  pthread_cond_destroy(&par->done);
+  pthread_cond_destroy(&par->go);
+  pthread_mutex_destroy(&par->lock);
+#endif
+
+  if (par->slots) {
+    for (i = 0; i < par->num_slots; i++) {
+      struct mszipd_par_slot *slot = &par->slots[i];
+      if (slot->zip) {
+        sys->free(slot->zip->matches);
+        mszipd_free(slot->zip);
+      }
+      if (slot->data) sys->free(slot->data - sizeof(bitbuf_type));
+    }
+    sys->free(par->slots);
+  }
+  sys->free(par->jobs);
+  sys->free(par);
+  zip->par = NULL;
+}
+
+int mszipd_set_parallel(struct mszipd_stream *zip, int threads,
+  int (*read_block)(struct mspack_file *, unsigned char **, unsigned int *))
+{
+  struct mszipd_par_state *par;
+  struct mspack_system *sys;
+  int i;
+
+  if (!zip || !read_block || threads < 1) return MSPACK_ERR_ARGS;
+  if (zip->par || zip->repair_mode) return MSPACK_ERR_ARGS;
+#ifdef HAVE_PTHREAD
+  if (threads > MSZIP_PAR_MAXTHREADS) threads = MSZIP_PAR_MAXTHREADS;
+#else
+  threads = 1;
+#endif
+
+  sys = zip->sys;
+  par = (struct mszipd_par_state *) sys->alloc(sys, sizeof(*par));
+  if (!par) return MSPACK_ERR_NOMEMORY;
+  par->read_block = read_block;
+  par->sys        = *sys;
+  par->sys.read   = &zip_par_read;
+  par->threads    = threads;
+  par->num_slots  = threads * MSZIP_PAR_BLOCKS;
+  par->count = par->next = par->stride = 0;
+  par->error      = MSPACK_ERR_OK;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init(&par->lock, NULL);
+  pthread_cond_init(&par->go, NULL);
+  pthread_cond_init(&par->done, NULL);
+  par->fill = 0;
+  par->started = par->running = par->quit = 0;
+#endif
+  par->slots = (struct mszipd_par_slot *) sys->alloc(sys,
+    par->num_slots * sizeof(struct mszipd_par_slot));
+  par->jobs = (struct mszipd_par_job *) sys->alloc(sys,
+    threads * sizeof(struct mszipd_par_job));
+  zip->par = par;
+  if (!par->slots || !par->jobs) goto nomem;
+
+  for (i = 0; i < par->num_slots; i++) {
+    par->slots[i].zip    = NULL;
+    par->slots[i].data   = NULL;
+    par->slots[i].length = par->slots[i].size = 0;
+    par->slots[i].error  = MSPACK_ERR_OK;
+  }
+  for (i = 0; i < par->num_slots; i++) {
+    struct mszipd_stream *blk = mszipd_init(&par->sys, NULL, NULL, 16, 0);
+    if (!(par->slots[i].zip = blk)) goto nomem;
+    blk->matches = (struct mszipd_match *) sys->alloc(sys,
+      MSZIP_MAX_MATCHES * sizeof(struct mszipd_match));
+    if (!blk->matches) goto nomem;
+  }
+  for (i = 0; i < threads; i++) {
+    par->jobs[i].par   = par;
+    par->jobs[i].first = i;
+  }
+  return MSPACK_ERR_OK;
+
+nomem:
+  zip_par_free(zip);
+  return MSPACK_ERR_NOMEMORY;
+}
+
+/*-------- pull-mode decoding --------*/
+
+/* mszipd_step() marks the start of each block before decoding it, saving
+ * everything in the stream before the huffman code lengths, which are read
+ * again for each block, and the window, which the block will overwrite */
+#define MSZIP_STEP_SAVED offsetof(struct mszipd_stream, LITERAL_len)
+
+struct mszipd_step_state {
+  struct mspack_stepper *st;
+  unsigned char saved[MSZIP_STEP_SAVED];
+  unsigned char window[MSZIP_FRAME_SIZE];
+};
+
+/* has mszipd_step() run out of input? The block will be decoded again
+ * with more input, so it isn't damaged and mustn't be repaired */
+static int zip_step_starved(struct mszipd_stream *zip) {
+  return zip->step && zip->step->st->starved;
+}
+
+int mszipd_step(struct mszipd_stream *zip, struct mspack_step *step) {
+  struct mszipd_step_state *ss;
+  struct mspack_system *sys;
+  struct mspack_file *input, *output;
+  unsigned int i;
+  int err = MSPACK_ERR_OK;
+
+  if (!zip || !step) return MSPACK_ERR_ARGS;
+  if (zip->error) return zip->error;
+
+  if (!(ss = zip->step)) {
+    ss = (struct mszipd_step_state *) zip->sys->alloc(zip->sys, sizeof(*ss));
+    if (!ss) return MSPACK_ERR_NOMEMORY;
+    if (!(ss->st = stepper_init(zip->sys, zip->inbuf_size))) {
+      zip->sys->free(ss);
+      return MSPACK_ERR_NOMEMORY;
+    }
+    zip->step = ss;
+  }
+
+  /* read and write the step's buffers rather than the stream's files */
+  sys    = zip->sys;
+  input  = zip->input;
+  output = zip->output;
+  zip->sys   = &ss->st->sys;
+  zip->input = zip->output = (struct mspack_file *) ss->st;
+  stepper_begin(ss->st, step);
+
+  while (step->avail_out > 0) {
+    /* copy out anything already decoded */
+    if ((i = (unsigned int) (zip->o_end - zip->o_ptr)) != 0) {
+      if (i > step->avail_out) i = step->avail_out;
+      sys->copy(zip->o_ptr, step->next_out, i);
+      zip->o_ptr      += i;
+      step->next_out  += i;
+      step->avail_out -= i;
+      continue;
+    }
+
+    /* the stream ends when all input has been used */
+    if (stepper_input_done(ss->st) && (zip->input_end ||
+        (zip->i_ptr == zip->i_end && zip->bits_left < 8)))
+    {
+      err = MSPACK_STEP_END;
+      break;
+    }
+
+    /* decode the next block, and output one byte of it. If the input
+     * runs out, go back to the start of the block */
+    sys->copy(zip, ss->saved, MSZIP_STEP_SAVED);
+    sys->copy(zip->window, ss->window, MSZIP_FRAME_SIZE);
+    stepper_mark(ss->st, zip->i_ptr, zip->i_end);
+    if ((err = mszipd_decompress(zip, 1))) {
+      if (ss->st->starved) {
+        sys->copy(ss->saved, zip, MSZIP_STEP_SAVED);
+        sys->copy(ss->window, zip->window, MSZIP_FRAME_SIZE);
+        err = stepper_rollback(ss->st, zip->inbuf, zip->inbuf_size,
+                               &zip->i_ptr, &zip->i_end);
+        if (err) zip->error = err; else err = MSPACK_STEP_NEED_INPUT;
+      }
+      break;
+    }
+  }
+
+  stepper_end(ss->st);
+  zip->sys    = sys;
+  zip->input  = input;
+  zip->output = output;
+  return err;
+}
+
 void mszipd_free(struct mszipd_stream *zip) {
   struct mspack_system *sys;
   if (zip) {
     sys = zip->sys;
-    sys->free(zip->inbuf);
+    if (zip->step) {
+      stepper_free(zip->step->st);
+      sys->free(zip->step);
+    }
+    if (zip->par) zip_par_free(zip);
+#ifdef HAVE_ZLIB
+    if (zip->zlib) {
+      inflateEnd(&zip->zlib->strm);
+      if (zip->zlib->record) sys->free(zip->zlib->record - sizeof(bitbuf_type));
+      if (zip->zlib->replay) sys->free(zip->zlib->replay - sizeof(bitbuf_type));
+      sys->free(zip->zlib);
+    }
+#endif
+    sys->free(zip->inbuf - sizeof(bitbuf_type));
     sys->free(zip);
   }
 }
@@ -21,15 +21,27 @@ extern "C" {
 
 #define QTM_FRAME_SIZE (32768)
 
-struct qtmd_modelsym {
-  unsigned short sym, cumfreq;
-};
+/* the longest match. The window has this much space after it, for the
+ * end of a match that wraps around a window smaller than a frame */
+#define QTM_MAX_MATCH  (259)
+
+/* A model has up to 64 symbols, most frequent first. cumfreq[i] is the sum
+ * of the frequencies of sym[i] and all the symbols after it, so it falls
+ * as i rises, and cumfreq[entries] is 0. The arrays are padded with more
+ * zeros to a multiple of QTM_MODEL_BLOCK entries, so they can be searched
+ * and updated a block at a time */
+#define QTM_MODEL_BLOCK (8)
+#define QTM_MODEL_SIZE  (72)
 
 struct qtmd_model {
   int shiftsleft, entries;
-  struct qtmd_modelsym *syms;
+  unsigned short cumfreq[QTM_MODEL_SIZE];
+  unsigned short sym[QTM_MODEL_SIZE];
 };
 
+struct mspack_step;               /* see step.h */
+struct qtmd_step_state;
+
 struct qtmd_stream {
   struct mspack_system *sys;      /* I/O routines                            */
   struct mspack_file   *input;    /* input file handle                       */
@@ -39,6 +51,7 @@ struct qtmd_stream {
   unsigned int window_size;       /* window size                             */
   unsigned int window_posn;       /* decompression offset within window      */
   unsigned int frame_todo;        /* bytes remaining for current frame       */
+  unsigned int window_spill;      /* bytes of a match past the window's end  */
 
   unsigned short H, L, C;         /* high/low/current: arith coding state    */
   unsigned char header_read;      /* have we started decoding a new frame?   */
@@ -47,7 +60,8 @@ struct qtmd_stream {
 
   /* I/O buffers */
   unsigned char *inbuf, *i_ptr, *i_end, *o_ptr, *o_end;
-  unsigned int  bit_buffer, inbuf_size;
+  unsigned long bit_buffer;
+  unsigned int  inbuf_size;
   unsigned char bits_left, input_end;
 
   /* four literal models, each representing 64 symbols
@@ -66,15 +80,8 @@ struct qtmd_stream {
   /* selector model. 0-6 to say literal (0,1,2,3) or match (4,5,6) */
   struct qtmd_model model7;
 
-  /* symbol arrays for all models */
-  struct qtmd_modelsym m0sym[64 + 1];
-  struct qtmd_modelsym m1sym[64 + 1];
-  struct qtmd_modelsym m2sym[64 + 1];
-  struct qtmd_modelsym m3sym[64 + 1];
-  struct qtmd_modelsym m4sym[24 + 1];
-  struct qtmd_modelsym m5sym[36 + 1];
-  struct qtmd_modelsym m6sym[42 + 1], m6lsym[27 + 1];
-  struct qtmd_modelsym m7sym[7 + 1];
+  /* state for qtmd_step(), allocated on first use */
+  struct qtmd_step_state *step;
 };
 
 /* allocates Quantum decompression state for decoding the given stream.
@@ -115,6 +122,30 @@ extern struct qtmd_stream *qtmd_init(struct mspack_system *system,
  */
 extern int qtmd_decompress(struct qtmd_stream *qtm, off_t out_bytes);
 
+/* decompresses more of a Quantum stream, like qtmd_decompress(), but
+ * throws the output away rather than writing it, to get to a point further
+ * on in the stream without calling system->write().
+ */
+extern int qtmd_skip(struct qtmd_stream *qtm, off_t out_bytes);
+
+/* decompresses more of a Quantum stream from and to memory buffers, in
+ * pull mode (see step.h), without calling system->read() or system->write().
+ *
+ * - takes input from step->next_in, and puts output at step->next_out,
+ *   until step->avail_out is zero or all input has been used.
+ *
+ * - Quantum streams don't say where they end, so this never returns
+ *   MSPACK_STEP_END. Like qtmd_decompress(), it must not be asked for more
+ *   output than the stream has, so step->avail_out should be no more than
+ *   the bytes still to come.
+ *
+ * - returns MSPACK_ERR_OK if step->avail_out is zero,
+ *   MSPACK_STEP_NEED_INPUT if all input has been used, or an error code.
+ *
+ * - don't mix this with qtmd_decompress() on the same stream.
+ */
+extern int qtmd_step(struct qtmd_stream *qtm, struct mspack_step *step);
+
 /* frees all state associated with a Quantum data stream
  *
  * - calls system->free() using the system pointer given in qtmd_init()
@@ -22,6 +22,8 @@
 
 #include <system.h>
 #include <qtm.h>
+#include <copymatch.h>
+#include <step.h>
 
 /* import bit-reading macros and code */
 #define BITS_TYPE struct qtmd_stream
@@ -33,6 +35,10 @@
     READ_IF_NEEDED; b1 = *i_ptr++;      \
     INJECT_BITS((b0 << 8) | b1, 16);    \
 } while (0)
+#define READ_BYTES_FAST do {                                \
+    INJECT_BITS(FETCH_BE_BYTES(i_ptr), BITS_FAST_BITS);     \
+    i_ptr += BITS_FAST_BITS / 8;                            \
+} while (0)
 #include <readbits.h>
 
 /* Quantum static data tables:
@@ -82,56 +88,145 @@ static const unsigned char length_extra[27] = {
 };
 
 
+/* QTM_CLZ16(x) counts the leading zero bits of a non-zero 16-bit value */
+#if defined(__GNUC__) || defined(__clang__)
+# define QTM_CLZ16(x) (__builtin_clz((unsigned int) (x) << 16))
+#else
+static int qtm_clz16(unsigned int x) {
+  int n = 0;
+  while (!(x & 0x8000)) { x <<= 1; n++; }
+  return n;
+}
+# define QTM_CLZ16(x) qtm_clz16(x)
+#endif
+
+/* Model search and update. With SSE2, a model's cumfreqs are compared and
+ * updated 8 at a time. Define QTM_NO_SIMD to build only the portable
+ * version. */
+#if !defined(QTM_NO_SIMD) && defined(__SSE2__) && \
+    (defined(__GNUC__) || defined(__clang__))
+# define QTM_MODEL_SIMD 1
+# include <emmintrin.h>
+#endif
+
+/* returns the index of the first cumfreq after cumfreq[0] that is no more
+ * than symf. As cumfreq[entries] is 0, this is entries at most */
+static inline int qtmd_find_symbol(struct qtmd_model *model,
+                                   unsigned int symf)
+{
+#if QTM_MODEL_SIMD
+  /* cumfreqs fit in a signed short, so this comparison still works */
+  const __m128i f = _mm_set1_epi16((short) ((symf > 0x7FFF) ? 0x7FFF : symf));
+  unsigned int mask;
+  int i = 0;
+
+  /* find lanes where cumfreq <= symf, ignoring cumfreq[0] */
+  mask = ~_mm_movemask_epi8(_mm_cmpgt_epi16(_mm_loadu_si128(
+    (const __m128i *) &model->cumfreq[0]), f)) & 0xFFFC;
+  while (!mask) {
+    i += QTM_MODEL_BLOCK;
+    mask = ~_mm_movemask_epi8(_mm_cmpgt_epi16(_mm_loadu_si128(
+      (const __m128i *) &model->cumfreq[i]), f)) & 0xFFFF;
+  }
+  return i + (__builtin_ctz(mask) >> 1);
+#else
+  int i;
+  for (i = 1; i < model->entries; i++) {
+    if (model->cumfreq[i] <= symf) break;
+  }
+  return i;
+#endif
+}
+
+/* adds 8 to the first n cumfreqs, n > 0 */
+static inline void qtmd_add_freq(struct qtmd_model *model, int n) {
+#if QTM_MODEL_SIMD
+  const __m128i eight = _mm_set1_epi16(8);
+  __m128i *cf = (__m128i *) &model->cumfreq[0];
+  for (; n >= QTM_MODEL_BLOCK; n -= QTM_MODEL_BLOCK, cf++) {
+    _mm_storeu_si128(cf, _mm_add_epi16(_mm_loadu_si128(cf), eight));
+  }
+  if (n) {
+    /* add 8 to the lanes below n only */
+    __m128i lanes = _mm_cmpgt_epi16(_mm_set1_epi16((short) n),
+                                    _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7));
+    _mm_storeu_si128(cf, _mm_add_epi16(_mm_loadu_si128(cf),
+                                       _mm_and_si128(lanes, eight)));
+  }
+#else
+  do { model->cumfreq[--n] += 8; } while (n > 0);
+#endif
+}
+
 /* Arithmetic decoder:
  * 
  * GET_SYMBOL(model, var) fetches the next symbol from the stated model
  * and puts it in var.
  *
  * If necessary, qtmd_update_model() is called.
+ *
+ * Then the range is renormalised. One bit at a time, this would be:
+ *
+ *   while (1) {
+ *     if ((L & 0x8000) != (H & 0x8000)) {
+ *       if ((L & 0x4000) && !(H & 0x4000)) {
+ *         // underflow case
+ *         C ^= 0x4000; L &= 0x3FFF; H |= 0x4000;
+ *       }
+ *       else break;
+ *     }
+ *     L <<= 1; H = (H << 1) | 1; C = (C << 1) | next bit;
+ *   }
+ *
+ * H is never below L, so this shifts out all the leading bits L and H
+ * have in common, then as long as L is 01... and H is 10..., shifts out
+ * the second bit while keeping the first. C's second bit is flipped each
+ * time, but only the last flip isn't shifted out. So it's done in one go
+ * instead: [same] leading bits are shifted, then [under] underflow bits,
+ * and C takes in all the new bits with a single read.
  */
 #define GET_SYMBOL(model, var) do {                                     \
   range = ((H - L) & 0xFFFF) + 1;                                       \
-  symf = ((((C - L + 1) * model.syms[0].cumfreq)-1) / range) & 0xFFFF;  \
+  symf = ((((C - L + 1) * model.cumfreq[0])-1) / range) & 0xFFFF;       \
                                                                         \
-  for (i = 1; i < model.entries; i++) {                                 \
-    if (model.syms[i].cumfreq <= symf) break;                           \
-  }                                                                     \
-  (var) = model.syms[i-1].sym;                                          \
+  i = qtmd_find_symbol(&model, symf);                                   \
+  (var) = model.sym[i-1];                                               \
                                                                         \
   range = (H - L) + 1;                                                  \
-  symf = model.syms[0].cumfreq;                                         \
-  H = L + ((model.syms[i-1].cumfreq * range) / symf) - 1;               \
-  L = L + ((model.syms[i].cumfreq   * range) / symf);                   \
+  symf = model.cumfreq[0];                                              \
+  H = L + ((model.cumfreq[i-1] * range) / symf) - 1;                    \
+  L = L + ((model.cumfreq[i]   * range) / symf);                        \
                                                                         \
-  do { model.syms[--i].cumfreq += 8; } while (i > 0);                   \
-  if (model.syms[0].cumfreq > 3800) qtmd_update_model(&model);          \
+  qtmd_add_freq(&model, i);                                             \
+  if (model.cumfreq[0] > 3800) qtmd_update_model(&model);               \
                                                                         \
-  while (1) {                                                           \
-    if ((L & 0x8000) != (H & 0x8000)) {                                 \
-      if ((L & 0x4000) && !(H & 0x4000)) {                              \
-        /* underflow case */                                            \
-        C ^= 0x4000; L &= 0x3FFF; H |= 0x4000;                          \
-      }                                                                 \
-      else break;                                                       \
-    }                                                                   \
-    L = (unsigned short) (L << 1);                                      \
-    H = (unsigned short) ((H << 1) | 1);                                \
-    ENSURE_BITS(1);                                                     \
-    C  = (unsigned short) ((C << 1) | PEEK_BITS(1));                    \
-    REMOVE_BITS(1);                                                     \
+  same = (L == H) ? 16 : QTM_CLZ16(L ^ H);                              \
+  L = (unsigned short) ((unsigned int) L << same);                      \
+  H = (unsigned short) (((unsigned int) H << same) | ((1 << same) - 1));\
+  under = QTM_CLZ16(~((unsigned int) (L & ~H) << 1) & 0xFFFF);          \
+  if (under) {                                                          \
+    L = (unsigned short) (((unsigned int) L << under) & 0x7FFF);        \
+    H = (unsigned short) (((unsigned int) H << under) | 0x8000 |        \
+                          ((1 << under) - 1));                          \
+  }                                                                     \
+  if ((same += under)) {                                                \
+    ENSURE_BITS(same);                                                  \
+    C = (unsigned short) (((unsigned int) C << same) | PEEK_BITS(same)); \
+    REMOVE_BITS(same);                                                  \
+    if (under) C ^= 0x8000;                                             \
   }                                                                     \
 } while (0)
 
 static void qtmd_update_model(struct qtmd_model *model) {
-  struct qtmd_modelsym tmp;
+  unsigned short tmp;
   int i, j;
 
   if (--model->shiftsleft) {
     for (i = model->entries - 1; i >= 0; i--) {
       /* -1, not -2; the 0 entry saves this */
-      model->syms[i].cumfreq >>= 1;
-      if (model->syms[i].cumfreq <= model->syms[i+1].cumfreq) {
-        model->syms[i].cumfreq = model->syms[i+1].cumfreq + 1;
+      model->cumfreq[i] >>= 1;
+      if (model->cumfreq[i] <= model->cumfreq[i+1]) {
+        model->cumfreq[i] = model->cumfreq[i+1] + 1;
       }
     }
   }
@@ -140,9 +235,9 @@ static void qtmd_update_model(struct qtmd_model *model) {
     for (i = 0; i < model->entries; i++) {
       /* no -1, want to include the 0 entry */
       /* this converts cumfreqs into frequencies, then shifts right */
-      model->syms[i].cumfreq -= model->syms[i+1].cumfreq;
-      model->syms[i].cumfreq++; /* avoid losing things entirely */
-      model->syms[i].cumfreq >>= 1;
+      model->cumfreq[i] -= model->cumfreq[i+1];
+      model->cumfreq[i]++; /* avoid losing things entirely */
+      model->cumfreq[i] >>= 1;
     }
 
     /* now sort by frequencies, decreasing order -- this must be an
@@ -150,34 +245,38 @@ static void qtmd_update_model(struct qtmd_model *model) {
      * characteristics */
     for (i = 0; i < model->entries - 1; i++) {
       for (j = i + 1; j < model->entries; j++) {
-        if (model->syms[i].cumfreq < model->syms[j].cumfreq) {
-          tmp = model->syms[i];
-          model->syms[i] = model->syms[j];
-          model->syms[j] = tmp;
+        if (model->cumfreq[i] < model->cumfreq[j]) {
+          tmp = model->cumfreq[i];
+          model->cumfreq[i] = model->cumfreq[j];
+          model->cumfreq[j] = tmp;
+          tmp = model->sym[i];
+          model->sym[i] = model->sym[j];
+          model->sym[j] = tmp;
         }
       }
     }
 
     /* then convert frequencies back to cumfreq */
     for (i = model->entries - 1; i >= 0; i--) {
-      model->syms[i].cumfreq += model->syms[i+1].cumfreq;
+      model->cumfreq[i] += model->cumfreq[i+1];
     }
   }
 }
 
 /* Initialises a model to decode symbols from [start] to [start]+[len]-1 */
-static void qtmd_init_model(struct qtmd_model *model,
-                            struct qtmd_modelsym *syms, int start, int len)
-{
+static void qtmd_init_model(struct qtmd_model *model, int start, int len) {
   int i;
 
   model->shiftsleft = 4;
   model->entries    = len;
-  model->syms       = syms;
 
   for (i = 0; i <= len; i++) {
-    syms[i].sym     = start + i; /* actual symbol */
-    syms[i].cumfreq = len - i;   /* current frequency of that symbol */
+    model->sym[i]     = start + i; /* actual symbol */
+    model->cumfreq[i] = len - i;   /* current frequency of that symbol */
+  }
+  for (; i < QTM_MODEL_SIZE; i++) {
+    model->sym[i]     = 0;
+    model->cumfreq[i] = 0;
   }
 }
 
@@ -208,7 +307,8 @@ struct qtmd_stream *qtmd_init(struct mspack_system *system,
   }
 
   /* allocate decompression window and input buffer */
-  qtm->window = (unsigned char *) system->alloc(system, (size_t) window_size);
+  qtm->window = (unsigned char *) system->alloc(system,
+    (size_t) window_size + QTM_MAX_MATCH);
   qtm->inbuf  = (unsigned char *) system->alloc(system, (size_t) input_buffer_size);
   if (!qtm->window || !qtm->inbuf) {
     system->free(qtm->window);
@@ -224,9 +324,11 @@ struct qtmd_stream *qtmd_init(struct mspack_system *system,
   qtm->inbuf_size  = input_buffer_size;
   qtm->window_size = window_size;
   qtm->window_posn = 0;
+  qtm->window_spill = 0;
   qtm->frame_todo  = QTM_FRAME_SIZE;
   qtm->header_read = 0;
   qtm->error       = MSPACK_ERR_OK;
+  qtm->step        = NULL;
 
   qtm->i_ptr = qtm->i_end = &qtm->inbuf[0];
   qtm->o_ptr = qtm->o_end = &qtm->window[0];
@@ -240,25 +342,26 @@ struct qtmd_stream *qtmd_init(struct mspack_system *system,
    * - model 6pos depends on window size, ranges from 20 to 42
    */
   i = window_bits * 2;
-  qtmd_init_model(&qtm->model0,    &qtm->m0sym[0],   0, 64);
-  qtmd_init_model(&qtm->model1,    &qtm->m1sym[0],  64, 64);
-  qtmd_init_model(&qtm->model2,    &qtm->m2sym[0], 128, 64);
-  qtmd_init_model(&qtm->model3,    &qtm->m3sym[0], 192, 64);
-  qtmd_init_model(&qtm->model4,    &qtm->m4sym[0],   0, (i > 24) ? 24 : i);
-  qtmd_init_model(&qtm->model5,    &qtm->m5sym[0],   0, (i > 36) ? 36 : i);
-  qtmd_init_model(&qtm->model6,    &qtm->m6sym[0],   0, i);
-  qtmd_init_model(&qtm->model6len, &qtm->m6lsym[0],  0, 27);
-  qtmd_init_model(&qtm->model7,    &qtm->m7sym[0],   0, 7);
+  qtmd_init_model(&qtm->model0,      0, 64);
+  qtmd_init_model(&qtm->model1,     64, 64);
+  qtmd_init_model(&qtm->model2,    128, 64);
+  qtmd_init_model(&qtm->model3,    192, 64);
+  qtmd_init_model(&qtm->model4,      0, (i > 24) ? 24 : i);
+  qtmd_init_model(&qtm->model5,      0, (i > 36) ? 36 : i);
+  qtmd_init_model(&qtm->model6,      0, i);
+  qtmd_init_model(&qtm->model6len,   0, 27);
+  qtmd_init_model(&qtm->model7,      0, 7);
 
   /* all ok */
   return qtm;
 }
 
-int qtmd_decompress(struct qtmd_stream *qtm, off_t out_bytes) {
+/* decodes out_bytes of output, and writes it unless skip is non-zero */
+static int qtmd_decode(struct qtmd_stream *qtm, off_t out_bytes, int skip) {
   DECLARE_BIT_VARS;
   unsigned int frame_todo, frame_end, window_posn, match_offset, range;
   unsigned char *window, *runsrc, *rundest;
-  int i, j, selector, extra, sym, match_length;
+  int i, j, selector, extra, sym, match_length, same, under;
   unsigned short H, L, C, symf;
 
   /* easy answers */
@@ -269,7 +372,7 @@ int qtmd_decompress(struct qtmd_stream *qtm, off_t out_bytes) {
   i = qtm->o_end - qtm->o_ptr;
   if ((off_t) i > out_bytes) i = (int) out_bytes;
   if (i) {
-    if (qtm->sys->write(qtm->output, qtm->o_ptr, i) != i) {
+    if (!skip && qtm->sys->write(qtm->output, qtm->o_ptr, i) != i) {
       return qtm->error = MSPACK_ERR_WRITE;
     }
     qtm->o_ptr  += i;
@@ -354,38 +457,18 @@ int qtmd_decompress(struct qtmd_stream *qtm, off_t out_bytes) {
 
         /* does match destination wrap the window? This situation is possible
          * where the window size is less than the 32k frame size, but matches
-         * must not go beyond a frame boundary */
+         * must not go beyond a frame boundary. The match is written past the
+         * end of the window, and the part past the end is moved to the start
+         * once the whole window has been written out. The source may also be
+         * past the end of the window, earlier in the same match */
         if ((window_posn + match_length) > qtm->window_size) {
-          /* copy first part of match, before window end */
-          i = qtm->window_size - window_posn;
           j = window_posn - match_offset;
-          while (i--) *rundest++ = window[j++ & (qtm->window_size - 1)];
-
-          /* flush currently stored data */
-          i = (&window[qtm->window_size] - qtm->o_ptr);
-
-          /* this should not happen, but if it does then this code
-           * can't handle the situation (can't flush up to the end of
-           * the window, but can't break out either because we haven't
-           * finished writing the match). bail out in this case */
-          if (i > out_bytes) {
-            D(("during window-wrap match; %d bytes to flush but only need %d",
-               i, (int) out_bytes))
-            return qtm->error = MSPACK_ERR_DECRUNCH;
+          for (i = match_length; i > 0; i--, j++) {
+            *rundest++ = window[(j >= (int) qtm->window_size) ? j
+                                : (j & (int) (qtm->window_size - 1))];
           }
-          if (qtm->sys->write(qtm->output, qtm->o_ptr, i) != i) {
-            return qtm->error = MSPACK_ERR_WRITE;
-          }
-          out_bytes -= i;
-          qtm->o_ptr = &window[0];
-          qtm->o_end = &window[0]; 
-
-          /* copy second part of match, after window wrap */
-          rundest = &window[0];
-          i = match_length - (qtm->window_size - window_posn);
-          while (i--) *rundest++ = window[j++ & (qtm->window_size - 1)];
-          window_posn = window_posn + match_length - qtm->window_size;
-
+          qtm->window_spill = window_posn + match_length - qtm->window_size;
+          window_posn = qtm->window_size;
           break; /* because "window_posn < frame_end" has now failed */
         }
         else {
@@ -403,14 +486,14 @@ int qtmd_decompress(struct qtmd_stream *qtm, off_t out_bytes) {
             runsrc = &window[qtm->window_size - j];
             if (j < i) {
               /* if match goes over the window edge, do two copy runs */
-              i -= j; while (j-- > 0) *rundest++ = *runsrc++;
+              copy_match(rundest, runsrc, j);
+              rundest += j; i -= j;
               runsrc = window;
             }
-            while (i-- > 0) *rundest++ = *runsrc++;
+            copy_match(rundest, runsrc, i);
           }
           else {
-            runsrc = rundest - match_offset;
-            while (i-- > 0) *rundest++ = *runsrc++;
+            copy_match(rundest, rundest - match_offset, i);
           }
           window_posn += match_length;
         }
@@ -447,20 +530,26 @@ int qtmd_decompress(struct qtmd_stream *qtm, off_t out_bytes) {
       i = (qtm->o_end - qtm->o_ptr);
       /* break out if we have more than enough to finish this request */
       if (i >= out_bytes) break;
-      if (qtm->sys->write(qtm->output, qtm->o_ptr, i) != i) {
+      if (!skip && qtm->sys->write(qtm->output, qtm->o_ptr, i) != i) {
         return qtm->error = MSPACK_ERR_WRITE;
       }
       out_bytes -= i;
+
+      /* move the end of any match that went past the window's end */
+      window_posn = qtm->window_spill;
+      if (window_posn) {
+        qtm->sys->copy(&window[qtm->window_size], &window[0], window_posn);
+      }
+      qtm->window_spill = 0;
       qtm->o_ptr = &window[0];
-      qtm->o_end = &window[0]; 
-      window_posn = 0;
+      qtm->o_end = &window[window_posn];
    }
 
   } /* while (more bytes needed) */
 
   if (out_bytes) {
     i = (int) out_bytes;
-    if (qtm->sys->write(qtm->output, qtm->o_ptr, i) != i) {
+    if (!skip && qtm->sys->write(qtm->output, qtm->o_ptr, i) != i) {
       return qtm->error = MSPACK_ERR_WRITE;
     }
     qtm->o_ptr += i;
@@ -478,10 +567,125 @@ int qtmd_decompress(struct qtmd_stream *qtm, off_t out_bytes) {
   return MSPACK_ERR_OK;
 }
 
+int qtmd_decompress(struct qtmd_stream *qtm, off_t out_bytes) {
+  return qtmd_decode(qtm, out_bytes, 0);
+}
+
+int qtmd_skip(struct qtmd_stream *qtm, off_t out_bytes) {
+  return qtmd_decode(qtm, out_bytes, 1);
+}
+
+/*-------- pull-mode decoding --------*/
+
+/* qtmd_step() decodes up to a frame's worth of output at a time. Before
+ * each, it saves the whole stream, and the part of the window that will be
+ * decoded into, including the space after the window. A match can go on
+ * past the bytes asked for, by up to its maximum length */
+#define QTM_STEP_MAX     (QTM_FRAME_SIZE)
+#define QTM_STEP_OVERRUN (259)
+
+struct qtmd_step_state {
+  struct mspack_stepper *st;
+  struct qtmd_stream saved;
+  unsigned char window[QTM_STEP_MAX + QTM_STEP_OVERRUN];
+  unsigned int window_len;        /* length of the saved part of the window */
+  unsigned char spill[QTM_MAX_MATCH]; /* the space after the window         */
+};
+
+/* copies len bytes of the window from or to buf, from window_posn on and
+ * wrapping around the end of the window, and the space after the window
+ * from or to spill */
+static void qtmd_step_window(struct qtmd_stream *qtm, unsigned char *buf,
+                             unsigned int len, unsigned char *spill, int save)
+{
+  unsigned int posn = qtm->window_posn, i = qtm->window_size - posn;
+  unsigned char *end = &qtm->window[qtm->window_size];
+  if (i > len) i = len;
+  if (save) {
+    qtm->sys->copy(&qtm->window[posn], buf, i);
+    qtm->sys->copy(&qtm->window[0], &buf[i], len - i);
+    qtm->sys->copy(end, spill, QTM_MAX_MATCH);
+  }
+  else {
+    qtm->sys->copy(buf, &qtm->window[posn], i);
+    qtm->sys->copy(&buf[i], &qtm->window[0], len - i);
+    qtm->sys->copy(spill, end, QTM_MAX_MATCH);
+  }
+}
+
+int qtmd_step(struct qtmd_stream *qtm, struct mspack_step *step) {
+  struct qtmd_step_state *ss;
+  struct mspack_system *sys;
+  struct mspack_file *input, *output;
+  unsigned int i;
+  int err = MSPACK_ERR_OK;
+
+  if (!qtm || !step) return MSPACK_ERR_ARGS;
+  if (qtm->error) return qtm->error;
+
+  if (!(ss = qtm->step)) {
+    ss = (struct qtmd_step_state *) qtm->sys->alloc(qtm->sys, sizeof(*ss));
+    if (!ss) return MSPACK_ERR_NOMEMORY;
+    if (!(ss->st = stepper_init(qtm->sys, qtm->inbuf_size))) {
+      qtm->sys->free(ss);
+      return MSPACK_ERR_NOMEMORY;
+    }
+    qtm->step = ss;
+  }
+
+  /* read and write the step's buffers rather than the stream's files */
+  sys    = qtm->sys;
+  input  = qtm->input;
+  output = qtm->output;
+  qtm->sys   = &ss->st->sys;
+  qtm->input = qtm->output = (struct mspack_file *) ss->st;
+  stepper_begin(ss->st, step);
+
+  while (step->avail_out > 0) {
+    /* copy out anything already decoded */
+    if ((i = (unsigned int) (qtm->o_end - qtm->o_ptr)) != 0) {
+      if (i > step->avail_out) i = step->avail_out;
+      sys->copy(qtm->o_ptr, step->next_out, i);
+      qtm->o_ptr      += i;
+      step->next_out  += i;
+      step->avail_out -= i;
+      continue;
+    }
+
+    /* decode some more. If the input runs out, go back to where it was */
+    i = (step->avail_out > QTM_STEP_MAX) ? QTM_STEP_MAX : step->avail_out;
+    ss->window_len = i + QTM_STEP_OVERRUN;
+    if (ss->window_len > qtm->window_size) ss->window_len = qtm->window_size;
+    sys->copy(qtm, &ss->saved, sizeof(struct qtmd_stream));
+    qtmd_step_window(qtm, ss->window, ss->window_len, ss->spill, 1);
+    stepper_mark(ss->st, qtm->i_ptr, qtm->i_end);
+    if ((err = qtmd_decompress(qtm, (off_t) i))) {
+      if (ss->st->starved) {
+        sys->copy(&ss->saved, qtm, sizeof(struct qtmd_stream));
+        qtmd_step_window(qtm, ss->window, ss->window_len, ss->spill, 0);
+        err = stepper_rollback(ss->st, qtm->inbuf, qtm->inbuf_size,
+                               &qtm->i_ptr, &qtm->i_end);
+        if (err) qtm->error = err; else err = MSPACK_STEP_NEED_INPUT;
+      }
+      break;
+    }
+  }
+
+  stepper_end(ss->st);
+  qtm->sys    = sys;
+  qtm->input  = input;
+  qtm->output = output;
+  return err;
+}
+
 void qtmd_free(struct qtmd_stream *qtm) {
   struct mspack_system *sys;
   if (qtm) {
     sys = qtm->sys;
+    if (qtm->step) {
+      stepper_free(qtm->step->st);
+      sys->free(qtm->step);
+    }
     sys->free(qtm->window);
     sys->free(qtm->inbuf);
     sys->free(qtm);
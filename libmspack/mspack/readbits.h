@@ -22,6 +22,9 @@
  * PEEK_BITS(n)      extracts without removing N bits from the bit buffer
  * REMOVE_BITS(n)    removes N bits from the bit buffer
  *
+ * ENSURE_BITS_FAST(n)   ENSURE_BITS without checking the byte buffer
+ * READ_BITS_FAST(var,n) READ_BITS without checking the byte buffer
+ *
  * READ_BITS simply calls ENSURE_BITS, PEEK_BITS and REMOVE_BITS,
  * which means it's limited to reading the number of bits you can
  * ensure at any one time. It also fails if asked to read zero bits.
@@ -38,12 +41,19 @@
  *   it should use READ_IF_NEEDED (calls read_input if the byte buffer
  *   is empty), then INJECT_BITS(data,n) to put data from the byte
  *   buffer into the bit buffer.
+ * - optionally, READ_BYTES_FAST: some code that puts BITS_FAST_BITS
+ *   bits from the byte buffer into the bit buffer in one go. It is only
+ *   used by ENSURE_BITS when the byte buffer has at least
+ *   BITS_FAST_BITS/8 bytes left and the bit buffer has room for them,
+ *   so it should not use READ_IF_NEEDED. FETCH_LE_BYTES, FETCH_BE_BYTES
+ *   and FETCH_LE16_WORDS read BITS_FAST_BITS bits from a byte pointer
+ *   for the common bitstream layouts.
  *
  * You also need to define some variables and structure members:
- * - unsigned char *i_ptr;    // current position in the byte buffer
- * - unsigned char *i_end;    // end of the byte buffer
- * - unsigned int bit_buffer; // the bit buffer itself
- * - unsigned int bits_left;  // number of bits remaining
+ * - unsigned char *i_ptr;     // current position in the byte buffer
+ * - unsigned char *i_end;     // end of the byte buffer
+ * - unsigned long bit_buffer; // the bit buffer itself
+ * - unsigned int bits_left;   // number of bits remaining
  *
  * If you use read_input() and READ_IF_NEEDED, they also expect these
  * structure members:
@@ -67,16 +77,23 @@
  * If you are reading in LSB order, bits need to be masked. Normally
  * this is done by computing the mask: N bits are masked by the value
  * (1<<N)-1). However, you can define BITS_LSB_TABLE to use a lookup
- * table instead of computing this. This adds two new macros,
- * PEEK_BITS_T and READ_BITS_T which work the same way as PEEK_BITS
- * and READ_BITS, except they use this lookup table. This is useful if
- * you need to look up a number of bits that are only known at
- * runtime, so the bit mask can't be turned into a constant by the
- * compiler.
+ * table instead of computing this. This adds three new macros,
+ * PEEK_BITS_T, READ_BITS_T and READ_BITS_T_FAST which work the same
+ * way as PEEK_BITS, READ_BITS and READ_BITS_FAST, except they use this
+ * lookup table. This is useful if you need to look up a number of bits
+ * that are only known at runtime, so the bit mask can't be turned into
+ * a constant by the compiler.
 
  * The bit buffer datatype should be at least 32 bits wide: it must be
  * possible to ENSURE_BITS(17), so it must be possible to add 16 new bits
  * to the bit buffer when the bit buffer already has 1 to 15 bits left.
+ * An unsigned long is used, so on LP64 systems the bit buffer is 64 bits
+ * wide and READ_BYTES_FAST can add 48 bits at a time, rather than
+ * READ_BYTES adding 8 or 16 bits at a time. Because of this, the bit
+ * buffer can hold several bytes beyond the one currently being read. If
+ * you need to read the byte stream directly, e.g. for uncompressed data,
+ * you must first put any whole bytes left in the bit buffer back into the
+ * byte buffer, or take them from the bit buffer.
  */
 
 #ifndef BITS_VAR
@@ -93,7 +110,7 @@
 # endif
 #endif
 
-typedef unsigned int bitbuf_type;
+typedef unsigned long bitbuf_type;
 
 #if HAVE_LIMITS_H
 # include <limits.h>
@@ -103,6 +120,23 @@ typedef unsigned int bitbuf_type;
 #endif
 #define BITBUF_WIDTH (sizeof(bitbuf_type) * CHAR_BIT)
 
+/* number of bits added to the bit buffer by READ_BYTES_FAST */
+#if defined(ULONG_MAX) && (ULONG_MAX > 0xFFFFFFFFUL)
+# define BITS_FAST_BITS (48)
+# define FETCH_LE_BYTES(p) ((bitbuf_type) EndGetI32(p) |        \
+    ((bitbuf_type) EndGetI16((p) + 4) << 32))
+# define FETCH_BE_BYTES(p) (((bitbuf_type) EndGetM32(p) << 16) | \
+    (bitbuf_type) EndGetM16((p) + 4))
+# define FETCH_LE16_WORDS(p) (((bitbuf_type) EndGetI16(p) << 32) | \
+    ((bitbuf_type) EndGetI16((p) + 2) << 16) |                    \
+    (bitbuf_type) EndGetI16((p) + 4))
+#else
+# define BITS_FAST_BITS (16)
+# define FETCH_LE_BYTES(p)   ((bitbuf_type) EndGetI16(p))
+# define FETCH_BE_BYTES(p)   ((bitbuf_type) EndGetM16(p))
+# define FETCH_LE16_WORDS(p) ((bitbuf_type) EndGetI16(p))
+#endif
+
 #define DECLARE_BIT_VARS \
    unsigned char *i_ptr, *i_end; \
    register bitbuf_type bit_buffer; \
@@ -130,9 +164,46 @@ typedef unsigned int bitbuf_type;
     bits_left  = BITS_VAR->bits_left;   \
 } while (0)
 
-#define ENSURE_BITS(nbits) do {                 \
+#ifdef READ_BYTES_FAST
+# define ENSURE_BITS(nbits) do {                                        \
+    if (bits_left < (nbits)) {                                          \
+        if ((i_end - i_ptr) >= (BITS_FAST_BITS / 8) &&                  \
+            bits_left <= (int)(BITBUF_WIDTH - BITS_FAST_BITS))          \
+        {                                                               \
+            READ_BYTES_FAST;                                            \
+        }                                                               \
+        while (bits_left < (nbits)) READ_BYTES;                         \
+    }                                                                   \
+} while (0)
+#else
+# define ENSURE_BITS(nbits) do {                 \
     while (bits_left < (nbits)) READ_BYTES;     \
 } while (0)
+#endif
+
+/* ENSURE_BITS_FAST and READ_BITS_FAST use READ_BYTES_FAST without checking
+ * how many bytes are left in the byte buffer. They are for decoding loops
+ * that check, before decoding each symbol, that there is enough input
+ * left for everything the symbol could need. BITS_FAST_INPUT(n) is the
+ * number of bytes that must be left in the byte buffer to read n bits
+ * this way: it allows for the bit buffer being filled to the brim.
+ * Decoding loops should use the regular macros once less input than
+ * this is left, so the end of input is handled carefully.
+ */
+#ifdef READ_BYTES_FAST
+# define ENSURE_BITS_FAST(nbits) do {                   \
+    while (bits_left < (nbits)) READ_BYTES_FAST;        \
+} while (0)
+#else
+# define ENSURE_BITS_FAST(nbits) ENSURE_BITS(nbits)
+#endif
+#define BITS_FAST_INPUT(nbits) ((int) (((nbits) + BITBUF_WIDTH + 7) / 8))
+
+#define READ_BITS_FAST(val, nbits) do {         \
+    ENSURE_BITS_FAST(nbits);                    \
+    (val) = PEEK_BITS(nbits);                   \
+    REMOVE_BITS(nbits);                         \
+} while (0)
 
 #define READ_BITS(val, nbits) do {              \
     ENSURE_BITS(nbits);                         \
@@ -177,6 +248,11 @@ static const unsigned short lsb_bit_mask[17] = {
     (val) = PEEK_BITS_T(nbits);         \
     REMOVE_BITS(nbits);                 \
 } while (0)
+# define READ_BITS_T_FAST(val, nbits) do {      \
+    ENSURE_BITS_FAST(nbits);                    \
+    (val) = PEEK_BITS_T(nbits);                 \
+    REMOVE_BITS(nbits);                         \
+} while (0)
 #endif
 
 #ifndef BITS_NO_READ_INPUT
@@ -21,9 +21,6 @@
 #if !(defined(HUFF_TABLE) && defined(HUFF_LEN))
 # error "define HUFF_TABLE(tbl) and HUFF_LEN(tbl) before using readhuff.h"
 #endif
-#ifndef HUFF_ERROR
-# error "define HUFF_ERROR before using readhuff.h"
-#endif
 #ifndef HUFF_MAXBITS
 # define HUFF_MAXBITS 16
 #endif
@@ -35,9 +32,20 @@
 
 /* Decodes the next huffman symbol from the input bitstream into var.
  * Do not use this macro on a table unless build_decode_table() succeeded.
+ * READ_HUFFSYM_FAST is the same, but uses ENSURE_BITS_FAST.
  */
 #define READ_HUFFSYM(tbl, var) do {                                 \
     ENSURE_BITS(HUFF_MAXBITS);                                      \
+    DECODE_HUFFSYM(tbl, var);                                       \
+} while (0)
+
+#define READ_HUFFSYM_FAST(tbl, var) do {                            \
+    ENSURE_BITS_FAST(HUFF_MAXBITS);                                 \
+    DECODE_HUFFSYM(tbl, var);                                       \
+} while (0)
+
+/* Decodes a huffman symbol already in the bit buffer */
+#define DECODE_HUFFSYM(tbl, var) do {                               \
     huff_sym = HUFF_TABLE(tbl, PEEK_BITS(TABLEBITS(tbl)));          \
     if (huff_sym >= MAXSYMBOLS(tbl)) HUFF_TRAVERSE(tbl);            \
     (var) = huff_sym;                                               \
@@ -45,26 +53,60 @@
     REMOVE_BITS(huff_idx);                                          \
 } while (0)
 
+/* HUFF_TRAVERSE looks up a code longer than TABLEBITS(tbl) bits in its
+ * second-level table. The first entry of each second-level table holds
+ * how many more bits it decodes; see make_decode_table() */
 #ifdef BITS_ORDER_LSB
 # define HUFF_TRAVERSE(tbl) do {                                    \
-    huff_idx = TABLEBITS(tbl) - 1;                                  \
-    do {                                                            \
-        if (huff_idx++ > HUFF_MAXBITS) HUFF_ERROR;                  \
-        huff_sym = HUFF_TABLE(tbl,                                  \
-            (huff_sym << 1) | ((bit_buffer >> huff_idx) & 1));      \
-    } while (huff_sym >= MAXSYMBOLS(tbl));                          \
+    huff_idx = huff_sym - MAXSYMBOLS(tbl) + (1 << TABLEBITS(tbl));  \
+    huff_sym = HUFF_TABLE(tbl, huff_idx + 1 + (int)                 \
+        ((bit_buffer >> TABLEBITS(tbl)) &                           \
+         ((1 << HUFF_TABLE(tbl, huff_idx)) - 1)));                  \
 } while (0)
 #else
-#define HUFF_TRAVERSE(tbl) do {                                     \
-    huff_idx = 1 << (BITBUF_WIDTH - TABLEBITS(tbl));                \
-    do {                                                            \
-        if ((huff_idx >>= 1) == 0) HUFF_ERROR;                      \
-        huff_sym = HUFF_TABLE(tbl,                                  \
-            (huff_sym << 1) | ((bit_buffer & huff_idx) ? 1 : 0));   \
-    } while (huff_sym >= MAXSYMBOLS(tbl));                          \
+# define HUFF_TRAVERSE(tbl) do {                                    \
+    huff_idx = huff_sym - MAXSYMBOLS(tbl) + (1 << TABLEBITS(tbl));  \
+    huff_sym = HUFF_TABLE(tbl, huff_idx + 1 + (int)                 \
+        ((bit_buffer << TABLEBITS(tbl)) >>                          \
+         (BITBUF_WIDTH - HUFF_TABLE(tbl, huff_idx))));              \
 } while (0)
 #endif
 
+/* Multi-symbol lookups (optional):
+ *
+ * If HUFF_MULTI(tbl,idx) and MULTIBITS(tbl) are defined, make_multi_table()
+ * can build a second table for a tree, with an unsigned int for every
+ * possible MULTIBITS(tbl) bits of input. MULTIBITS(tbl) should be at least
+ * TABLEBITS(tbl) and at most HUFF_MAXBITS. Each entry holds up to three
+ * "literal" symbols (symbols below a given limit, which must be 256 or
+ * less) whose codes all fit in MULTIBITS(tbl) bits, along with how many
+ * symbols there are and how many bits their codes use in total.
+ *
+ * PEEK_HUFFMULTI(tbl, var) looks up the next entry from the bit buffer,
+ * without removing any bits. If HUFF_MULTI_COUNT(var) is non-zero,
+ * REMOVE_BITS(HUFF_MULTI_BITS(var)) consumes the literals
+ * HUFF_MULTI_SYM(var, 0) to HUFF_MULTI_SYM(var, count-1). If it is zero,
+ * the next symbol isn't a literal; if its code is short enough to be in
+ * the regular table, it is HUFF_MULTI_ONE(var) and its code is
+ * HUFF_MULTI_BITS(var) bits long, otherwise HUFF_MULTI_BITS(var) is zero
+ * and DECODE_HUFFSYM must be used instead.
+ *
+ * The regular table is still needed, and READ_HUFFSYM decodes exactly
+ * the same symbols as before; decoders can be built without HUFF_MULTI
+ * to check the results of the multi-symbol tables against it.
+ */
+#ifdef HUFF_MULTI
+# ifndef MULTIBITS
+#  error "define MULTIBITS(tbl) before using HUFF_MULTI"
+# endif
+# define PEEK_HUFFMULTI(tbl, var) \
+    ((var) = HUFF_MULTI(tbl, PEEK_BITS(MULTIBITS(tbl))))
+# define HUFF_MULTI_COUNT(x)  ((x) >> 29)
+# define HUFF_MULTI_BITS(x)   (((x) >> 24) & 0x1F)
+# define HUFF_MULTI_SYM(x, n) (((x) >> ((n) << 3)) & 0xFF)
+# define HUFF_MULTI_ONE(x)    ((x) & 0xFFFF)
+#endif
+
 /* make_decode_table(nsyms, nbits, length[], table[])
  *
  * This function was originally coded by David Tritscher.
@@ -76,7 +118,15 @@
  *          in one lookup of the table.
  * length = A table to get code lengths from [0 to nsyms-1]
  * table  = The table to fill up with decoded symbols and pointers.
- *          Should be ((1<<nbits) + (nsyms*2)) in length.
+ *          Should be HUFF_TABLESIZE(nsyms, nbits, maxbits) in length,
+ *          where maxbits is the longest code length possible.
+ *
+ * The first (1<<nbits) entries of the table are looked up directly. Codes
+ * longer than nbits are decoded with a second lookup: their entry in the
+ * first part of the table is nsyms plus the offset of a second-level table
+ * after it. The first entry of a second-level table is how many more bits
+ * it decodes (enough for all codes that start with the same nbits), and
+ * the rest are symbols, in the same way as the first part of the table.
  *
  * Returns 0 for OK or 1 for error
  */
@@ -92,6 +142,11 @@ static int make_decode_table(unsigned int nsyms, unsigned int nbits,
     unsigned int pos         = 0; /* the current position in the decode table */
     unsigned int table_mask  = 1 << nbits;
     unsigned int bit_mask    = table_mask >> 1; /* don't do 0 length codes */
+    unsigned int prefix, sub, sub_bits, count[HUFF_MAXBITS + 1];
+#ifdef BITS_ORDER_LSB
+    unsigned int step;
+#endif
+    int left;
 
     /* fill entries for codes short enough for a direct mapping */
     for (bit_num = 1; bit_num <= nbits; bit_num++) {
@@ -121,19 +176,20 @@ static int make_decode_table(unsigned int nsyms, unsigned int nbits,
     /* exit with success if table is now complete */
     if (pos == table_mask) return 0;
 
-    /* mark all remaining table entries as unused */
-    for (sym = pos; sym < table_mask; sym++) {
-#ifdef BITS_ORDER_MSB
-        table[sym] = 0xFFFF;
-#else
-        reverse = sym; leaf = 0; fill = nbits;
-        do { leaf <<= 1; leaf |= reverse & 1; reverse >>= 1; } while (--fill);
-        table[leaf] = 0xFFFF;
-#endif
+    /* count how many codes there are of each length longer than nbits */
+    for (bit_num = nbits+1; bit_num <= HUFF_MAXBITS; bit_num++) {
+        count[bit_num] = 0;
+    }
+    for (sym = 0; sym < nsyms; sym++) {
+        if (length[sym] > nbits && length[sym] <= HUFF_MAXBITS) {
+            count[length[sym]]++;
+        }
     }
 
-    /* next_symbol = base of allocation for long codes */
-    next_symbol = ((table_mask >> 1) < nsyms) ? nsyms : (table_mask >> 1);
+    /* second-level tables are allocated after the first-level entries */
+    next_symbol = 0;
+    prefix = table_mask; /* no second-level table yet */
+    sub = sub_bits = 0;
 
     /* give ourselves room for codes to grow by up to 16 more bits.
      * codes now start at bit nbits+16 and end at (nbits+16-codelength) */
@@ -146,26 +202,48 @@ static int make_decode_table(unsigned int nsyms, unsigned int nbits,
             if (length[sym] != bit_num) continue;
             if (pos >= table_mask) return 1; /* table overflow */
 
+            /* does this code start with different nbits to the last one?
+             * if so, start a new second-level table for it, which is deep
+             * enough to hold all the remaining codes up to the length that
+             * fills it (the same method as zlib's inflate_table()) */
+            if ((pos >> 16) != prefix) {
+                prefix = pos >> 16;
+                sub_bits = bit_num - nbits;
+                left = 1 << sub_bits;
+                while ((sub_bits + nbits) < HUFF_MAXBITS) {
+                    left -= count[sub_bits + nbits];
+                    if (left <= 0) break;
+                    sub_bits++;
+                    left <<= 1;
+                }
+
 #ifdef BITS_ORDER_MSB
-            leaf = pos >> 16;
+                leaf = prefix;
 #else
-            /* leaf = the first nbits of the code, reversed */
-            reverse = pos >> 16; leaf = 0; fill = nbits;
-            do {leaf <<= 1; leaf |= reverse & 1; reverse >>= 1;} while (--fill);
+                reverse = prefix; leaf = 0; fill = nbits;
+                do {leaf <<= 1; leaf |= reverse & 1; reverse >>= 1;} while (--fill);
 #endif
-            for (fill = 0; fill < (bit_num - nbits); fill++) {
-                /* if this path hasn't been taken yet, 'allocate' two entries */
-                if (table[leaf] == 0xFFFF) {
-                    table[(next_symbol << 1)     ] = 0xFFFF;
-                    table[(next_symbol << 1) + 1 ] = 0xFFFF;
-                    table[leaf] = next_symbol++;
-                }
+                table[leaf] = nsyms + next_symbol;
+                sub = (1 << nbits) + next_symbol;
+                table[sub++] = sub_bits;
+                next_symbol += (1 << sub_bits) + 1;
+            }
+            count[bit_num]--;
 
-                /* follow the path and select either left or right for next bit */
-                leaf = table[leaf] << 1;
-                if ((pos >> (15-fill)) & 1) leaf++;
+            /* fill all lookups of this symbol in the second-level table */
+            leaf = (pos >> (16 - sub_bits)) & ((1 << sub_bits) - 1);
+            fill = 1 << (sub_bits - (bit_num - nbits));
+#ifdef BITS_ORDER_MSB
+            do { table[sub + leaf++] = sym; } while (--fill);
+#else
+            /* reverse the significant bits */
+            reverse = leaf; leaf = 0;
+            for (step = sub_bits; step > 0; step--) {
+                leaf <<= 1; leaf |= reverse & 1; reverse >>= 1;
             }
-            table[leaf] = sym;
+            step = 1 << (bit_num - nbits);
+            do { table[sub + leaf] = sym; leaf += step; } while (--fill);
+#endif
             pos += bit_mask;
         }
         bit_mask >>= 1;
@@ -174,4 +252,54 @@ static int make_decode_table(unsigned int nsyms, unsigned int nbits,
     /* full table? */
     return (pos == table_mask) ? 0 : 1;
 }
+
+#ifdef HUFF_MULTI
+/* make_multi_table(nsyms, nbits, mbits, nlits, length[], table[], multi[])
+ *
+ * Builds a multi-symbol table (see PEEK_HUFFMULTI) from a table that
+ * make_decode_table() has already built successfully.
+ *
+ * nsyms  = the nsyms given to make_decode_table()
+ * nbits  = the nbits given to make_decode_table()
+ * mbits  = the number of bits of input to look up at once. Must be at
+ *          least nbits.
+ * nlits  = symbols 0 to nlits-1 are literals. Must be 256 or less.
+ * length = the code lengths given to make_decode_table()
+ * table  = the table built by make_decode_table()
+ * multi  = the table to fill in. Should be (1<<mbits) in length.
+ */
+static void make_multi_table(unsigned int nsyms, unsigned int nbits,
+                             unsigned int mbits, unsigned int nlits,
+                             unsigned char *length, unsigned short *table,
+                             unsigned int *multi)
+{
+    register unsigned int pos, entry, bits, count;
+    register unsigned short sym;
+    unsigned int multi_mask = (1 << mbits) - 1;
+
+    for (pos = 0; pos <= multi_mask; pos++) {
+        entry = bits = 0;
+        for (count = 0; count < 3; count++) {
+            /* look up the code starting after the bits used so far. Any
+             * bits shifted in are unknown, so only accept codes which
+             * don't reach them. Table entries that aren't symbols are
+             * always >= nlits */
+#ifdef BITS_ORDER_MSB
+            sym = table[((pos << bits) & multi_mask) >> (mbits - nbits)];
+#else
+            sym = table[(pos >> bits) & ((1 << nbits) - 1)];
+#endif
+            if (sym >= nlits || (bits + length[sym]) > mbits) break;
+            entry |= (unsigned int) sym << (count << 3);
+            bits += length[sym];
+        }
+        /* if the first symbol isn't a literal, store it alone */
+        if (count == 0 && sym < nsyms) {
+            entry = sym;
+            bits = length[sym];
+        }
+        multi[pos] = entry | (bits << 24) | (count << 29);
+    }
+}
+#endif
 #endif
@@ -0,0 +1,187 @@
+/* This file is part of libmspack.
+ * (C) 2003-2026 Stuart Caie.
+ *
+ * libmspack is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License (LGPL) version 2.1
+ *
+ * For further details, see the file COPYING.LIB distributed with libmspack
+ */
+
+/* the parts of pull-mode decoding shared by all decoders, see step.h */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <system.h>
+#include <step.h>
+
+static int step_read(struct mspack_file *file, void *buffer, int bytes) {
+  struct mspack_stepper *st = (struct mspack_stepper *) file;
+  struct mspack_step *step = st->step;
+  unsigned char *buf = (unsigned char *) buffer;
+  unsigned int n, total = 0;
+
+  /* queued input comes first */
+  n = st->q_len - st->q_pos;
+  if (n > (unsigned int) bytes) n = (unsigned int) bytes;
+  if (n) {
+    st->orig->copy(&st->queue[st->q_pos], buf, n);
+    st->q_pos += n; total += n;
+  }
+
+  n = step->avail_in - st->c_pos;
+  if (n > (unsigned int) bytes - total) n = (unsigned int) bytes - total;
+  if (n) {
+    st->orig->copy((void *) &step->next_in[st->c_pos], &buf[total], n);
+    st->c_pos += n; total += n;
+  }
+
+  /* with no input left, fail unless there will be no more input */
+  if (total == 0 && !step->end_of_input) {
+    st->starved = 1;
+    return -1;
+  }
+  return (int) total;
+}
+
+static int step_write(struct mspack_file *file, void *buffer, int bytes) {
+  struct mspack_stepper *st = (struct mspack_stepper *) file;
+  struct mspack_step *step = st->step;
+
+  /* output from a starved decoder is thrown away */
+  if (st->starved) return bytes;
+  if ((unsigned int) bytes > step->avail_out) return -1;
+  st->orig->copy(buffer, step->next_out, (size_t) bytes);
+  step->next_out  += bytes;
+  step->avail_out -= (unsigned int) bytes;
+  return bytes;
+}
+
+static int step_seek(struct mspack_file *file, off_t offset, int mode) {
+  return -1;
+}
+
+static off_t step_tell(struct mspack_file *file) {
+  return -1;
+}
+
+static void step_message(struct mspack_file *file, const char *format, ...) {
+  /* the decoders only warn about bad input, which would be repeated
+   * each time a frame is decoded again, so warnings are dropped */
+}
+
+struct mspack_stepper *stepper_init(struct mspack_system *orig,
+                                    unsigned int inbuf_size)
+{
+  struct mspack_stepper *st;
+
+  st = (struct mspack_stepper *) orig->alloc(orig, sizeof(struct mspack_stepper));
+  if (!st) return NULL;
+  /* the unread input may include bytes put back before the input buffer */
+  st->mark_in = (unsigned char *) orig->alloc(orig, inbuf_size + 16);
+  if (!st->mark_in) {
+    orig->free(st);
+    return NULL;
+  }
+
+  st->sys         = *orig;
+  st->sys.read    = &step_read;
+  st->sys.write   = &step_write;
+  st->sys.seek    = &step_seek;
+  st->sys.tell    = &step_tell;
+  st->sys.message = &step_message;
+  st->orig        = orig;
+  st->step        = NULL;
+  st->queue       = NULL;
+  st->q_len = st->q_size = st->q_pos = st->c_pos = 0;
+  st->mark_q = st->mark_c = st->mark_in_len = 0;
+  st->mark_out    = NULL;
+  st->starved     = 0;
+  return st;
+}
+
+void stepper_free(struct mspack_stepper *st) {
+  if (st) {
+    struct mspack_system *sys = st->orig;
+    sys->free(st->queue);
+    sys->free(st->mark_in);
+    sys->free(st);
+  }
+}
+
+void stepper_begin(struct mspack_stepper *st,
+                   struct mspack_step *step)
+{
+  st->step    = step;
+  st->c_pos   = 0;
+  st->starved = 0;
+}
+
+void stepper_end(struct mspack_stepper *st) {
+  struct mspack_step *step = st->step;
+  step->next_in  += st->c_pos;
+  step->avail_in -= st->c_pos;
+  st->step = NULL;
+}
+
+int stepper_input_done(struct mspack_stepper *st) {
+  return st->step->end_of_input && st->q_pos == st->q_len &&
+    st->c_pos == st->step->avail_in;
+}
+
+void stepper_mark(struct mspack_stepper *st,
+                  unsigned char *i_ptr, unsigned char *i_end)
+{
+  /* the queue isn't needed once it has all been read */
+  if (st->q_pos == st->q_len) st->q_pos = st->q_len = 0;
+
+  st->mark_q      = st->q_pos;
+  st->mark_c      = st->c_pos;
+  st->mark_out    = st->step->next_out;
+  st->mark_in_len = (unsigned int) (i_end - i_ptr);
+  st->orig->copy(i_ptr, st->mark_in, st->mark_in_len);
+}
+
+int stepper_rollback(struct mspack_stepper *st,
+                     unsigned char *inbuf,
+                     unsigned int inbuf_size,
+                     unsigned char **i_ptr,
+                     unsigned char **i_end)
+{
+  struct mspack_step *step = st->step;
+  unsigned int q_keep = st->q_len - st->mark_q;
+  unsigned int c_keep = step->avail_in - st->mark_c;
+
+  /* keep all input from the mark onwards in the queue */
+  if (q_keep + c_keep > st->q_size) {
+    unsigned int size = (q_keep + c_keep) * 2;
+    unsigned char *q = (unsigned char *) st->orig->alloc(st->orig, size);
+    if (!q) return MSPACK_ERR_NOMEMORY;
+    if (q_keep) st->orig->copy(&st->queue[st->mark_q], q, q_keep);
+    st->orig->free(st->queue);
+    st->queue  = q;
+    st->q_size = size;
+  }
+  else {
+    unsigned int i;
+    for (i = 0; i < q_keep; i++) st->queue[i] = st->queue[st->mark_q + i];
+  }
+  if (c_keep) {
+    st->orig->copy((void *) &step->next_in[st->mark_c], &st->queue[q_keep],
+                   c_keep);
+  }
+  st->q_len = q_keep + c_keep;
+  st->q_pos = 0;
+  st->c_pos = step->avail_in;
+
+  /* forget output since the mark, and restore the unread input */
+  step->avail_out += (unsigned int) (step->next_out - st->mark_out);
+  step->next_out   = st->mark_out;
+  *i_ptr = (st->mark_in_len <= inbuf_size) ? &inbuf[0]
+         : &inbuf[inbuf_size] - st->mark_in_len;
+  *i_end = &(*i_ptr)[st->mark_in_len];
+  st->orig->copy(st->mark_in, *i_ptr, st->mark_in_len);
+  st->starved = 0;
+  return MSPACK_ERR_OK;
+}
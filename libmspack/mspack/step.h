@@ -0,0 +1,105 @@
+/* This file is part of libmspack.
+ * (C) 2003-2026 Stuart Caie.
+ *
+ * libmspack is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License (LGPL) version 2.1
+ *
+ * For further details, see the file COPYING.LIB distributed with libmspack
+ */
+
+#ifndef MSPACK_STEP_H
+#define MSPACK_STEP_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Pull-mode decoding. Rather than reading and writing through an
+ * mspack_system, lzxd_step(), mszipd_step() and qtmd_step() take input
+ * from, and put output into, buffers given on each call, much like zlib's
+ * inflate(). They can be driven from an event loop: when the input runs
+ * out, they return MSPACK_STEP_NEED_INPUT and carry on when called again
+ * with more.
+ *
+ * Each step function decodes a frame (or MSZIP block) at a time. If the
+ * input runs out part way through one, the decoder goes back to where the
+ * frame started and keeps the input it used, to decode the frame again
+ * once there is more input. Nothing from a partly decoded frame is output.
+ */
+
+/* the buffers for a step function. It updates all but end_of_input */
+struct mspack_step {
+  const unsigned char *next_in;   /* next input byte                         */
+  unsigned int  avail_in;         /* number of bytes available at next_in    */
+  unsigned char *next_out;        /* next output byte goes here              */
+  unsigned int  avail_out;        /* number of bytes free at next_out        */
+  int end_of_input;               /* non-zero once all input has been given  */
+};
+
+/* step functions return MSPACK_ERR_OK when avail_out has reached 0, one of
+ * these, or an error code */
+#define MSPACK_STEP_NEED_INPUT (-1) /* all the input was used; give more     */
+#define MSPACK_STEP_END        (-2) /* the whole stream has been output      */
+
+/* The rest is shared by the step functions. A stepper stands in for the
+ * decoder's mspack_system and its input and output files while a step
+ * function runs: it reads from its queue then next_in, and writes to
+ * next_out. A mark saves the read and write positions and the decoder's
+ * unread input. If the decoder asks for input when there is none, the
+ * stepper is "starved": the read fails, and the decoder's error is undone
+ * by going back to the mark. Anything written in the meantime is thrown
+ * away, and so are messages, as they are about the failed read.
+ */
+struct mspack_stepper {
+  struct mspack_system sys;       /* system the decoder uses in a step       */
+  struct mspack_system *orig;     /* the decoder's own system                */
+  struct mspack_step *step;       /* buffers for the current step            */
+
+  unsigned char *queue;           /* input kept from earlier steps           */
+  unsigned int  q_len, q_size;    /* bytes in, and size of, the queue        */
+  unsigned int  q_pos, c_pos;     /* bytes read from queue and from next_in  */
+
+  unsigned int  mark_q, mark_c;   /* q_pos and c_pos at the mark             */
+  unsigned char *mark_out;        /* next_out at the mark                    */
+  unsigned char *mark_in;         /* the decoder's unread input at the mark  */
+  unsigned int  mark_in_len;      /* length of mark_in                       */
+
+  int starved;                    /* did the decoder run out of input?       */
+};
+
+/* allocates a stepper for a decoder using the given system, with an input
+ * buffer of inbuf_size bytes (plus any bytes before it). Returns NULL if
+ * there isn't enough memory */
+extern struct mspack_stepper *stepper_init(struct mspack_system *orig,
+                                           unsigned int inbuf_size);
+
+/* frees a stepper */
+extern void stepper_free(struct mspack_stepper *st);
+
+/* starts and ends a step. At the end, the input used is removed from the
+ * step's buffers, and all of it is if the decoder was starved */
+extern void stepper_begin(struct mspack_stepper *st,
+                          struct mspack_step *step);
+extern void stepper_end(struct mspack_stepper *st);
+
+/* returns non-zero if no more input can be read */
+extern int stepper_input_done(struct mspack_stepper *st);
+
+/* saves a mark, with the decoder's unread input from i_ptr to i_end */
+extern void stepper_mark(struct mspack_stepper *st,
+                         unsigned char *i_ptr, unsigned char *i_end);
+
+/* goes back to the mark, putting its unread input back in the decoder's
+ * input buffer, which is inbuf_size bytes. The stepper keeps
+ * all input since the mark. Returns an error code, or MSPACK_ERR_OK */
+extern int stepper_rollback(struct mspack_stepper *st,
+                            unsigned char *inbuf,
+                            unsigned int inbuf_size,
+                            unsigned char **i_ptr,
+                            unsigned char **i_end);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -20,20 +20,34 @@ int mspack_version(int entity) {
     * - added mschmd_header::first_pmgl
     * - added mschmd_header::last_pmgl
     * - added mschmd_header::chunk_cache;
+    * CHM decoder version 2 -> 3 changes:
+    * - added mschm_decompressor::extract_to_buffer
     */
   case MSPACK_VER_MSCHMD:
+    return 3;
   /* CAB decoder version 1 -> 2 changes:
    * - added MSCABD_PARAM_SALVAGE
+   * CAB decoder version 2 -> 3 changes:
+   * - added mscab_decompressor::extract_to_buffer
+   * CAB decoder version 3 -> 4 changes:
+   * - added MSCABD_PARAM_THREADS
+   * CAB decoder version 4 -> 5 changes:
+   * - added MSCABD_PARAM_MAXREPAIRS and mscab_decompressor::last_repairs
    */
   case MSPACK_VER_MSCABD:
+    return 5;
   /* OAB decoder version  1 -> 2 changes:
    * - added msoab_decompressor::set_param and MSOABD_PARAM_DECOMPBUF
    */
   case MSPACK_VER_MSOABD:
     return 2;
+  /* SZDD decoder version 1 -> 2 changes:
+   * - added msszdd_decompressor::decompress_batch
+   */
+  case MSPACK_VER_MSSZDDD:
+    return 2;
   case MSPACK_VER_LIBRARY:
   case MSPACK_VER_SYSTEM:
-  case MSPACK_VER_MSSZDDD:
   case MSPACK_VER_MSKWAJD:
     return 1;
   case MSPACK_VER_MSCABC:
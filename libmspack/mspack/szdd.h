@@ -36,4 +36,9 @@ struct msszddd_header_p {
   struct mspack_file *fh;
 };
 
+/* decompress_batch() runs one job per thread, up to this many. Each job
+ * has its own LZSS buffer, and takes the next file from the list until
+ * none are left */
+#define SZDDD_BATCH_MAXTHREADS (64)
+
 #endif
@@ -16,6 +16,10 @@
 #include <system.h>
 #include <szdd.h>
 
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
 /* prototypes */
 static struct msszddd_header *szddd_open(
     struct msszdd_decompressor *base, const char *filename);
@@ -27,8 +31,14 @@ static int szddd_read_headers(
 static int szddd_extract(
     struct msszdd_decompressor *base, struct msszddd_header *hdr,
     const char *filename);
+static int szddd_extract_fh(
+    struct mspack_system *sys, struct mspack_file *fh,
+    struct msszddd_header *hdr, const char *filename, unsigned char *buf);
 static int szddd_decompress(
     struct msszdd_decompressor *base, const char *input, const char *output);
+static int szddd_decompress_batch(
+    struct msszdd_decompressor *base, struct msszddd_batch *files,
+    int num_files, int threads);
 static int szddd_error(
     struct msszdd_decompressor *base);
 
@@ -51,6 +61,7 @@ struct msszdd_decompressor *
     self->base.extract    = &szddd_extract;
     self->base.decompress = &szddd_decompress;
     self->base.last_error = &szddd_error;
+    self->base.decompress_batch = &szddd_decompress_batch;
     self->system          = sys;
     self->error           = MSPACK_ERR_OK;
   }
@@ -182,37 +193,52 @@ static int szddd_extract(struct msszdd_decompressor *base,
                          struct msszddd_header *hdr, const char *filename)
 {
     struct msszdd_decompressor_p *self = (struct msszdd_decompressor_p *) base;
-    struct mspack_file *fh, *outfh;
-    struct mspack_system *sys;
-    off_t data_offset;
 
     if (!self) return MSPACK_ERR_ARGS;
     if (!hdr)  return self->error = MSPACK_ERR_ARGS;
-    sys = self->system;
 
-    fh = ((struct msszddd_header_p *) hdr)->fh;
+    return self->error = szddd_extract_fh(self->system,
+        ((struct msszddd_header_p *) hdr)->fh, hdr, filename, NULL);
+}
+
+/* decompresses an SZDD file, whose headers have been read from fh, to
+ * the named output file. If buf is not NULL, it's used as the LZSS
+ * buffer, and must be LZSS_BUFFER_SIZE(SZDD_INPUT_SIZE) bytes */
+static int szddd_extract_fh(struct mspack_system *sys,
+                            struct mspack_file *fh,
+                            struct msszddd_header *hdr,
+                            const char *filename,
+                            unsigned char *buf)
+{
+    struct mspack_file *outfh;
+    off_t data_offset;
+    int mode, error;
 
     /* seek to the compressed data */
     data_offset = (hdr->format == MSSZDD_FMT_NORMAL) ? 14 : 12;
     if (sys->seek(fh, data_offset, MSPACK_SYS_SEEK_START)) {
-        return self->error = MSPACK_ERR_SEEK;
+        return MSPACK_ERR_SEEK;
     }
 
     /* open file for output */
     if (!(outfh = sys->open(sys, filename, MSPACK_SYS_OPEN_WRITE))) {
-        return self->error = MSPACK_ERR_OPEN;
+        return MSPACK_ERR_OPEN;
     }
 
     /* decompress the data */
-    self->error = lzss_decompress(sys, fh, outfh, SZDD_INPUT_SIZE,
-                                  hdr->format == MSSZDD_FMT_NORMAL
-                                  ? LZSS_MODE_EXPAND
-                                  : LZSS_MODE_QBASIC);
+    mode = (hdr->format == MSSZDD_FMT_NORMAL)
+         ? LZSS_MODE_EXPAND : LZSS_MODE_QBASIC;
+    if (buf) {
+        error = lzss_decompress_buf(sys, fh, outfh, buf, SZDD_INPUT_SIZE, mode);
+    }
+    else {
+        error = lzss_decompress(sys, fh, outfh, SZDD_INPUT_SIZE, mode);
+    }
 
     /* close output file */
     sys->close(outfh);
 
-    return self->error;
+    return error;
 }
 
 /***************************************
@@ -235,6 +261,129 @@ static int szddd_decompress(struct msszdd_decompressor *base,
     return self->error = error;
 }
 
+/***************************************
+ * SZDDD_DECOMPRESS_BATCH
+ ***************************************
+ * unpacks a list of files, reusing the same header and LZSS buffer for
+ * each file, on one or more threads
+ */
+struct szddd_batch_state {
+    struct mspack_system *sys;
+    struct msszddd_batch *files;
+    int num_files, next;                /* files in list, next one to do */
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t lock;               /* held while taking next file   */
+#endif
+};
+
+struct szddd_batch_job {
+    struct szddd_batch_state *batch;
+    unsigned char *buf;                 /* LZSS buffer for this job      */
+#ifdef HAVE_PTHREAD
+    pthread_t thread;
+#endif
+};
+
+static void *szddd_batch_job(void *arg) {
+    struct szddd_batch_job *job = (struct szddd_batch_job *) arg;
+    struct szddd_batch_state *batch = job->batch;
+    struct mspack_system *sys = batch->sys;
+    struct msszddd_header_p hdr;
+    struct msszddd_batch *file;
+    int i;
+
+    for (;;) {
+#ifdef HAVE_PTHREAD
+        pthread_mutex_lock(&batch->lock);
+#endif
+        i = batch->next++;
+#ifdef HAVE_PTHREAD
+        pthread_mutex_unlock(&batch->lock);
+#endif
+        if (i >= batch->num_files) break;
+
+        file = &batch->files[i];
+        file->missing_char = '\0';
+        if (!(hdr.fh = sys->open(sys, file->input, MSPACK_SYS_OPEN_READ))) {
+            file->error = MSPACK_ERR_OPEN;
+            continue;
+        }
+        file->error = szddd_read_headers(sys, hdr.fh, &hdr.base);
+        if (!file->error) {
+            file->missing_char = hdr.base.missing_char;
+            file->error = szddd_extract_fh(sys, hdr.fh, &hdr.base,
+                                           file->output, job->buf);
+        }
+        sys->close(hdr.fh);
+    }
+    return NULL;
+}
+
+static int szddd_decompress_batch(struct msszdd_decompressor *base,
+                                  struct msszddd_batch *files,
+                                  int num_files, int threads)
+{
+    struct msszdd_decompressor_p *self = (struct msszdd_decompressor_p *) base;
+    struct szddd_batch_job jobs[SZDDD_BATCH_MAXTHREADS];
+    struct szddd_batch_state batch;
+    struct mspack_system *sys;
+    int i, num_jobs;
+#ifdef HAVE_PTHREAD
+    int started = 1;
+#endif
+
+    if (!self) return MSPACK_ERR_ARGS;
+    if (num_files < 0 || (num_files > 0 && !files) || threads < 1) {
+        return self->error = MSPACK_ERR_ARGS;
+    }
+    sys = self->system;
+
+#ifdef HAVE_PTHREAD
+    if (threads > SZDDD_BATCH_MAXTHREADS) threads = SZDDD_BATCH_MAXTHREADS;
+    if (threads > num_files) threads = num_files;
+#else
+    threads = 1;
+#endif
+
+    /* give each job a buffer; if memory runs out, use fewer jobs */
+    for (num_jobs = 0; num_jobs < threads; num_jobs++) {
+        jobs[num_jobs].batch = &batch;
+        jobs[num_jobs].buf = (unsigned char *) sys->alloc(sys,
+            LZSS_BUFFER_SIZE(SZDD_INPUT_SIZE));
+        if (!jobs[num_jobs].buf) break;
+    }
+    if (num_jobs == 0 && num_files > 0) {
+        for (i = 0; i < num_files; i++) files[i].error = MSPACK_ERR_NOMEMORY;
+        return self->error = MSPACK_ERR_NOMEMORY;
+    }
+
+    batch.sys       = sys;
+    batch.files     = files;
+    batch.num_files = num_files;
+    batch.next      = 0;
+
+    /* this thread does the first job. Jobs that can't get a thread aren't
+     * needed, as the other jobs will take their files */
+#ifdef HAVE_PTHREAD
+    pthread_mutex_init(&batch.lock, NULL);
+    while (started < num_jobs && !pthread_create(&jobs[started].thread,
+           NULL, &szddd_batch_job, &jobs[started])) started++;
+#endif
+    if (num_jobs > 0) szddd_batch_job(&jobs[0]);
+#ifdef HAVE_PTHREAD
+    for (i = 1; i < started; i++) pthread_join(jobs[i].thread, NULL);
+    pthread_mutex_destroy(&batch.lock);
+#endif
+    for (i = 0; i < num_jobs; i++) sys->free(jobs[i].buf);
+
+    /* report the first file in the list that failed */
+    self->error = MSPACK_ERR_OK;
+    for (i = 0; i < num_files && !self->error; i++) {
+        self->error = files[i].error;
+    }
+    return self->error;
+}
+
 /***************************************
  * SZDDD_ERROR
  ***************************************
@@ -0,0 +1,208 @@
+/* cabd_bench: measures how quickly the files in one or more cabinets
+ * can be extracted. The extracted data is discarded, so only the time
+ * taken to read and decompress it is measured.
+ *
+ * usage: cabd_bench [-n repeats] [-t threads] <cabinet files>
+ *
+ * -t sets MSCABD_PARAM_THREADS. With thread support, times are wall-clock
+ * rather than CPU time, which would add up the time of every thread.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <mspack.h>
+#ifdef HAVE_PTHREAD
+#include <sys/time.h>
+#endif
+
+#include <error.h>
+
+struct mspack_file_p {
+    FILE *fh;
+    const char *filename;
+};
+
+static off_t bytes_written;
+
+static struct mspack_file *b_open(struct mspack_system *self, const char *filename, int mode) {
+    struct mspack_file_p *fh;
+    if (mode != MSPACK_SYS_OPEN_WRITE &&
+        mode != MSPACK_SYS_OPEN_READ) return NULL;
+
+    if ((fh = (struct mspack_file_p *) malloc(sizeof(struct mspack_file_p)))) {
+        if (mode == MSPACK_SYS_OPEN_WRITE) {
+            fh->fh = NULL;
+            fh->filename = "<output>";
+            return (struct mspack_file *) fh;
+        }
+        if ((fh->fh = fopen(filename, "rb"))) {
+            fh->filename = filename;
+            return (struct mspack_file *) fh;
+        }
+        free(fh);
+    }
+    return NULL;
+}
+
+static void b_close(struct mspack_file *file) {
+    struct mspack_file_p *self = (struct mspack_file_p *) file;
+    if (self) {
+        if (self->fh) fclose(self->fh);
+        free(self);
+    }
+}
+
+static int b_read(struct mspack_file *file, void *buffer, int bytes) {
+    struct mspack_file_p *self = (struct mspack_file_p *) file;
+    if (self && self->fh && buffer && bytes >= 0) {
+        size_t count = fread(buffer, 1, bytes, self->fh);
+        if (!ferror(self->fh)) return (int) count;
+    }
+    return -1;
+}
+
+static int b_write(struct mspack_file *file, void *buffer, int bytes) {
+    struct mspack_file_p *self = (struct mspack_file_p *) file;
+    if (!self || self->fh || !buffer || bytes < 0) return -1;
+    bytes_written += bytes;
+    return bytes;
+}
+
+static int b_seek(struct mspack_file *file, off_t offset, int mode) {
+    struct mspack_file_p *self = (struct mspack_file_p *) file;
+    if (self && self->fh) {
+        switch (mode) {
+        case MSPACK_SYS_SEEK_START: mode = SEEK_SET; break;
+        case MSPACK_SYS_SEEK_CUR:   mode = SEEK_CUR; break;
+        case MSPACK_SYS_SEEK_END:   mode = SEEK_END; break;
+        default: return -1;
+        }
+#if HAVE_FSEEKO
+        return fseeko(self->fh, offset, mode);
+#else
+        return fseek(self->fh, offset, mode);
+#endif
+    }
+    return -1;
+}
+
+static off_t b_tell(struct mspack_file *file) {
+    struct mspack_file_p *self = (struct mspack_file_p *) file;
+#if HAVE_FSEEKO
+    return (self && self->fh) ? (off_t) ftello(self->fh) : 0;
+#else
+    return (self && self->fh) ? (off_t) ftell(self->fh) : 0;
+#endif
+}
+
+static void b_msg(struct mspack_file *file, const char *format, ...) {
+    va_list ap;
+    if (file) {
+        fprintf(stderr, "%s: ", ((struct mspack_file_p *) file)->filename);
+    }
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+    fputc((int) '\n', stderr);
+}
+static void *b_alloc(struct mspack_system *self, size_t bytes) {
+    return malloc(bytes);
+}
+static void b_free(void *buffer) {
+    free(buffer);
+}
+static void b_copy(void *src, void *dest, size_t bytes) {
+    memcpy(dest, src, bytes);
+}
+
+static struct mspack_system read_files_discard_writes = {
+    &b_open, &b_close, &b_read, &b_write, &b_seek,
+    &b_tell, &b_msg, &b_alloc, &b_free, &b_copy, NULL
+};
+
+static double now(void) {
+#ifdef HAVE_PTHREAD
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1000000.0;
+#else
+    return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void report(const char *name, off_t bytes, double secs) {
+    double mb = (double) bytes / (1024.0 * 1024.0);
+    printf("%10.2f MB %8.3f s %10.2f MB/s  %s\n",
+           mb, secs, (secs > 0) ? mb / secs : 0.0, name);
+}
+
+int main(int argc, char *argv[]) {
+    struct mscab_decompressor *cabd;
+    struct mscabd_cabinet *cab;
+    struct mscabd_file *file;
+    off_t total_bytes = 0;
+    double start, total_secs = 0;
+    int err, i, repeats = 1, threads = 1;
+
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    /* if self-test reveals an error */
+    MSPACK_SYS_SELFTEST(err);
+    if (err) return 1;
+
+    while (argv[1] && argv[2]) {
+        if (!strcmp(argv[1], "-n")) {
+            repeats = atoi(argv[2]);
+            if (repeats < 1) repeats = 1;
+        }
+        else if (!strcmp(argv[1], "-t")) {
+            threads = atoi(argv[2]);
+            if (threads < 1) threads = 1;
+        }
+        else break;
+        argv += 2;
+    }
+
+    if (!(cabd = mspack_create_cab_decompressor(&read_files_discard_writes))) {
+        fprintf(stderr, "can't make decompressor\n");
+        return 1;
+    }
+    if (cabd->set_param(cabd, MSCABD_PARAM_THREADS, threads)) {
+        fprintf(stderr, "can't set %d threads\n", threads);
+        return 1;
+    }
+
+    for (argv++; *argv; argv++) {
+        if (!(cab = cabd->open(cabd, *argv))) {
+            fprintf(stderr, "%s: cab open error: %s\n", *argv, ERROR(cabd));
+            continue;
+        }
+
+        bytes_written = 0;
+        start = now();
+        for (i = 0; i < repeats; i++) {
+            for (file = cab->files; file; file = file->next) {
+                if (cabd->extract(cabd, file, NULL) != MSPACK_ERR_OK) {
+                    fprintf(stderr, "%s: error extracting \"%s\": %s\n",
+                            *argv, file->filename, ERROR(cabd));
+                }
+            }
+        }
+        start = now() - start;
+        report(*argv, bytes_written, start);
+        total_bytes += bytes_written;
+        total_secs += start;
+        cabd->close(cabd, cab);
+    }
+    report("total", total_bytes, total_secs);
+    mspack_destroy_cab_decompressor(cabd);
+    return 0;
+}
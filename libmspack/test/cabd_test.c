@@ -519,6 +519,213 @@ void cabd_extract_test_04() {
     mspack_destroy_cab_decompressor(cabd);
 }
 
+/* test that extracting to memory gives the same result as to a file */
+void cabd_extract_test_05() {
+    struct mscab_decompressor *cabd;
+    struct mscabd_cabinet *cab;
+    struct mscabd_file *f;
+    struct mspack_system *sys = &read_files_write_md5;
+    struct mspack_file *fh;
+    char file_md5[33];
+    unsigned char *buf;
+
+    TEST(mspack_version(MSPACK_VER_MSCABD) >= 3);
+    cabd = mspack_create_cab_decompressor(sys);
+    TEST(cabd != NULL);
+    cab = cabd->open(cabd, TESTFILE("mszip_lzx_qtm.cab"));
+    TEST(cab != NULL);
+
+    for (f = cab->files; f; f = f->next) {
+        TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_OK);
+        memcpy(file_md5, md5_string, 33);
+
+        TEST(buf = (unsigned char *) malloc(f->length + 1));
+        buf[f->length] = 0xAA;
+        TEST(cabd->extract_to_buffer(cabd, f, buf, f->length + 1)
+             == MSPACK_ERR_OK);
+        TEST(buf[f->length] == 0xAA);
+        fh = sys->open(sys, NULL, MSPACK_SYS_OPEN_WRITE);
+        sys->write(fh, buf, f->length);
+        sys->close(fh);
+        TEST(memcmp(file_md5, md5_string, 33) == 0);
+
+        /* a smaller buffer only gets the start of the file */
+        buf[10] = 0xAA;
+        TEST(cabd->extract_to_buffer(cabd, f, buf, 10) == MSPACK_ERR_OK);
+        TEST(buf[10] == 0xAA);
+        free(buf);
+    }
+
+    cabd->close(cabd, cab);
+    mspack_destroy_cab_decompressor(cabd);
+}
+
+/* MS-ZIP blocks decoded in parallel give the same files as decoding them
+ * one at a time, in any order */
+void cabd_extract_test_06() {
+    struct mscab_decompressor *cabd;
+    struct mscabd_cabinet *cab;
+    struct mscabd_file *f;
+    struct mspack_system *sys = &read_files_write_md5;
+    char file_md5[3][33];
+    int i;
+
+    TEST(mspack_version(MSPACK_VER_MSCABD) >= 4);
+    cabd = mspack_create_cab_decompressor(sys);
+    TEST(cabd != NULL);
+    TEST(cabd->set_param(cabd, MSCABD_PARAM_THREADS, 0) == MSPACK_ERR_ARGS);
+    cab = cabd->open(cabd, TESTFILE("mszip_3blocks.cab"));
+    TEST(cab != NULL);
+    TEST(cab->folders->num_blocks == 3);
+
+    for (f = cab->files, i = 0; f && i < 3; f = f->next, i++) {
+        TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_OK);
+        memcpy(file_md5[i], md5_string, 33);
+    }
+    cabd->close(cabd, cab);
+
+    TEST(cabd->set_param(cabd, MSCABD_PARAM_THREADS, 4) == MSPACK_ERR_OK);
+    cab = cabd->open(cabd, TESTFILE("mszip_3blocks.cab"));
+    TEST(cab != NULL);
+    for (f = cab->files, i = 0; f && i < 3; f = f->next, i++) {
+        TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_OK);
+        TEST(memcmp(file_md5[i], md5_string, 33) == 0);
+    }
+    /* the last file, then the middle one, skipping the first */
+    f = cab->files->next->next;
+    TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_OK);
+    TEST(memcmp(file_md5[2], md5_string, 33) == 0);
+    f = cab->files->next;
+    TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_OK);
+    TEST(memcmp(file_md5[1], md5_string, 33) == 0);
+
+    cabd->close(cabd, cab);
+    mspack_destroy_cab_decompressor(cabd);
+}
+
+/* MS-ZIP repairs are counted for each file, and can be limited */
+void cabd_extract_test_07() {
+    struct mscab_decompressor *cabd;
+    struct mscabd_cabinet *cab;
+    struct mscabd_file *f;
+    struct mscabd_repairs r;
+    struct mspack_system *sys = &read_files_write_md5;
+
+    TEST(mspack_version(MSPACK_VER_MSCABD) >= 5);
+    cabd = mspack_create_cab_decompressor(sys);
+    TEST(cabd != NULL);
+    TEST(cabd->set_param(cabd, MSCABD_PARAM_MAXREPAIRS, -1) == MSPACK_ERR_ARGS);
+    TEST(cabd->last_repairs(cabd, NULL) == MSPACK_ERR_ARGS);
+
+    /* the second and third of the cab's three blocks are damaged */
+    cab = cabd->open(cabd, TESTFILE("mszip_2badblocks.cab"));
+    TEST(cab != NULL);
+    f = cab->files;
+    TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_DECRUNCH);
+    TEST(cabd->last_repairs(cabd, &r) == MSPACK_ERR_OK);
+    TEST(r.blocks == 0 && r.bytes == 0);
+    cabd->close(cabd, cab);
+
+    /* each file ends in a different damaged block */
+    TEST(cabd->set_param(cabd, MSCABD_PARAM_FIXMSZIP, 1) == MSPACK_ERR_OK);
+    cab = cabd->open(cabd, TESTFILE("mszip_2badblocks.cab"));
+    TEST(cab != NULL);
+    f = cab->files;
+    TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_OK);
+    TEST(cabd->last_repairs(cabd, &r) == MSPACK_ERR_OK);
+    TEST(r.blocks == 1 && r.first_block == 1 && r.bytes == 32768);
+    f = f->next;
+    TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_OK);
+    TEST(cabd->last_repairs(cabd, &r) == MSPACK_ERR_OK);
+    TEST(r.blocks == 1 && r.first_block == 2 && r.bytes == 32768);
+    f = f->next;
+    TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_OK);
+    TEST(cabd->last_repairs(cabd, &r) == MSPACK_ERR_OK);
+    TEST(r.blocks == 0 && r.bytes == 0);
+
+    /* getting to the last file goes through both damaged blocks */
+    TEST(cabd->extract(cabd, cab->files, NULL) == MSPACK_ERR_OK);
+    TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_OK);
+    TEST(cabd->last_repairs(cabd, &r) == MSPACK_ERR_OK);
+    TEST(r.blocks == 1 && r.first_block == 2);
+    cabd->close(cabd, cab);
+
+    TEST(cabd->set_param(cabd, MSCABD_PARAM_MAXREPAIRS, 1) == MSPACK_ERR_OK);
+    cab = cabd->open(cabd, TESTFILE("mszip_2badblocks.cab"));
+    TEST(cab != NULL);
+    f = cab->files->next->next;
+    TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_DECRUNCH);
+    TEST(cabd->last_repairs(cabd, &r) == MSPACK_ERR_OK);
+    TEST(r.blocks == 1 && r.first_block == 1 && r.bytes == 32768);
+    cabd->close(cabd, cab);
+
+    TEST(cabd->set_param(cabd, MSCABD_PARAM_MAXREPAIRS, 2) == MSPACK_ERR_OK);
+    cab = cabd->open(cabd, TESTFILE("mszip_2badblocks.cab"));
+    TEST(cab != NULL);
+    f = cab->files->next->next;
+    TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_OK);
+    TEST(cabd->last_repairs(cabd, &r) == MSPACK_ERR_OK);
+    TEST(r.blocks == 2 && r.first_block == 1 && r.bytes == 65536);
+    cabd->close(cabd, cab);
+
+    mspack_destroy_cab_decompressor(cabd);
+}
+
+/* MS-ZIP blocks decoded in parallel: a damaged or truncated block in the
+ * blocks read ahead doesn't affect the files before it, and it's an error
+ * for the files that need it, in any order. The fourth of each cab's six
+ * blocks is damaged; each of its three files is two blocks */
+void cabd_extract_test_08() {
+    static const char *files[2] = {
+        TESTFILE("mszip_par_bad.cab"), TESTFILE("mszip_par_short.cab")
+    };
+    struct mscab_decompressor *cabd;
+    struct mscabd_cabinet *cab;
+    struct mscabd_file *f;
+    struct mspack_system *sys = &read_files_write_md5;
+    char file_md5[33];
+    int i, threads, num_files = 2;
+
+#ifndef HAVE_PTHREAD
+    /* blocks are only decoded one at a time, where a truncated block
+     * carries on into the next block's data */
+    num_files = 1;
+#endif
+    TEST(mspack_version(MSPACK_VER_MSCABD) >= 4);
+    for (i = 0; i < num_files; i++) {
+        /* decoded one at a time, the first file is fine */
+        cabd = mspack_create_cab_decompressor(sys);
+        TEST(cabd != NULL);
+        cab = cabd->open(cabd, files[i]);
+        TEST(cab != NULL);
+        TEST(cab->folders->num_blocks == 6);
+        TEST(cabd->extract(cabd, cab->files, NULL) == MSPACK_ERR_OK);
+        memcpy(file_md5, md5_string, 33);
+        cabd->close(cabd, cab);
+
+        for (threads = 2; threads <= 4; threads += 2) {
+            TEST(cabd->set_param(cabd, MSCABD_PARAM_THREADS, threads)
+                 == MSPACK_ERR_OK);
+            cab = cabd->open(cabd, files[i]);
+            TEST(cab != NULL);
+            f = cab->files;
+            TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_OK);
+            TEST(memcmp(file_md5, md5_string, 33) == 0);
+            TEST(cabd->extract(cabd, f->next, NULL) == MSPACK_ERR_DECRUNCH);
+            TEST(cabd->extract(cabd, f->next->next, NULL)
+                 == MSPACK_ERR_DECRUNCH);
+
+            /* the last file, then the first again */
+            TEST(cabd->extract(cabd, f->next->next, NULL)
+                 == MSPACK_ERR_DECRUNCH);
+            TEST(cabd->extract(cabd, f, NULL) == MSPACK_ERR_OK);
+            TEST(memcmp(file_md5, md5_string, 33) == 0);
+            cabd->close(cabd, cab);
+        }
+        mspack_destroy_cab_decompressor(cabd);
+    }
+}
+
 int main() {
     int selftest;
 
@@ -545,6 +752,10 @@ int main() {
     cabd_extract_test_02();
     cabd_extract_test_03();
     cabd_extract_test_04();
+    cabd_extract_test_05();
+    cabd_extract_test_06();
+    cabd_extract_test_07();
+    cabd_extract_test_08();
 
     printf("ALL %d TESTS PASSED.\n", test_count);
     return 0;
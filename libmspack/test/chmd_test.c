@@ -157,6 +157,126 @@ void chmd_extract_test_01() {
 }
 
 
+/* the text in extract.chm: /sec0.txt is its first 5000 bytes, in the
+ * uncompressed section, and /lzx1.txt and /lzx2.txt are the next 1000
+ * and 20000 bytes, in the LZX section */
+static size_t extract_text(char *text) {
+    size_t len = 0;
+    int i;
+    for (i = 1; i <= 1000; i++) {
+        len += sprintf(&text[len], "Line %d of the test data.\n", i);
+    }
+    return len;
+}
+
+/* check extract_to_buffer() gives the same data as extract(), from both
+ * sections, into exact-sized, larger and smaller buffers */
+void chmd_extract_test_02() {
+    struct mschm_decompressor *chmd;
+    struct mschmd_header *chm;
+    struct mschmd_file *f;
+    static char text[30000];
+    static unsigned char buf[25000];
+    static const struct { const char *name; int section; size_t offset; }
+        expect[3] = {
+            { "/sec0.txt", 0, 0 }, { "/lzx2.txt", 1, 6000 },
+            { "/lzx1.txt", 1, 5000 }
+        };
+    size_t len, i;
+    int e;
+
+    TEST(extract_text(text) > 26000);
+    TEST(chmd = mspack_create_chm_decompressor(NULL));
+    TEST(chm = chmd->open(chmd, TESTFILE("extract.chm")));
+
+    /* the LZX files are taken out of order, so the stream goes back */
+    for (e = 0; e < 3; e++) {
+        for (f = chm->files; f; f = f->next) {
+            if (!strcmp(f->filename, expect[e].name)) break;
+        }
+        TEST(f != NULL);
+        TEST(f->section->id == (unsigned int) expect[e].section);
+        len = (size_t) f->length;
+        TEST(len > 200 && len < sizeof(buf));
+
+        /* exact size */
+        memset(buf, 0xAA, sizeof(buf));
+        TEST(chmd->extract_to_buffer(chmd, f, buf, len) == MSPACK_ERR_OK);
+        TEST(memcmp(buf, &text[expect[e].offset], len) == 0);
+        TEST(buf[len] == 0xAA);
+
+        /* larger: only the file's length is written */
+        memset(buf, 0xAA, sizeof(buf));
+        TEST(chmd->extract_to_buffer(chmd, f, buf, sizeof(buf))
+             == MSPACK_ERR_OK);
+        TEST(memcmp(buf, &text[expect[e].offset], len) == 0);
+        for (i = len; i < sizeof(buf) && buf[i] == 0xAA; i++);
+        TEST(i == sizeof(buf));
+
+        /* too short: only the start of the file is written */
+        memset(buf, 0xAA, sizeof(buf));
+        TEST(chmd->extract_to_buffer(chmd, f, buf, 100) == MSPACK_ERR_OK);
+        TEST(memcmp(buf, &text[expect[e].offset], 100) == 0);
+        for (i = 100; i < sizeof(buf) && buf[i] == 0xAA; i++);
+        TEST(i == sizeof(buf));
+    }
+
+    TEST(chmd->extract_to_buffer(chmd, chm->files, NULL, 100)
+         == MSPACK_ERR_ARGS);
+    chmd->close(chmd, chm);
+    mspack_destroy_chm_decompressor(chmd);
+}
+
+/* the data in e8.chm, before its E8 calls were translated: 16 byte
+ * records of an E8 call, a 4 byte relative offset and 11 letters */
+#define E8_LEN (131072)
+static void e8_data(unsigned char *data) {
+    unsigned char *p = data;
+    int k, rel;
+    for (k = 0; k < E8_LEN / 16; k++, p += 16) {
+        rel = (k * 40503) % 300000 - 100000;
+        p[0] = 0xE8;
+        p[1] = (unsigned char) rel;
+        p[2] = (unsigned char) (rel >> 8);
+        p[3] = (unsigned char) (rel >> 16);
+        p[4] = (unsigned char) (rel >> 24);
+        memset(&p[5], 'A' + k % 26, 11);
+    }
+}
+
+/* check that E8 translated LZX data decodes the same whether the files
+ * are extracted in order, carrying on through reset points, or out of
+ * order, starting at a reset point. E8 positions count from the reset */
+void chmd_extract_test_03() {
+    struct mschm_decompressor *chmd;
+    struct mschmd_header *chm;
+    struct mschmd_file *f;
+    static unsigned char data[E8_LEN], buf[E8_LEN];
+    static const char *order[2][3] = {
+        { "/e8a.bin", "/e8b.bin", "/e8c.bin" },
+        { "/e8c.bin", "/e8a.bin", "/e8b.bin" }
+    };
+    int o, i;
+
+    e8_data(data);
+    for (o = 0; o < 2; o++) {
+        TEST(chmd = mspack_create_chm_decompressor(NULL));
+        TEST(chm = chmd->open(chmd, TESTFILE("e8.chm")));
+        for (i = 0; i < 3; i++) {
+            for (f = chm->files; f; f = f->next) {
+                if (!strcmp(f->filename, order[o][i])) break;
+            }
+            TEST(f != NULL);
+            memset(buf, 0, sizeof(buf));
+            TEST(chmd->extract_to_buffer(chmd, f, buf, sizeof(buf))
+                 == MSPACK_ERR_OK);
+            TEST(memcmp(buf, &data[f->offset], (size_t) f->length) == 0);
+        }
+        chmd->close(chmd, chm);
+        mspack_destroy_chm_decompressor(chmd);
+    }
+}
+
 int main() {
   int selftest;
 
@@ -168,6 +288,8 @@ int main() {
   chmd_open_test_03();
   chmd_search_test_01();
   chmd_extract_test_01();
+  chmd_extract_test_02();
+  chmd_extract_test_03();
 
   printf("ALL %d TESTS PASSED.\n", test_count);
   return 0;
@@ -0,0 +1,122 @@
+/* copy_match_bench: measures how quickly copy_match() copies LZ77 matches,
+ * compared to copying one byte at a time, for a few typical distributions
+ * of match lengths and distances. It also checks that both give the same
+ * result.
+ *
+ * usage: copy_match_bench [-n repeats]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <system.h>
+#include <copymatch.h>
+#include <rnd.h>
+
+#define WINDOW_SIZE (1 << 20)
+#define NUM_MATCHES (1 << 16)
+
+struct match {
+    unsigned int dist, length;
+};
+
+/* a random number from 0 to range-1 */
+static unsigned int rnd_below(unsigned int range) {
+    return rnd() % range;
+}
+
+/* LZX: mostly short matches, with many repeated nearby offsets */
+static void gen_lzx(struct match *m) {
+    unsigned int r = rnd_below(100);
+    m->length = (r < 50) ? 2 + rnd_below(3) : (r < 80) ? 5 + rnd_below(6)
+              : (r < 95) ? 11 + rnd_below(22) : 33 + rnd_below(225);
+    r = rnd_below(100);
+    m->dist = (r < 10) ? 1 + rnd_below(7) : (r < 60) ? 8 + rnd_below(248)
+            : 256 + rnd_below(65536 - 256);
+}
+
+/* MSZIP: deflate matches, at least 3 bytes and within 32kb */
+static void gen_mszip(struct match *m) {
+    unsigned int r = rnd_below(100);
+    m->length = (r < 60) ? 3 + rnd_below(6) : (r < 90) ? 9 + rnd_below(24)
+              : 33 + rnd_below(226);
+    r = rnd_below(100);
+    m->dist = (r < 10) ? 1 + rnd_below(7) : 8 + rnd_below(32768 - 8);
+}
+
+/* runs: long matches of short patterns, as in sparse or padded data */
+static void gen_runs(struct match *m) {
+    m->length = 32 + rnd_below(227);
+    m->dist = 1 + rnd_below(4);
+}
+
+static clock_t run(unsigned char *window, struct match *matches, int repeats,
+                   int bytewise, unsigned long *bytes)
+{
+    clock_t start = clock();
+    unsigned int i, pos, n;
+    unsigned char *dest, *src;
+    int r;
+
+    *bytes = 0;
+    for (r = 0; r < repeats; r++) {
+        pos = 65536;
+        for (i = 0; i < NUM_MATCHES; i++) {
+            if (pos + 258 > WINDOW_SIZE) pos = 65536;
+            dest = &window[pos];
+            src = dest - matches[i].dist;
+            n = matches[i].length;
+            if (bytewise) {
+                while (n--) *dest++ = *src++;
+            }
+            else {
+                copy_match(dest, src, n);
+            }
+            pos += matches[i].length;
+            *bytes += matches[i].length;
+        }
+    }
+    return clock() - start;
+}
+
+static int bench(const char *name, void (*gen)(struct match *), int repeats) {
+    static unsigned char w1[WINDOW_SIZE], w2[WINDOW_SIZE];
+    static struct match matches[NUM_MATCHES];
+    unsigned long bytes;
+    clock_t t1, t2;
+    unsigned int i;
+
+    for (i = 0; i < NUM_MATCHES; i++) gen(&matches[i]);
+    for (i = 0; i < WINDOW_SIZE; i++) w1[i] = w2[i] = (unsigned char) rnd_below(256);
+
+    t1 = run(w1, matches, repeats, 1, &bytes);
+    t2 = run(w2, matches, repeats, 0, &bytes);
+    if (memcmp(w1, w2, WINDOW_SIZE)) {
+        printf("%-6s copy_match() gives a different result!\n", name);
+        return 1;
+    }
+    printf("%-6s %8.2f MB  bytewise %8.3f s  copy_match %8.3f s  %5.2fx\n",
+           name, (double) bytes / (1024.0 * 1024.0),
+           (double) t1 / CLOCKS_PER_SEC, (double) t2 / CLOCKS_PER_SEC,
+           t2 ? (double) t1 / t2 : 0.0);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int repeats = 100, err = 0;
+
+    if (argc > 2 && !strcmp(argv[1], "-n")) {
+        repeats = atoi(argv[2]);
+        if (repeats < 1) repeats = 1;
+    }
+
+    err |= bench("lzx", &gen_lzx, repeats);
+    err |= bench("mszip", &gen_mszip, repeats);
+    err |= bench("runs", &gen_runs, repeats);
+    return err;
+}
@@ -8,6 +8,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <mspack.h>
+#include <system.h>
+#include <mem_fh.h>
+#include <rnd.h>
+#include <ref_lzss.h>
 
 #define __tf3(x) #x
 #define __tf2(x) __tf3(x)
@@ -114,6 +118,59 @@ void kwajd_open_test_01() {
     mspack_destroy_kwaj_decompressor(kwajd);
 }
 
+/* an mspack_system that reads the file "in" from memory, and writes
+ * any other file to memory */
+static struct mem_file mem_in, mem_out;
+
+static struct mspack_file *m_open(struct mspack_system *self,
+                                  const char *filename, int mode)
+{
+    struct mem_file *fh = (mode == MSPACK_SYS_OPEN_READ) ? &mem_in : &mem_out;
+    if (mode == MSPACK_SYS_OPEN_READ && strcmp(filename, "in")) return NULL;
+    fh->posn = 0;
+    return (struct mspack_file *) fh;
+}
+static void m_close(struct mspack_file *file) {
+}
+
+/* test that KWAJ files compressed with LZSS expand the same as the
+ * reference decoder, including matches that wrap the window or refer to
+ * where the output is in it, and input that ends part way through */
+void kwajd_lzss_test_01() {
+    static unsigned char in[14 + 100000], out[1200000], expect[1200000];
+    struct mspack_system sys = *mspack_default_system;
+    struct mskwaj_decompressor *kwajd;
+    struct mskwajd_header *hdr;
+    size_t len, expect_len, i;
+    int n;
+
+    mem_fh_system(&sys);
+    sys.open = &m_open;  sys.close = &m_close;
+    mem_in.data  = in;  mem_out.data = out;
+    TEST(kwajd = mspack_create_kwaj_decompressor(&sys));
+
+    memcpy(in, "KWAJ\x88\xF0\x27\xD1\x02\x00\x0E\x00\x00\x00", 14);
+    for (n = 0; n < 8; n++) {
+        len = (n < 2) ? 100000 : 1 + rnd() % 300;
+        for (i = 14; i < 14 + len; i++) {
+            /* mostly matches in odd tests, mostly literals in even tests */
+            in[i] = (n & 1) ? (unsigned char) (rnd() & 0x9F)
+                            : (unsigned char) rnd();
+        }
+        mem_in.length = 14 + len;
+        mem_out.length = sizeof(out);
+        expect_len = ref_lzss(&in[14], len, expect, 4096 - 18);
+
+        TEST(hdr = kwajd->open(kwajd, "in"));
+        TEST(hdr->comp_type == MSKWAJ_COMP_SZDD);
+        TEST(kwajd->extract(kwajd, hdr, "out") == MSPACK_ERR_OK);
+        TEST(mem_out.posn == expect_len);
+        TEST(memcmp(out, expect, expect_len) == 0);
+        kwajd->close(kwajd, hdr);
+    }
+    mspack_destroy_kwaj_decompressor(kwajd);
+}
+
 int main() {
   int selftest;
 
@@ -121,6 +178,7 @@ int main() {
   TEST(selftest == MSPACK_ERR_OK);
 
   kwajd_open_test_01();
+  kwajd_lzss_test_01();
 
   printf("ALL %d TESTS PASSED.\n", test_count);
   return 0;
@@ -0,0 +1,357 @@
+/* lzxd_bench: measures how quickly lzxd_decompress() decodes the LZX
+ * streams in CAB, CHM and OAB files. Each file is read into memory first,
+ * and its LZX streams are decoded from memory with the output discarded,
+ * so only the LZX decoder is measured.
+ *
+ * If libmspack was built with LZX_PROFILE defined (e.g. "make clean all
+ * CPPFLAGS=-DLZX_PROFILE"), the time spent in each phase of decoding is
+ * also shown.
+ *
+ * usage: lzxd_bench [-n repeats] <CAB, CHM or OAB files>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <system.h>
+#include <lzx.h>
+#include <cab.h>
+#include <chm.h>
+#include <oab.h>
+#include <mem_fh.h>
+
+/* an LZX stream found in a file */
+struct stream {
+    unsigned char *data;   /* compressed data                     */
+    size_t length;         /* compressed length                   */
+    off_t output_length;   /* decompressed length                 */
+    int window_bits, reset_interval, is_delta;
+    int free_data;         /* was data allocated, or in the file? */
+};
+
+static const char *content_name = "::DataSpace/Storage/MSCompressed/Content";
+static const char *control_name = "::DataSpace/Storage/MSCompressed/ControlData";
+static const char *rtable_name  = "::DataSpace/Storage/MSCompressed/Transform/"
+  "{7FC28940-9D31-11D0-9B27-00A0C91E9C7C}/InstanceData/ResetTable";
+
+static struct stream *streams;
+static int num_streams;
+
+static void m_msg(struct mspack_file *file, const char *format, ...) {
+}
+static void *m_alloc(struct mspack_system *self, size_t bytes) {
+    return malloc(bytes);
+}
+static void m_free(void *buffer) {
+    free(buffer);
+}
+static void m_copy(void *src, void *dest, size_t bytes) {
+    memcpy(dest, src, bytes);
+}
+
+static struct mspack_system mem_system = {
+    NULL, NULL, NULL, NULL, NULL, NULL,
+    &m_msg, &m_alloc, &m_free, &m_copy, NULL
+};
+
+static int add_stream(unsigned char *data, size_t length, off_t output_length,
+                      int window_bits, int reset_interval, int is_delta,
+                      int free_data)
+{
+    struct stream *s = (struct stream *) realloc(streams,
+        (num_streams + 1) * sizeof(struct stream));
+    if (!s) return 0;
+    streams = s;
+    s = &streams[num_streams++];
+    s->data           = data;
+    s->length         = length;
+    s->output_length  = output_length;
+    s->window_bits    = window_bits;
+    s->reset_interval = reset_interval;
+    s->is_delta       = is_delta;
+    s->free_data      = free_data;
+    return 1;
+}
+
+/* finds the LZX folders in a cabinet. Each folder's data blocks are
+ * joined together to make one LZX stream */
+static int find_cab(unsigned char *buf, size_t len) {
+    unsigned int num_folders, flags, i, j, num_blocks, csize, comp_type;
+    unsigned int head_res = 0, fold_res = 0, data_res = 0;
+    size_t pos = cfhead_SIZEOF, data_pos;
+    unsigned char *data;
+    off_t output_length;
+    size_t data_len;
+
+    if (len < cfhead_SIZEOF) return 0;
+    num_folders = EndGetI16(&buf[cfhead_NumFolders]);
+    flags = EndGetI16(&buf[cfhead_Flags]);
+    if (flags & cfheadRESERVE_PRESENT) {
+        if (len < pos + cfheadext_SIZEOF) return 0;
+        head_res = EndGetI16(&buf[pos + cfheadext_HeaderReserved]);
+        fold_res = buf[pos + cfheadext_FolderReserved];
+        data_res = buf[pos + cfheadext_DataReserved];
+        pos += cfheadext_SIZEOF + head_res;
+    }
+    /* skip previous and next cabinet names and disk names */
+    for (i = ((flags & cfheadPREV_CABINET) ? 2 : 0) +
+             ((flags & cfheadNEXT_CABINET) ? 2 : 0); i > 0; i--)
+    {
+        while (pos < len && buf[pos]) pos++;
+        pos++;
+    }
+
+    for (i = 0; i < num_folders; i++, pos += cffold_SIZEOF + fold_res) {
+        if (pos + cffold_SIZEOF > len) return 0;
+        comp_type = EndGetI16(&buf[pos + cffold_CompType]);
+        if ((comp_type & cffoldCOMPTYPE_MASK) != cffoldCOMPTYPE_LZX) continue;
+        num_blocks = EndGetI16(&buf[pos + cffold_NumBlocks]);
+        data_pos = EndGetI32(&buf[pos + cffold_DataOffset]);
+
+        if (!(data = (unsigned char *) malloc(num_blocks * CAB_INPUTMAX))) {
+            return 0;
+        }
+        data_len = 0;
+        output_length = 0;
+        for (j = 0; j < num_blocks; j++) {
+            if (data_pos + cfdata_SIZEOF + data_res > len) break;
+            csize = EndGetI16(&buf[data_pos + cfdata_CompressedSize]);
+            output_length += EndGetI16(&buf[data_pos + cfdata_UncompressedSize]);
+            data_pos += cfdata_SIZEOF + data_res;
+            if (data_pos + csize > len || csize > CAB_INPUTMAX) break;
+            memcpy(&data[data_len], &buf[data_pos], csize);
+            data_len += csize;
+            data_pos += csize;
+        }
+        if (j < num_blocks || !add_stream(data, data_len, output_length,
+                                          (comp_type >> 8) & 0x1F, 0, 0, 1))
+        {
+            free(data);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* finds the LZX compressed section of a CHM helpfile */
+static int find_chm(const char *filename, unsigned char *buf, size_t len) {
+    struct mschm_decompressor *chmd;
+    struct mschmd_header *chm;
+    struct mschmd_file content, control, rtable;
+    unsigned int interval, window_size, window_bits = 0, i;
+    off_t sec0, output_length;
+    int ok = 0;
+
+    if (!(chmd = mspack_create_chm_decompressor(NULL))) return 0;
+    if ((chm = chmd->fast_open(chmd, filename))) {
+        sec0 = chm->sec0.offset;
+        if (!chmd->fast_find(chmd, chm, content_name, &content, sizeof(content)) &&
+            !chmd->fast_find(chmd, chm, control_name, &control, sizeof(control)) &&
+            !chmd->fast_find(chmd, chm, rtable_name, &rtable, sizeof(rtable)) &&
+            content.section && content.section->id == 0 &&
+            control.section && control.section->id == 0 &&
+            rtable.section && rtable.section->id == 0 &&
+            control.length == lzxcd_SIZEOF &&
+            rtable.length >= lzxrt_headerSIZEOF &&
+            (size_t) (sec0 + content.offset + content.length) <= len &&
+            (size_t) (sec0 + control.offset + control.length) <= len &&
+            (size_t) (sec0 + rtable.offset + rtable.length) <= len)
+        {
+            unsigned char *cd = &buf[sec0 + control.offset];
+            interval    = EndGetI32(&cd[lzxcd_ResetInterval]);
+            window_size = EndGetI32(&cd[lzxcd_WindowSize]);
+            if (EndGetI32(&cd[lzxcd_Version]) == 2) {
+                interval    *= LZX_FRAME_SIZE;
+                window_size *= LZX_FRAME_SIZE;
+            }
+            for (i = 15; i <= 21; i++) {
+                if (window_size == (1U << i)) window_bits = i;
+            }
+            /* the uncompressed data is padded to the next reset interval */
+            output_length = EndGetI64(&buf[sec0 + rtable.offset + lzxrt_UncompLen]);
+            if (window_bits && interval && !(interval % LZX_FRAME_SIZE)) {
+                output_length += interval - 1;
+                output_length -= output_length % interval;
+                ok = add_stream(&buf[sec0 + content.offset],
+                                (size_t) content.length, output_length,
+                                (int) window_bits,
+                                (int) (interval / LZX_FRAME_SIZE), 0, 0);
+            }
+        }
+        chmd->close(chmd, chm);
+    }
+    mspack_destroy_chm_decompressor(chmd);
+    return ok;
+}
+
+/* finds the LZX blocks of an OAB file. Each is a separate stream */
+static int find_oab(unsigned char *buf, size_t len) {
+    unsigned int target_size, flags, csize, dsize, window_bits;
+    size_t pos = oabhead_SIZEOF;
+
+    target_size = EndGetI32(&buf[oabhead_TargetSize]);
+    while (target_size) {
+        if (pos + oabblk_SIZEOF > len) return 0;
+        flags = EndGetI32(&buf[pos + oabblk_Flags]);
+        csize = EndGetI32(&buf[pos + oabblk_CompSize]);
+        dsize = EndGetI32(&buf[pos + oabblk_UncompSize]);
+        pos += oabblk_SIZEOF;
+        if (pos + csize > len || dsize > target_size) return 0;
+        if (flags) {
+            window_bits = 17;
+            while (window_bits < 25 && (1U << window_bits) < dsize) {
+                window_bits++;
+            }
+            if (!add_stream(&buf[pos], csize, dsize, window_bits, 0, 1, 0)) {
+                return 0;
+            }
+        }
+        pos += csize;
+        target_size -= dsize;
+    }
+    return 1;
+}
+
+/* reads a file into memory, and finds the LZX streams in it */
+static unsigned char *load(const char *filename) {
+    unsigned char *buf = NULL;
+    size_t len = 0;
+    FILE *fh;
+    long size;
+    int ok = 0;
+
+    if ((fh = fopen(filename, "rb"))) {
+        if (!fseek(fh, 0, SEEK_END) && (size = ftell(fh)) >= 16 &&
+            !fseek(fh, 0, SEEK_SET) && (buf = (unsigned char *) malloc(size)))
+        {
+            len = fread(buf, 1, (size_t) size, fh);
+        }
+        fclose(fh);
+    }
+    if (len < 16) {
+        fprintf(stderr, "%s: can't read file\n", filename);
+        free(buf);
+        return NULL;
+    }
+
+    if (!memcmp(buf, "MSCF", 4)) {
+        ok = find_cab(buf, len);
+    }
+    else if (!memcmp(buf, "ITSF", 4)) {
+        ok = find_chm(filename, buf, len);
+    }
+    else if (EndGetI32(&buf[oabhead_VersionHi]) == 3 &&
+             EndGetI32(&buf[oabhead_VersionLo]) == 1)
+    {
+        ok = find_oab(buf, len);
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: not a CAB, CHM or OAB file, or LZX data "
+                "not found\n", filename);
+    }
+    return buf;
+}
+
+static void report(const char *name, off_t bytes, clock_t ticks) {
+    double secs = (double) ticks / CLOCKS_PER_SEC;
+    double mb = (double) bytes / (1024.0 * 1024.0);
+    printf("%10.2f MB %8.3f s %10.2f MB/s  %s\n",
+           mb, secs, (secs > 0) ? mb / secs : 0.0, name);
+}
+
+static void report_phases(unsigned long long *ticks) {
+    static const char *names[LZX_PROF_PHASES] = {
+        "headers and tables", "symbol decoding", "match copying",
+        "E8 translation", "output writes"
+    };
+    unsigned long long total = 0, t;
+    int i;
+
+    /* LZX_PROF_DECODE includes LZX_PROF_COPY, show them separately */
+    ticks[LZX_PROF_DECODE] -= ticks[LZX_PROF_COPY];
+    for (i = 0; i < LZX_PROF_PHASES; i++) total += ticks[i];
+    if (total == 0) return;
+    for (i = 0; i < LZX_PROF_PHASES; i++) {
+        t = ticks[i];
+        printf("%20s: %16llu ticks %6.2f%%\n", names[i], t,
+               100.0 * (double) t / (double) total);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long long prof_ticks[LZX_PROF_PHASES];
+    struct mem_file in, out;
+    struct lzxd_stream *lzx;
+    off_t total_bytes = 0;
+    clock_t start, total_ticks = 0;
+    unsigned char *buf;
+    int err, i, j, repeats = 1;
+
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    /* if self-test reveals an error */
+    MSPACK_SYS_SELFTEST(err);
+    if (err) return 1;
+    mem_fh_system(&mem_system);
+
+    if (argc > 2 && !strcmp(argv[1], "-n")) {
+        repeats = atoi(argv[2]);
+        if (repeats < 1) repeats = 1;
+        argv += 2;
+    }
+
+    memset(prof_ticks, 0, sizeof(prof_ticks));
+    for (argv++; *argv; argv++) {
+        if (!(buf = load(*argv))) continue;
+
+        /* output is only counted */
+        out.data = NULL;
+        out.posn = 0;
+        start = clock();
+        for (i = 0; i < repeats; i++) {
+            for (j = 0; j < num_streams; j++) {
+                in.data   = streams[j].data;
+                in.length = streams[j].length;
+                in.posn   = 0;
+                lzx = lzxd_init(&mem_system, (struct mspack_file *) &in,
+                                (struct mspack_file *) &out,
+                                streams[j].window_bits,
+                                streams[j].reset_interval, 65536,
+                                streams[j].output_length,
+                                (char) streams[j].is_delta);
+                if (!lzx) {
+                    fprintf(stderr, "%s: can't initialise LZX\n", *argv);
+                    continue;
+                }
+                if ((err = lzxd_decompress(lzx, streams[j].output_length))) {
+                    fprintf(stderr, "%s: LZX error %d in stream %d\n",
+                            *argv, err, j);
+                }
+                for (err = 0; err < LZX_PROF_PHASES; err++) {
+                    prof_ticks[err] += lzx->prof_ticks[err];
+                }
+                lzxd_free(lzx);
+            }
+        }
+        start = clock() - start;
+        report(*argv, (off_t) out.posn, start);
+        total_bytes += (off_t) out.posn;
+        total_ticks += start;
+
+        for (j = 0; j < num_streams; j++) {
+            if (streams[j].free_data) free(streams[j].data);
+        }
+        num_streams = 0;
+        free(buf);
+    }
+    report("total", total_bytes, total_ticks);
+    report_phases(prof_ticks);
+    free(streams);
+    return 0;
+}
@@ -0,0 +1,530 @@
+/* LZX decompressor regression test suite */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <system.h>
+#include <lzx.h>
+#include <copymatch.h>
+#include <step.h>
+#include <mem_fh.h>
+#include <rnd.h>
+
+unsigned int test_count = 0;
+#define TEST(x) do {\
+    test_count++; \
+    if ((x)) {printf("%s:%d SUCCESS %s\n",__func__,__LINE__,#x);} \
+    else {printf("%s:%d FAILED %s\n",__func__,__LINE__,#x);exit(1);} \
+} while (0)
+
+/* test the E8 translation of known calls */
+void lzxd_e8_test_01() {
+    unsigned char buf[32], expect[32];
+    int method;
+
+    for (method = LZX_E8_AUTO; method <= LZX_E8_AVX2; method++) {
+        memset(buf, 0, sizeof(buf));
+        /* absolute 0x1000 at position 0x100 becomes relative 0xF00 */
+        memcpy(&buf[0], "\xE8\x00\x10\x00\x00", 5);
+        /* absolute -0x10 becomes relative filesize-0x10 */
+        memcpy(&buf[5], "\xE8\xF0\xFF\xFF\xFF", 5);
+        /* absolute 0x2000000 is beyond filesize and stays the same */
+        memcpy(&buf[10], "\xE8\x00\x00\x00\x02", 5);
+        /* E8 in the operand of the previous call is not a call */
+        memcpy(&buf[15], "\xE8\xE8\x00\x10\x00", 5);
+        /* E8 in the last 10 bytes is not translated */
+        buf[22] = 0xE8; buf[23] = 0x00; buf[24] = 0x10;
+
+        memcpy(expect, buf, sizeof(buf));
+        memcpy(&expect[1], "\x00\x0F\x00\x00", 4);
+        memcpy(&expect[6], "\xF0\xFF\xFF\x00", 4);
+        memcpy(&expect[16], "\xD9\xFF\x0F\x00", 4);
+
+        if (lzxd_e8_translate(buf, sizeof(buf), 0x100, 0x1000000, method)) {
+            TEST(method != LZX_E8_AUTO && method != LZX_E8_SCALAR);
+            continue;
+        }
+        TEST(memcmp(buf, expect, sizeof(buf)) == 0);
+    }
+}
+
+/* test that every E8 translation method gives the same result as the
+ * scalar method on random data, dense with E8 bytes, and that undoing
+ * the translation gives back the original data */
+void lzxd_e8_test_02() {
+    static unsigned char data[LZX_FRAME_SIZE], ref[LZX_FRAME_SIZE],
+        buf[LZX_FRAME_SIZE];
+    unsigned int length, i, same, undone;
+    int method, n, curpos, filesize;
+
+    for (method = LZX_E8_AUTO; method <= LZX_E8_AVX2; method++) {
+        if (lzxd_e8_translate(data, 0, 0, 1, method)) {
+            TEST(method != LZX_E8_AUTO && method != LZX_E8_SCALAR);
+            continue;
+        }
+        same = undone = 1;
+        for (n = 0; n < 2000; n++) {
+            length = (n & 1) ? LZX_FRAME_SIZE - (rnd() & 63) : rnd() & 255;
+            curpos = (int) ((rnd() & 0x7FFF) << 15);
+            filesize = (int) (rnd() << 10) + 1;
+            for (i = 0; i < length; i++) {
+                data[i] = (rnd() & 3) ? 0xE8 : (unsigned char) rnd();
+            }
+            memcpy(ref, data, length);
+            memcpy(buf, data, length);
+            lzxd_e8_translate(ref, length, curpos, filesize, LZX_E8_SCALAR);
+            lzxd_e8_translate(buf, length, curpos, filesize, method);
+            if (memcmp(ref, buf, length)) same = 0;
+            lzxd_e8_translate(buf, length, curpos, filesize,
+                              method | LZX_E8_UNDO);
+            if (memcmp(data, buf, length)) undone = 0;
+        }
+        TEST(same);
+        TEST(undone);
+    }
+}
+
+/* test that copy_match() gives the same result as copying one byte at a
+ * time, for every short distance in both directions and many lengths */
+void lzxd_copy_match_test_01() {
+    unsigned char ref[256], buf[256];
+    unsigned int i, length, same = 1;
+    int dist;
+
+    for (dist = -20; dist <= 20; dist++) {
+        if (dist == 0) continue;
+        for (length = 0; length <= 80; length++) {
+            for (i = 0; i < sizeof(ref); i++) ref[i] = buf[i] = (unsigned char) rnd();
+            for (i = 0; i < length; i++) ref[100 + i] = ref[100 - dist + i];
+            copy_match(&buf[100], &buf[100 - dist], length);
+            if (memcmp(ref, buf, sizeof(ref))) same = 0;
+        }
+    }
+    TEST(same);
+}
+
+/* makes an LZX stream of SEEK_FRAMES uncompressed blocks, one per frame, with
+ * a reset every frame. Returns the decompressed data in out */
+#define SEEK_FRAMES (4)
+#define SEEK_FRAME_LEN (4 + 12 + LZX_FRAME_SIZE)
+static void make_uncompressed_frames(unsigned char *in, unsigned char *out) {
+    unsigned int i, j;
+    for (i = 0; i < SEEK_FRAMES; i++) {
+        /* no E8, blocktype 3, length 32768, 4 padding bits */
+        unsigned char *p = &in[i * SEEK_FRAME_LEN];
+        memcpy(p, "\x08\x30\x00\x00", 4);
+        memset(&p[4], 1, 12); /* R0, R1, R2 */
+        for (j = 0; j < LZX_FRAME_SIZE; j++) {
+            p[16 + j] = out[i * LZX_FRAME_SIZE + j] = (unsigned char) rnd();
+        }
+    }
+}
+
+/* test that lzxd_seek() moves to reset points in either direction. As
+ * lzxd_decompress() decodes the frame after the one asked for, the last
+ * frame is never asked for */
+void lzxd_seek_test_01() {
+    static unsigned char in[SEEK_FRAMES * SEEK_FRAME_LEN];
+    static unsigned char expect[SEEK_FRAMES * LZX_FRAME_SIZE];
+    static unsigned char out[SEEK_FRAMES * LZX_FRAME_SIZE];
+    struct mspack_system sys = *mspack_default_system;
+    struct mem_file infh, outfh;
+    struct lzxd_stream *lzx;
+
+    mem_fh_system(&sys);
+    infh.data = in;    infh.length = sizeof(in);   infh.posn = 0;
+    outfh.data = out;  outfh.length = sizeof(out); outfh.posn = 0;
+    make_uncompressed_frames(in, expect);
+
+    lzx = lzxd_init(&sys, (struct mspack_file *) &infh,
+                    (struct mspack_file *) &outfh, 16, 1, 4096,
+                    sizeof(expect), 0);
+    TEST(lzx != NULL);
+
+    /* decode frame 0, then jump ahead to frame 2 */
+    TEST(lzxd_decompress(lzx, LZX_FRAME_SIZE) == MSPACK_ERR_OK);
+    TEST(memcmp(out, expect, LZX_FRAME_SIZE) == 0);
+    TEST(lzxd_seek(lzx, 2, 2 * SEEK_FRAME_LEN) == MSPACK_ERR_OK);
+    outfh.posn = 0;
+    TEST(lzxd_decompress(lzx, LZX_FRAME_SIZE) == MSPACK_ERR_OK);
+    TEST(memcmp(out, &expect[2 * LZX_FRAME_SIZE], LZX_FRAME_SIZE) == 0);
+
+    /* go back to frame 1 */
+    TEST(lzxd_seek(lzx, 1, SEEK_FRAME_LEN) == MSPACK_ERR_OK);
+    outfh.posn = 0;
+    TEST(lzxd_decompress(lzx, 2 * LZX_FRAME_SIZE) == MSPACK_ERR_OK);
+    TEST(memcmp(out, &expect[LZX_FRAME_SIZE], 2 * LZX_FRAME_SIZE) == 0);
+    lzxd_free(lzx);
+
+    /* a stream that never resets can only go back to the start */
+    lzx = lzxd_init(&sys, (struct mspack_file *) &infh,
+                    (struct mspack_file *) &outfh, 16, 0, 4096, 0, 0);
+    TEST(lzx != NULL);
+    TEST(lzxd_seek(lzx, 1, SEEK_FRAME_LEN) == MSPACK_ERR_ARGS);
+    TEST(lzxd_seek(lzx, 0, 0) == MSPACK_ERR_OK);
+    lzxd_free(lzx);
+}
+
+/* test that a stream restored from a checkpoint carries on from where
+ * the checkpoint was made, in the middle of a block that spans frames */
+void lzxd_checkpoint_test_01() {
+    static unsigned char in[16 + SEEK_FRAMES * LZX_FRAME_SIZE];
+    static unsigned char expect[SEEK_FRAMES * LZX_FRAME_SIZE];
+    static unsigned char out[SEEK_FRAMES * LZX_FRAME_SIZE];
+    static unsigned char ckpt[1 << 17];
+    struct mspack_system sys = *mspack_default_system;
+    struct mem_file infh, outfh, ckfh;
+    struct lzxd_stream *lzx, *lzx2;
+    unsigned int i;
+
+    mem_fh_system(&sys);
+    infh.data = in;    infh.length = sizeof(in);   infh.posn = 0;
+    outfh.data = out;  outfh.length = sizeof(out); outfh.posn = 0;
+    ckfh.data = ckpt;  ckfh.length = sizeof(ckpt); ckfh.posn = 0;
+
+    /* no E8, blocktype 3, length 131072, 4 padding bits, R0-R2 */
+    memcpy(in, "\x20\x30\x00\x00", 4);
+    memset(&in[4], 1, 12);
+    for (i = 0; i < sizeof(expect); i++) {
+        in[16 + i] = expect[i] = (unsigned char) rnd();
+    }
+
+    lzx = lzxd_init(&sys, (struct mspack_file *) &infh,
+                    (struct mspack_file *) &outfh, 16, 0, 4096,
+                    sizeof(expect), 0);
+    lzx2 = lzxd_init(&sys, (struct mspack_file *) &infh,
+                     (struct mspack_file *) &outfh, 16, 0, 4096,
+                     sizeof(expect), 0);
+    TEST(lzx != NULL && lzx2 != NULL);
+
+    /* decode frame 0, save a checkpoint, then decode frame 1 */
+    TEST(lzxd_decompress(lzx, LZX_FRAME_SIZE) == MSPACK_ERR_OK);
+    TEST(lzxd_checkpoint(lzx, &sys, (struct mspack_file *) &ckfh)
+         == MSPACK_ERR_OK);
+    TEST(lzxd_decompress(lzx, LZX_FRAME_SIZE) == MSPACK_ERR_OK);
+    TEST(memcmp(out, expect, 2 * LZX_FRAME_SIZE) == 0);
+
+    /* a new stream restored from the checkpoint decodes frames 1 and 2 */
+    ckfh.posn = 0; outfh.posn = 0;
+    TEST(lzxd_restore(lzx2, &sys, (struct mspack_file *) &ckfh)
+         == MSPACK_ERR_OK);
+    TEST(lzxd_decompress(lzx2, 2 * LZX_FRAME_SIZE) == MSPACK_ERR_OK);
+    TEST(memcmp(out, &expect[LZX_FRAME_SIZE], 2 * LZX_FRAME_SIZE) == 0);
+
+    /* the first stream can also go back to it */
+    ckfh.posn = 0; outfh.posn = 0;
+    TEST(lzxd_restore(lzx, &sys, (struct mspack_file *) &ckfh)
+         == MSPACK_ERR_OK);
+    TEST(lzxd_decompress(lzx, LZX_FRAME_SIZE) == MSPACK_ERR_OK);
+    TEST(memcmp(out, &expect[LZX_FRAME_SIZE], LZX_FRAME_SIZE) == 0);
+    lzxd_free(lzx2);
+
+    /* a checkpoint for a different window size is refused */
+    lzx2 = lzxd_init(&sys, (struct mspack_file *) &infh,
+                     (struct mspack_file *) &outfh, 17, 0, 4096, 0, 0);
+    ckfh.posn = 0;
+    TEST(lzxd_restore(lzx2, &sys, (struct mspack_file *) &ckfh)
+         == MSPACK_ERR_ARGS);
+    lzxd_free(lzx2);
+    lzxd_free(lzx);
+}
+
+/* an LZX bitstream writer: bits are stored MSB first in 16-bit LE words */
+struct bit_writer {
+    unsigned char *p;
+    unsigned int word, bits;
+};
+
+static void put_bits(struct bit_writer *bw, unsigned int value, int n) {
+    while (n--) {
+        bw->word = (bw->word << 1) | ((value >> n) & 1);
+        if (++bw->bits == 16) {
+            *bw->p++ = bw->word & 0xFF;
+            *bw->p++ = (bw->word >> 8) & 0xFF;
+            bw->word = bw->bits = 0;
+        }
+    }
+}
+
+/* writes the code lengths from first to last (exclusive) as all zero,
+ * except for the symbols in ones[] which get length 1. The pretree gives
+ * symbols 0, 16, 17 and 18 the 2-bit codes 00, 01, 10 and 11 */
+static void put_lens(struct bit_writer *bw, unsigned int first,
+                     unsigned int last, const unsigned int *ones, int n)
+{
+    unsigned int x = first, run, i;
+    for (i = 0; i < 20; i++) {
+        put_bits(bw, (i == 0 || (i >= 16 && i <= 18)) ? 2 : 0, 4);
+    }
+    while (x < last) {
+        for (run = 0; x + run < last && (!n || x + run < *ones); run++);
+        while (run >= 20) {
+            i = run > 51 ? 51 : run;
+            if (run - i > 0 && run - i < 4) i -= 4; /* leave a usable run */
+            put_bits(bw, 3, 2); put_bits(bw, i - 20, 5);
+            run -= i; x += i;
+        }
+        if (run >= 4) { put_bits(bw, 2, 2); put_bits(bw, run - 4, 4); x += run; }
+        else while (run--) { put_bits(bw, 0, 2); x++; }
+        if (n && x == *ones) {
+            put_bits(bw, 1, 2); /* delta 16: length 0 becomes 1 */
+            x++; ones++; n--;
+        }
+    }
+}
+
+/* test that LZX DELTA streams sharing one reference buffer decode the same
+ * as one with its own copy of the reference data. The stream is a single
+ * verbatim block: a match 32768 bytes back, into the reference data, then
+ * repeated matches with the same offset, so it decodes to the reference */
+#define SHARE_REF_LEN (LZX_FRAME_SIZE)
+void lzxd_share_test_01() {
+    static unsigned char in[8192], ref[SHARE_REF_LEN];
+    static unsigned char out[3][LZX_FRAME_SIZE];
+    /* match length 8 (length header 6) with position slot 30 or 0 (R0) */
+    static const unsigned int ones[2] = { 256 + 0*8 + 6, 256 + 30*8 + 6 };
+    struct mspack_system sys = *mspack_default_system;
+    struct mem_file infh, outfh, reffh;
+    struct lzxd_stream *lzx[3];
+    struct bit_writer bw;
+    unsigned int i;
+
+    mem_fh_system(&sys);
+    for (i = 0; i < sizeof(ref); i++) ref[i] = (unsigned char) rnd();
+
+    memset(in, 0, sizeof(in));
+    bw.p = in; bw.word = bw.bits = 0;
+    put_bits(&bw, 0, 16);                   /* chunk size (not used) */
+    put_bits(&bw, 0, 1);                    /* no E8 translation */
+    put_bits(&bw, 1, 3);                    /* verbatim block */
+    put_bits(&bw, LZX_FRAME_SIZE >> 8, 16); /* block length */
+    put_bits(&bw, LZX_FRAME_SIZE & 0xFF, 8);
+    put_lens(&bw, 0, 256, NULL, 0);
+    put_lens(&bw, 256, 256 + 34*8, ones, 2);
+    put_lens(&bw, 0, 249, NULL, 0);
+    put_bits(&bw, 1, 1);                    /* slot 30 match... */
+    put_bits(&bw, 2, 14);                   /* ...at offset 32768 */
+    for (i = 8; i < LZX_FRAME_SIZE; i += 8) put_bits(&bw, 0, 1);
+    put_bits(&bw, 0, 15);                   /* flush */
+
+    for (i = 0; i < 3; i++) {
+        infh.data = in;  infh.length = sizeof(in);  infh.posn = 0;
+        lzx[i] = lzxd_init(&sys, (struct mspack_file *) &infh,
+                           (struct mspack_file *) &outfh, 17, 0, 4096,
+                           LZX_FRAME_SIZE, 1);
+        TEST(lzx[i] != NULL);
+        if (i == 0) {
+            reffh.data = ref; reffh.length = sizeof(ref); reffh.posn = 0;
+            TEST(lzxd_set_reference_data(lzx[i], &sys,
+                 (struct mspack_file *) &reffh, sizeof(ref)) == MSPACK_ERR_OK);
+        }
+        else {
+            TEST(lzxd_share_reference_data(lzx[i], ref, sizeof(ref))
+                 == MSPACK_ERR_OK);
+            TEST(lzxd_set_reference_data(lzx[i], &sys,
+                 (struct mspack_file *) &reffh, sizeof(ref)) == MSPACK_ERR_ARGS);
+        }
+        outfh.data = out[i]; outfh.length = LZX_FRAME_SIZE; outfh.posn = 0;
+        TEST(lzxd_decompress(lzx[i], LZX_FRAME_SIZE) == MSPACK_ERR_OK);
+    }
+    TEST(memcmp(out[0], ref, LZX_FRAME_SIZE) == 0);
+    TEST(memcmp(out[1], ref, LZX_FRAME_SIZE) == 0);
+    TEST(memcmp(out[2], ref, LZX_FRAME_SIZE) == 0);
+    for (i = 0; i < 3; i++) lzxd_free(lzx[i]);
+
+    /* shared reference data must leave room for the output */
+    lzx[0] = lzxd_init(&sys, (struct mspack_file *) &infh,
+                       (struct mspack_file *) &outfh, 17, 0, 4096, 0, 1);
+    TEST(lzxd_share_reference_data(lzx[0], ref, 1 << 17) == MSPACK_ERR_ARGS);
+    lzxd_free(lzx[0]);
+}
+
+/* makes an LZX stream of an uncompressed frame, then a verbatim block of
+ * frames-1 frames which each copy the frame before, with matches 32768
+ * bytes back. Returns the length of the stream */
+static unsigned int make_copy_frames(unsigned char *in, unsigned char *out,
+                                     unsigned int frames)
+{
+    static const unsigned int ones[2] = { 256 + 0*8 + 6, 256 + 30*8 + 6 };
+    unsigned int i, len = (frames - 1) * LZX_FRAME_SIZE;
+    struct bit_writer bw;
+
+    bw.p = in; bw.word = bw.bits = 0;
+    put_bits(&bw, 0, 1);                    /* no E8 translation */
+    put_bits(&bw, 3, 3);                    /* uncompressed block */
+    put_bits(&bw, LZX_FRAME_SIZE >> 8, 16); /* block length */
+    put_bits(&bw, LZX_FRAME_SIZE & 0xFF, 8);
+    put_bits(&bw, 0, 4);                    /* align to 16 bits */
+    memset(bw.p, 1, 12); bw.p += 12;        /* R0, R1, R2 */
+    for (i = 0; i < LZX_FRAME_SIZE; i++) *bw.p++ = out[i] = rnd();
+    put_bits(&bw, 1, 3);                    /* verbatim block */
+    put_bits(&bw, len >> 8, 16);
+    put_bits(&bw, len & 0xFF, 8);
+    put_lens(&bw, 0, 256, NULL, 0);
+    put_lens(&bw, 256, 256 + 32*8, ones, 2);
+    put_lens(&bw, 0, 249, NULL, 0);
+    put_bits(&bw, 1, 1);                    /* slot 30 match... */
+    put_bits(&bw, 2, 14);                   /* ...at offset 32768 */
+    for (i = LZX_FRAME_SIZE + 8; i <= frames * LZX_FRAME_SIZE; i += 8) {
+        /* each frame ends on a 16-bit boundary */
+        if ((i % LZX_FRAME_SIZE) == 0 && bw.bits) put_bits(&bw, 0, 16 - bw.bits);
+        if (i < frames * LZX_FRAME_SIZE) put_bits(&bw, 0, 1);
+    }
+    for (i = LZX_FRAME_SIZE; i < frames * LZX_FRAME_SIZE; i++) {
+        out[i] = out[i - LZX_FRAME_SIZE];
+    }
+    return (unsigned int) (bw.p - in);
+}
+
+/* test that the window starts small, and grows without losing data */
+void lzxd_window_test_01() {
+    static unsigned char in[LZX_FRAME_SIZE + 8192];
+    static unsigned char expect[2 * LZX_FRAME_SIZE], out[2 * LZX_FRAME_SIZE];
+    struct mspack_system sys = *mspack_default_system;
+    struct mem_file infh, outfh;
+    struct lzxd_stream *lzx;
+
+    mem_fh_system(&sys);
+    memset(in, 0, sizeof(in));
+    make_copy_frames(in, expect, 2);
+
+    infh.data = in;   infh.length = sizeof(in);   infh.posn = 0;
+    outfh.data = out; outfh.length = sizeof(out); outfh.posn = 0;
+    lzx = lzxd_init(&sys, (struct mspack_file *) &infh,
+                    (struct mspack_file *) &outfh, 16, 0, 4096, 0, 0);
+    TEST(lzx != NULL);
+    TEST(lzx->window_alloc == LZX_FRAME_SIZE);
+    lzxd_set_output_length(lzx, sizeof(out));
+    TEST(lzxd_decompress(lzx, sizeof(out)) == MSPACK_ERR_OK);
+    TEST(lzx->window_alloc == 2 * LZX_FRAME_SIZE);
+    TEST(memcmp(out, expect, sizeof(out)) == 0);
+    lzxd_free(lzx);
+
+    /* known lengths get a window rounded up to a frame, up to the most */
+    lzx = lzxd_init(&sys, NULL, NULL, 21, 0, 4096, 40000, 0);
+    TEST(lzx != NULL && lzx->window_alloc == 2 * LZX_FRAME_SIZE);
+    lzxd_free(lzx);
+    lzx = lzxd_init(&sys, NULL, NULL, 21, 0, 4096, 3 << 20, 0);
+    TEST(lzx != NULL && lzx->window_alloc == 1 << 21);
+    lzxd_free(lzx);
+}
+
+/* test that lzxd_skip() gets to the same place as lzxd_decompress(), with
+ * E8 translated frames skipped whole or in part */
+void lzxd_skip_test_01() {
+    static unsigned char in[8 + 12 + SEEK_FRAMES * LZX_FRAME_SIZE];
+    static unsigned char expect[SEEK_FRAMES * LZX_FRAME_SIZE];
+    static unsigned char out[SEEK_FRAMES * LZX_FRAME_SIZE];
+    static const unsigned int skips[3] = { 10000, LZX_FRAME_SIZE, 90000 };
+    struct mspack_system sys = *mspack_default_system;
+    struct mem_file infh, outfh;
+    struct lzxd_stream *lzx;
+    struct bit_writer bw;
+    unsigned int i;
+
+    /* E8 filesize 1MB, an uncompressed block of every frame, R0-R2 */
+    bw.p = in; bw.word = bw.bits = 0;
+    put_bits(&bw, 1, 1);
+    put_bits(&bw, 0x10, 16); put_bits(&bw, 0, 16);
+    put_bits(&bw, 3, 3);
+    put_bits(&bw, sizeof(expect) >> 8, 16);
+    put_bits(&bw, sizeof(expect) & 0xFF, 8);
+    put_bits(&bw, 0, 4);
+    memset(bw.p, 1, 12); bw.p += 12;
+    for (i = 0; i < sizeof(expect); i++) {
+        /* half the bytes are zero, so many calls are to within the file */
+        bw.p[i] = expect[i] = !(rnd() & 7) ? 0xE8 :
+            (rnd() & 1) ? 0 : (unsigned char) rnd();
+    }
+    for (i = 0; i < SEEK_FRAMES; i++) {
+        lzxd_e8_translate(&expect[i * LZX_FRAME_SIZE], LZX_FRAME_SIZE,
+                          (int) (i * LZX_FRAME_SIZE), 0x100000, LZX_E8_SCALAR);
+    }
+
+    mem_fh_system(&sys);
+    for (i = 0; i < 3; i++) {
+        infh.data = in;    infh.length = sizeof(in);   infh.posn = 0;
+        outfh.data = out;  outfh.length = sizeof(out); outfh.posn = 0;
+        lzx = lzxd_init(&sys, (struct mspack_file *) &infh,
+                        (struct mspack_file *) &outfh, 17, 0, 4096,
+                        sizeof(expect), 0);
+        TEST(lzx != NULL);
+        TEST(lzxd_skip(lzx, skips[i]) == MSPACK_ERR_OK);
+        TEST(outfh.posn == 0);
+        TEST(lzxd_decompress(lzx, sizeof(expect) - skips[i]) == MSPACK_ERR_OK);
+        TEST(outfh.posn == sizeof(expect) - skips[i]);
+        TEST(memcmp(out, &expect[skips[i]], outfh.posn) == 0);
+        lzxd_free(lzx);
+    }
+}
+
+/* test that lzxd_step() gives the same output however its input and output
+ * are split up. The window wraps, and input runs out part way through
+ * both uncompressed and verbatim frames */
+void lzxd_step_test_01() {
+    static unsigned char in[LZX_FRAME_SIZE + 8192];
+    static unsigned char expect[4 * LZX_FRAME_SIZE], out[4 * LZX_FRAME_SIZE + 1];
+    static const unsigned int chunks[3] = { 333, 4096, sizeof(in) };
+    struct lzxd_stream *lzx;
+    struct mspack_step step;
+    unsigned int in_len, given, n, c;
+    int err;
+
+    memset(in, 0, sizeof(in));
+    in_len = make_copy_frames(in, expect, 4);
+
+    for (c = 0; c < 3; c++) {
+        lzx = lzxd_init(mspack_default_system, NULL, NULL, 16, 0, 4096,
+                        sizeof(expect), 0);
+        TEST(lzx != NULL);
+        memset(out, 0, sizeof(out));
+        step.next_in  = in;  step.avail_in  = 0;
+        step.next_out = out; step.avail_out = 0;
+        step.end_of_input = 0;
+        given = 0;
+        do {
+            /* give more output space 777 bytes at a time */
+            if (step.avail_out == 0) {
+                n = (unsigned int) (&out[sizeof(out)] - step.next_out);
+                step.avail_out = (n > 777) ? 777 : n;
+            }
+            err = lzxd_step(lzx, &step);
+            if (err == MSPACK_STEP_NEED_INPUT) {
+                n = in_len - given;
+                if (n > chunks[c]) n = chunks[c];
+                step.next_in  = &in[given];
+                step.avail_in = n;
+                given += n;
+                step.end_of_input = (given == in_len);
+            }
+        } while (err == MSPACK_ERR_OK || err == MSPACK_STEP_NEED_INPUT);
+        TEST(err == MSPACK_STEP_END);
+        TEST(step.next_out == &out[sizeof(expect)]);
+        TEST(memcmp(out, expect, sizeof(expect)) == 0);
+        lzxd_free(lzx);
+    }
+}
+
+int main() {
+  int selftest;
+
+  MSPACK_SYS_SELFTEST(selftest);
+  TEST(selftest == MSPACK_ERR_OK);
+
+  lzxd_e8_test_01();
+  lzxd_e8_test_02();
+  lzxd_copy_match_test_01();
+  lzxd_seek_test_01();
+  lzxd_checkpoint_test_01();
+  lzxd_share_test_01();
+  lzxd_window_test_01();
+  lzxd_step_test_01();
+  lzxd_skip_test_01();
+
+  printf("ALL %d TESTS PASSED.\n", test_count);
+  return 0;
+}
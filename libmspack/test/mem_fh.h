@@ -0,0 +1,59 @@
+/* an mspack_file which reads from or writes to memory, for tests and
+ * benchmarks that decode without real files. Reads come from the first
+ * length bytes of data. Writes go to data and fail if they would go past
+ * length, unless data is NULL, in which case they're only counted. posn
+ * is how far has been read or written.
+ *
+ * mem_fh_system() sets an mspack_system's read, write, seek and tell
+ * methods to the ones here. It doesn't set open or close, so files are
+ * set up by the caller and passed to the decoder directly, unless the
+ * caller provides its own open and close.
+ */
+
+#include <string.h>
+
+struct mem_file {
+    unsigned char *data;
+    size_t length, posn;
+};
+
+static int mem_read(struct mspack_file *file, void *buffer, int bytes) {
+    struct mem_file *fh = (struct mem_file *) file;
+    size_t todo = fh->length - fh->posn;
+    if (bytes < 0) return -1;
+    if (todo > (size_t) bytes) todo = (size_t) bytes;
+    memcpy(buffer, &fh->data[fh->posn], todo);
+    fh->posn += todo;
+    return (int) todo;
+}
+
+static int mem_write(struct mspack_file *file, void *buffer, int bytes) {
+    struct mem_file *fh = (struct mem_file *) file;
+    if (bytes < 0) return -1;
+    if (fh->data) {
+        if (fh->posn + bytes > fh->length) return -1;
+        memcpy(&fh->data[fh->posn], buffer, (size_t) bytes);
+    }
+    fh->posn += (size_t) bytes;
+    return bytes;
+}
+
+static int mem_seek(struct mspack_file *file, off_t offset, int mode) {
+    struct mem_file *fh = (struct mem_file *) file;
+    if (mode == MSPACK_SYS_SEEK_CUR) offset += (off_t) fh->posn;
+    if (mode == MSPACK_SYS_SEEK_END) offset += (off_t) fh->length;
+    if (offset < 0 || offset > (off_t) fh->length) return 1;
+    fh->posn = (size_t) offset;
+    return 0;
+}
+
+static off_t mem_tell(struct mspack_file *file) {
+    return (off_t) ((struct mem_file *) file)->posn;
+}
+
+static void mem_fh_system(struct mspack_system *sys) {
+    sys->read  = &mem_read;
+    sys->write = &mem_write;
+    sys->seek  = &mem_seek;
+    sys->tell  = &mem_tell;
+}
@@ -0,0 +1,212 @@
+/* MS-ZIP decompressor regression test suite */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <system.h>
+#include <mszip.h>
+#include <cab.h>
+#include <step.h>
+#include <mem_fh.h>
+
+unsigned int test_count = 0;
+#define TEST(x) do {\
+    test_count++; \
+    if ((x)) {printf("%s:%d SUCCESS %s\n",__func__,__LINE__,#x);} \
+    else {printf("%s:%d FAILED %s\n",__func__,__LINE__,#x);exit(1);} \
+} while (0)
+
+#define __tf3(x) #x
+#define __tf2(x) __tf3(x)
+#define TESTFILE(fname) (__tf2(TEST_FILES) "/" fname)
+
+/* the MS-ZIP stream of a cabinet's first folder, as its data blocks
+ * joined together, and the length of its uncompressed data */
+#define MAX_BLOCKS (8)
+struct mszip_data {
+    unsigned char data[MAX_BLOCKS * CAB_INPUTMAX];
+    size_t length, out_length;
+};
+
+/* reads the MS-ZIP stream of a cabinet's first folder. The cabinet must
+ * have no reserved space */
+static void load_folder(const char *filename, struct mszip_data *zd) {
+    static unsigned char buf[MAX_BLOCKS * (CAB_INPUTMAX + cfdata_SIZEOF) +
+                             cfhead_SIZEOF + cffold_SIZEOF];
+    size_t len, pos, csize;
+    unsigned int i, num_blocks;
+    FILE *fh;
+
+    TEST(fh = fopen(filename, "rb"));
+    len = fread(buf, 1, sizeof(buf), fh);
+    fclose(fh);
+    TEST(len > cfhead_SIZEOF + cffold_SIZEOF);
+    TEST(EndGetI16(&buf[cfhead_Flags]) == 0);
+
+    pos = cfhead_SIZEOF;
+    TEST((EndGetI16(&buf[pos + cffold_CompType]) & cffoldCOMPTYPE_MASK)
+         == cffoldCOMPTYPE_MSZIP);
+    num_blocks = EndGetI16(&buf[pos + cffold_NumBlocks]);
+    TEST(num_blocks > 0 && num_blocks <= MAX_BLOCKS);
+    pos = EndGetI32(&buf[pos + cffold_DataOffset]);
+
+    zd->length = zd->out_length = 0;
+    for (i = 0; i < num_blocks; i++) {
+        TEST(pos + cfdata_SIZEOF <= len);
+        csize = EndGetI16(&buf[pos + cfdata_CompressedSize]);
+        zd->out_length += EndGetI16(&buf[pos + cfdata_UncompressedSize]);
+        pos += cfdata_SIZEOF;
+        TEST(pos + csize <= len);
+        memcpy(&zd->data[zd->length], &buf[pos], csize);
+        zd->length += csize;
+        pos += csize;
+    }
+}
+
+/* decodes an MS-ZIP stream with mszipd_decompress(). Returns the error */
+static int decode(struct mszip_data *zd, unsigned char *out, int repair) {
+    struct mspack_system sys = *mspack_default_system;
+    struct mem_file infh, outfh;
+    struct mszipd_stream *zip;
+    int err;
+
+    mem_fh_system(&sys);
+    infh.data  = zd->data; infh.length  = zd->length;
+    outfh.data = out;      outfh.length = zd->out_length;
+    infh.posn = outfh.posn = 0;
+    zip = mszipd_init(&sys, (struct mspack_file *) &infh,
+                      (struct mspack_file *) &outfh, 4096, repair);
+    TEST(zip != NULL);
+    err = mszipd_decompress(zip, (off_t) zd->out_length);
+    mszipd_free(zip);
+    return err;
+}
+
+/* decodes an MS-ZIP stream with mszipd_step(), giving it in_chunk bytes
+ * of input and out_chunk bytes of output space at a time. Returns the
+ * error */
+static int step_decode(struct mszipd_stream *zip, struct mszip_data *zd,
+                       unsigned char *out, unsigned int in_chunk,
+                       unsigned int out_chunk)
+{
+    struct mspack_step step;
+    unsigned int given = 0, n;
+    int err;
+
+    step.next_in  = zd->data; step.avail_in  = 0;
+    step.next_out = out;      step.avail_out = 0;
+    step.end_of_input = 0;
+    do {
+        if (step.avail_out == 0) {
+            n = (unsigned int) (&out[zd->out_length] - step.next_out);
+            step.avail_out = (n > out_chunk) ? out_chunk : n;
+        }
+        err = mszipd_step(zip, &step);
+        if (err == MSPACK_STEP_NEED_INPUT) {
+            n = (unsigned int) zd->length - given;
+            if (n > in_chunk) n = in_chunk;
+            step.next_in  = &zd->data[given];
+            step.avail_in = n;
+            given += n;
+            step.end_of_input = (given == zd->length);
+        }
+    } while ((err == MSPACK_ERR_OK || err == MSPACK_STEP_NEED_INPUT) &&
+             step.next_out < &out[zd->out_length]);
+    TEST(step.next_out == &out[zd->out_length]);
+    return err;
+}
+
+/* test that mszipd_step() decodes the same as mszipd_decompress(), when
+ * given input and output space a little at a time, so blocks are decoded
+ * again after running out of input part way through them. In the second
+ * file, the second block copies from window positions it writes over, so
+ * it's only decoded again correctly if the window is restored */
+void mszipd_step_test_01() {
+    static const char *files[2] = {
+        TESTFILE("mszip_3blocks.cab"), TESTFILE("mszip_crossblock.cab")
+    };
+    static const unsigned int chunks[3][2] = {
+        { 64, 777 }, { 333, 32768 }, { 100000, 1 }
+    };
+    static struct mszip_data zd;
+    static unsigned char expect[MAX_BLOCKS * CAB_BLOCKMAX];
+    static unsigned char out[MAX_BLOCKS * CAB_BLOCKMAX];
+    struct mszipd_stream *zip;
+    int f, c;
+
+    for (f = 0; f < 2; f++) {
+        load_folder(files[f], &zd);
+        TEST(decode(&zd, expect, 0) == MSPACK_ERR_OK);
+
+        for (c = 0; c < 3; c++) {
+            zip = mszipd_init(mspack_default_system, NULL, NULL, 4096, 0);
+            TEST(zip != NULL);
+            memset(out, 0, sizeof(out));
+            TEST(step_decode(zip, &zd, out, chunks[c][0], chunks[c][1])
+                 == MSPACK_ERR_OK);
+            TEST(memcmp(out, expect, zd.out_length) == 0);
+            mszipd_free(zip);
+        }
+    }
+}
+
+/* test that running out of input in mszipd_step() isn't taken as damage
+ * in repair mode, so only really damaged blocks are repaired and counted,
+ * and the repair limit isn't used up by input shortfalls */
+void mszipd_step_test_02() {
+    static const unsigned int in_chunks[3] = { 64, 333, 100000 };
+    static struct mszip_data zd;
+    static unsigned char expect[MAX_BLOCKS * CAB_BLOCKMAX];
+    static unsigned char out[MAX_BLOCKS * CAB_BLOCKMAX];
+    struct mszipd_stream *zip;
+    int c;
+
+    /* valid data: nothing repaired */
+    load_folder(TESTFILE("mszip_3blocks.cab"), &zd);
+    TEST(decode(&zd, expect, 0) == MSPACK_ERR_OK);
+    for (c = 0; c < 3; c++) {
+        zip = mszipd_init(mspack_default_system, NULL, NULL, 4096, 1);
+        TEST(zip != NULL);
+        memset(out, 0, sizeof(out));
+        TEST(step_decode(zip, &zd, out, in_chunks[c], 777) == MSPACK_ERR_OK);
+        TEST(memcmp(out, expect, zd.out_length) == 0);
+        TEST(zip->block == 3);
+        TEST(zip->repaired_blocks == 0);
+        TEST(zip->repaired_bytes == 0);
+        mszipd_free(zip);
+    }
+
+    /* two damaged blocks: both are repaired, within a limit of two */
+    load_folder(TESTFILE("mszip_2badblocks.cab"), &zd);
+    TEST(decode(&zd, expect, 1) == MSPACK_ERR_OK);
+    for (c = 0; c < 3; c++) {
+        zip = mszipd_init(mspack_default_system, NULL, NULL, 4096, 1);
+        TEST(zip != NULL);
+        zip->max_repairs = 2;
+        memset(out, 0, sizeof(out));
+        TEST(step_decode(zip, &zd, out, in_chunks[c], 777) == MSPACK_ERR_OK);
+        TEST(memcmp(out, expect, zd.out_length) == 0);
+        TEST(zip->block == 3);
+        TEST(zip->repaired_blocks == 2);
+        TEST(zip->first_repaired == 1);
+        TEST(zip->repaired_bytes > 0);
+        mszipd_free(zip);
+    }
+}
+
+int main() {
+  int selftest;
+
+  MSPACK_SYS_SELFTEST(selftest);
+  TEST(selftest == MSPACK_ERR_OK);
+
+  mszipd_step_test_01();
+  mszipd_step_test_02();
+
+  printf("ALL %d TESTS PASSED.\n", test_count);
+  return 0;
+}
@@ -0,0 +1,412 @@
+/* qtm_synth.h: makes synthetic Quantum streams for testing and
+ * benchmarking the Quantum decompressor, which otherwise can only be fed
+ * with the few Quantum cabinets there are.
+ *
+ * qtm_synth_data() makes repeatable data with a mixture of text, random
+ * bytes and copies of earlier data from near and far, so every literal
+ * model, match model and position slot gets used.
+ *
+ * qtm_synth_compress() is a minimal Quantum compressor. It isn't meant to
+ * compress well, only correctly; each 32k frame is flushed, aligned to a
+ * byte and followed by an 0xFF trailer, just as qtmd_decompress() sees
+ * CAB Quantum data blocks after cabd.c has added its trailer byte.
+ */
+
+#ifndef QTM_SYNTH_H
+#define QTM_SYNTH_H 1
+
+#include <stdlib.h>
+#include <string.h>
+
+/* the decompressor can read a few bytes past the end of the stream,
+ * so this many zero bytes are kept after it */
+#define QTM_SYNTH_PAD (8)
+
+/* the size of a Quantum frame */
+#define QTM_SYNTH_FRAME (32768)
+
+/* a Quantum stream made by qtm_synth_compress() */
+struct qtm_synth {
+    unsigned char *data;   /* compressed data, followed by padding */
+    size_t length;         /* compressed length, without padding   */
+    unsigned long symbols; /* number of literals and matches       */
+};
+
+static unsigned int qtm_synth_rnd(unsigned int *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static void qtm_synth_data(unsigned char *buf, size_t length,
+                           unsigned int seed)
+{
+    static const char text[] = "etaoin shrdlu cmfwyp vbgkqjxz\n";
+    size_t i = 0, offset, len, max;
+    unsigned int kind;
+
+    while (i < length) {
+        kind = qtm_synth_rnd(&seed) % 16;
+        if (kind < 5 && i > 300) {
+            /* copy earlier data, from up to 2MB back */
+            max = (size_t) 4 << (qtm_synth_rnd(&seed) % 20);
+            if (max > i) max = i;
+            offset = 1 + qtm_synth_rnd(&seed) % max;
+            len = (qtm_synth_rnd(&seed) % 8) ? 3 + qtm_synth_rnd(&seed) % 30
+                                              : 3 + qtm_synth_rnd(&seed) % 300;
+            for (; len > 0 && i < length; len--, i++) buf[i] = buf[i - offset];
+        }
+        else if (kind < 8) {
+            buf[i++] = (unsigned char) qtm_synth_rnd(&seed);
+        }
+        else {
+            buf[i++] = text[qtm_synth_rnd(&seed) % (sizeof(text) - 1)];
+        }
+    }
+}
+
+/* the compressor's view of a model, the same as the original
+ * qtmd_modelsym: symbols in order of cumfreq */
+struct qtm_synth_sym { unsigned short sym, cumfreq; };
+struct qtm_synth_model {
+    int shiftsleft, entries;
+    struct qtm_synth_sym syms[65];
+};
+
+/* extra bits, written after a given number of arithmetic coder shifts */
+struct qtm_synth_extra { size_t at; unsigned int value; int bits; };
+
+struct qtm_synth_state {
+    struct qtm_synth_model model[9];
+    unsigned int L, H, underflow;
+    /* the current frame's arithmetic coder output, one bit per byte */
+    unsigned char *abits;
+    size_t abits_len, abits_size, shifts;
+    struct qtm_synth_extra *extra;
+    size_t extra_len, extra_size;
+    /* the output stream */
+    unsigned char *out;
+    size_t out_len, out_size;
+    unsigned int bitbuf;
+    int bitsleft, error;
+};
+
+static const unsigned int qtm_synth_position_base[42] = {
+    0, 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512,
+    768, 1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384, 24576, 32768,
+    49152, 65536, 98304, 131072, 196608, 262144, 393216, 524288, 786432,
+    1048576, 1572864
+};
+static const unsigned char qtm_synth_extra_bits[42] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+    11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18, 19, 19
+};
+static const unsigned char qtm_synth_length_base[27] = {
+    0, 1, 2, 3, 4, 5, 6, 8, 10, 12, 14, 18, 22, 26,
+    30, 38, 46, 54, 62, 78, 94, 110, 126, 158, 190, 222, 254
+};
+static const unsigned char qtm_synth_length_extra[27] = {
+    0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static void qtm_synth_init_model(struct qtm_synth_model *model,
+                                 int start, int len)
+{
+    int i;
+    model->shiftsleft = 4;
+    model->entries    = len;
+    for (i = 0; i <= len; i++) {
+        model->syms[i].sym     = (unsigned short) (start + i);
+        model->syms[i].cumfreq = (unsigned short) (len - i);
+    }
+}
+
+/* the same as the original qtmd_update_model() */
+static void qtm_synth_update_model(struct qtm_synth_model *model) {
+    struct qtm_synth_sym tmp;
+    int i, j;
+
+    if (--model->shiftsleft) {
+        for (i = model->entries - 1; i >= 0; i--) {
+            model->syms[i].cumfreq >>= 1;
+            if (model->syms[i].cumfreq <= model->syms[i+1].cumfreq) {
+                model->syms[i].cumfreq = model->syms[i+1].cumfreq + 1;
+            }
+        }
+    }
+    else {
+        model->shiftsleft = 50;
+        for (i = 0; i < model->entries; i++) {
+            model->syms[i].cumfreq -= model->syms[i+1].cumfreq;
+            model->syms[i].cumfreq++;
+            model->syms[i].cumfreq >>= 1;
+        }
+        for (i = 0; i < model->entries - 1; i++) {
+            for (j = i + 1; j < model->entries; j++) {
+                if (model->syms[i].cumfreq < model->syms[j].cumfreq) {
+                    tmp = model->syms[i];
+                    model->syms[i] = model->syms[j];
+                    model->syms[j] = tmp;
+                }
+            }
+        }
+        for (i = model->entries - 1; i >= 0; i--) {
+            model->syms[i].cumfreq += model->syms[i+1].cumfreq;
+        }
+    }
+}
+
+static void *qtm_synth_grow(void *buf, size_t *size, size_t elem, int *error) {
+    void *n = realloc(buf, (*size * 2 + 1024) * elem);
+    if (!n) {
+        *error = 1;
+        return buf;
+    }
+    *size = *size * 2 + 1024;
+    return n;
+}
+
+static void qtm_synth_abit(struct qtm_synth_state *s, unsigned int bit) {
+    if (s->abits_len == s->abits_size) {
+        s->abits = (unsigned char *) qtm_synth_grow(s->abits, &s->abits_size,
+                                                    1, &s->error);
+        if (s->error) return;
+    }
+    s->abits[s->abits_len++] = (unsigned char) bit;
+}
+
+static void qtm_synth_put_extra(struct qtm_synth_state *s,
+                                int bits, unsigned int value)
+{
+    if (!bits) return;
+    if (s->extra_len == s->extra_size) {
+        s->extra = (struct qtm_synth_extra *) qtm_synth_grow(s->extra,
+            &s->extra_size, sizeof(struct qtm_synth_extra), &s->error);
+        if (s->error) return;
+    }
+    s->extra[s->extra_len].at    = s->shifts;
+    s->extra[s->extra_len].value = value;
+    s->extra[s->extra_len].bits  = bits;
+    s->extra_len++;
+}
+
+/* the inverse of the decompressor's GET_SYMBOL() */
+static void qtm_synth_encode(struct qtm_synth_state *s, int m, int value) {
+    struct qtm_synth_model *model = &s->model[m];
+    unsigned int range = (s->H - s->L) + 1, total = model->syms[0].cumfreq;
+    int i, j;
+
+    for (i = 0; model->syms[i].sym != value; i++);
+    s->H = (s->L + (model->syms[i].cumfreq * range) / total - 1) & 0xFFFF;
+    s->L = (s->L + (model->syms[i+1].cumfreq * range) / total) & 0xFFFF;
+
+    for (j = 0; j <= i; j++) model->syms[j].cumfreq += 8;
+    if (model->syms[0].cumfreq > 3800) qtm_synth_update_model(model);
+
+    for (;;) {
+        if (!((s->L ^ s->H) & 0x8000)) {
+            unsigned int bit = s->L >> 15;
+            qtm_synth_abit(s, bit);
+            for (; s->underflow; s->underflow--) qtm_synth_abit(s, !bit);
+        }
+        else if ((s->L & 0x4000) && !(s->H & 0x4000)) {
+            s->underflow++;
+            s->L &= 0x3FFF;
+            s->H |= 0x4000;
+        }
+        else {
+            break;
+        }
+        s->L = (s->L << 1) & 0xFFFF;
+        s->H = ((s->H << 1) | 1) & 0xFFFF;
+        s->shifts++;
+    }
+}
+
+static void qtm_synth_obits(struct qtm_synth_state *s,
+                            unsigned int value, int bits)
+{
+    while (bits-- > 0) {
+        s->bitbuf = (s->bitbuf << 1) | ((value >> bits) & 1);
+        if (++s->bitsleft == 8) {
+            if (s->out_len == s->out_size) {
+                s->out = (unsigned char *) qtm_synth_grow(s->out,
+                    &s->out_size, 1, &s->error);
+                if (s->error) return;
+            }
+            s->out[s->out_len++] = (unsigned char) s->bitbuf;
+            s->bitbuf = 0;
+            s->bitsleft = 0;
+        }
+    }
+}
+
+static void qtm_synth_frame_start(struct qtm_synth_state *s) {
+    s->L = 0; s->H = 0xFFFF; s->underflow = 0;
+    s->shifts = s->abits_len = s->extra_len = 0;
+}
+
+/* flushes the arithmetic coder, then writes its bits with the extra bits
+ * interleaved where the decompressor will read them: the decompressor
+ * reads 16 bits ahead of the arithmetic coder's current position */
+static void qtm_synth_frame_end(struct qtm_synth_state *s) {
+    unsigned int bit = (s->L & 0x4000) ? 1 : 0;
+    size_t i, e = 0;
+
+    s->underflow++;
+    qtm_synth_abit(s, bit);
+    for (; s->underflow; s->underflow--) qtm_synth_abit(s, !bit);
+    while (s->abits_len < s->shifts + 16) qtm_synth_abit(s, 0);
+    if (s->error) return;
+
+    for (i = 0; i < s->shifts + 16; i++) {
+        for (; i >= 16 && e < s->extra_len && s->extra[e].at == i - 16; e++) {
+            qtm_synth_obits(s, s->extra[e].value, s->extra[e].bits);
+        }
+        qtm_synth_obits(s, s->abits[i], 1);
+    }
+    for (; e < s->extra_len; e++) {
+        qtm_synth_obits(s, s->extra[e].value, s->extra[e].bits);
+    }
+    qtm_synth_obits(s, 0, (8 - s->bitsleft) & 7);
+    qtm_synth_obits(s, 0xFF, 8);
+}
+
+static int qtm_synth_slot(unsigned int value, int entries) {
+    int slot = entries - 1;
+    while (slot > 0 && qtm_synth_position_base[slot] > value) slot--;
+    return slot;
+}
+
+#define QTM_SYNTH_HASH(p) \
+    (((p)[0] * 506832829U ^ (p)[1] * 2654435761U ^ (p)[2]) >> 16)
+
+/* compresses in[0..length-1] with the given window size (10 to 21 bits).
+ * Returns zero and fills in out on success, non-zero if out of memory. */
+static int qtm_synth_compress(struct qtm_synth *out, const unsigned char *in,
+                              size_t length, int window_bits)
+{
+    struct qtm_synth_state s;
+    unsigned int window_size = 1U << window_bits, value, hash;
+    unsigned int max_offset = window_size - 260;
+    int *head, *prev, i, slot, tries;
+    size_t pos = 0, frame_start = 0, best_len, best_off, off, len, max;
+
+    memset(&s, 0, sizeof(s));
+    memset(out, 0, sizeof(*out));
+    head = (int *) malloc(65536 * sizeof(int));
+    prev = (int *) malloc((length + 1) * sizeof(int));
+    if (!head || !prev) {
+        free(head);
+        free(prev);
+        return 1;
+    }
+    for (i = 0; i < 65536; i++) head[i] = -1;
+
+    i = window_bits * 2;
+    qtm_synth_init_model(&s.model[0], 0, 64);
+    qtm_synth_init_model(&s.model[1], 64, 64);
+    qtm_synth_init_model(&s.model[2], 128, 64);
+    qtm_synth_init_model(&s.model[3], 192, 64);
+    qtm_synth_init_model(&s.model[4], 0, (i > 24) ? 24 : i);
+    qtm_synth_init_model(&s.model[5], 0, (i > 36) ? 36 : i);
+    qtm_synth_init_model(&s.model[6], 0, i);
+    qtm_synth_init_model(&s.model[7], 0, 27);
+    qtm_synth_init_model(&s.model[8], 0, 7);
+    qtm_synth_frame_start(&s);
+
+    while (pos < length && !s.error) {
+        /* find the longest match, within the window and this frame */
+        best_len = best_off = 0;
+        if (pos + 3 <= length) {
+            hash = QTM_SYNTH_HASH(&in[pos]);
+            for (i = head[hash], tries = 8; i >= 0 && tries > 0;
+                 i = prev[i], tries--)
+            {
+                off = pos - (size_t) i;
+                if (off > max_offset) break;
+                max = length - pos;
+                if (max > 258) max = 258;
+                if (max > QTM_SYNTH_FRAME - (pos - frame_start)) {
+                    max = QTM_SYNTH_FRAME - (pos - frame_start);
+                }
+                for (len = 0; len < max && in[i + len] == in[pos + len]; len++);
+                /* short matches can't reach as far */
+                if (len == 3 && off > 4096) len = 0;
+                if (len == 4 && off > 262144) len = 0;
+                if (len > best_len) {
+                    best_len = len;
+                    best_off = off;
+                }
+            }
+        }
+
+        if (best_len >= 3) {
+            value = (unsigned int) best_off - 1;
+            if (best_len == 3) {
+                qtm_synth_encode(&s, 8, 4);
+                slot = qtm_synth_slot(value, s.model[4].entries);
+                qtm_synth_encode(&s, 4, slot);
+            }
+            else if (best_len == 4) {
+                qtm_synth_encode(&s, 8, 5);
+                slot = qtm_synth_slot(value, s.model[5].entries);
+                qtm_synth_encode(&s, 5, slot);
+            }
+            else {
+                unsigned int lvalue = (unsigned int) best_len - 5;
+                for (i = 25; i > 0 && qtm_synth_length_base[i] > lvalue; i--);
+                qtm_synth_encode(&s, 8, 6);
+                qtm_synth_encode(&s, 7, i);
+                qtm_synth_put_extra(&s, qtm_synth_length_extra[i],
+                                    lvalue - qtm_synth_length_base[i]);
+                slot = qtm_synth_slot(value, s.model[6].entries);
+                qtm_synth_encode(&s, 6, slot);
+            }
+            qtm_synth_put_extra(&s, qtm_synth_extra_bits[slot],
+                                value - qtm_synth_position_base[slot]);
+        }
+        else {
+            qtm_synth_encode(&s, 8, in[pos] >> 6);
+            qtm_synth_encode(&s, in[pos] >> 6, in[pos]);
+            best_len = 1;
+        }
+        out->symbols++;
+
+        for (; best_len > 0; best_len--, pos++) {
+            if (pos + 3 <= length) {
+                hash = QTM_SYNTH_HASH(&in[pos]);
+                prev[pos] = head[hash];
+                head[hash] = (int) pos;
+            }
+        }
+        if (pos - frame_start == QTM_SYNTH_FRAME || pos == length) {
+            qtm_synth_frame_end(&s);
+            qtm_synth_frame_start(&s);
+            frame_start = pos;
+        }
+    }
+
+    /* add padding */
+    for (i = 0; i < QTM_SYNTH_PAD * 8 && !s.error; i += 8) {
+        qtm_synth_obits(&s, 0, 8);
+    }
+    free(head);
+    free(prev);
+    free(s.abits);
+    free(s.extra);
+    if (s.error) {
+        free(s.out);
+        return 1;
+    }
+    out->data   = s.out;
+    out->length = s.out_len - QTM_SYNTH_PAD;
+    return 0;
+}
+
+static void qtm_synth_free(struct qtm_synth *s) {
+    free(s->data);
+    s->data = NULL;
+}
+
+#endif
@@ -0,0 +1,279 @@
+/* qtmd_bench: measures how quickly qtmd_decompress() decodes Quantum
+ * streams, at every window size from 10 to 21 bits.
+ *
+ * Synthetic data from qtm_synth.h is compressed at each window size and
+ * decoded. The Quantum folders of any CAB files given are decoded as they
+ * are, then their contents are also compressed at each window size and
+ * decoded. All streams are decoded from and to memory, so only the
+ * Quantum decoder is measured.
+ *
+ * For each stream, the speed, the time per decoded symbol (literal or
+ * match) where the number of symbols is known, and the MD5 of the output
+ * are shown. Output that differs from what was compressed is reported as
+ * a MISMATCH, and the exit code is non-zero. test/qtmd_test.c has the
+ * reference MD5s for the synthetic streams.
+ *
+ * usage: qtmd_bench [-n repeats] [-s synthetic size] [CAB files]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <system.h>
+#include <qtm.h>
+#include <cab.h>
+#include <md5.h>
+#include <qtm_synth.h>
+#include <mem_fh.h>
+
+static void m_msg(struct mspack_file *file, const char *format, ...) {
+}
+static void *m_alloc(struct mspack_system *self, size_t bytes) {
+    return malloc(bytes);
+}
+static void m_free(void *buffer) {
+    free(buffer);
+}
+static void m_copy(void *src, void *dest, size_t bytes) {
+    memcpy(dest, src, bytes);
+}
+
+static struct mspack_system mem_system = {
+    NULL, NULL, NULL, NULL, NULL, NULL,
+    &m_msg, &m_alloc, &m_free, &m_copy, NULL
+};
+
+static int repeats = 1, failed = 0;
+static off_t total_bytes = 0;
+static clock_t total_ticks = 0;
+
+/* decodes a Quantum stream repeatedly into out, and reports on it. If
+ * expect is not NULL, the output must be the same as it */
+static void bench(const char *name, unsigned char *in, size_t in_len,
+                  unsigned char *out, size_t out_len, int window_bits,
+                  unsigned long symbols, const unsigned char *expect)
+{
+    struct mem_file infh, outfh;
+    struct qtmd_stream *qtm;
+    unsigned char md5[16];
+    clock_t ticks = 0;
+    double secs, mb;
+    int err = MSPACK_ERR_OK, i;
+
+    for (i = 0; i < repeats && err == MSPACK_ERR_OK; i++) {
+        infh.data  = in;  infh.length  = in_len;  infh.posn  = 0;
+        outfh.data = out; outfh.length = out_len; outfh.posn = 0;
+        ticks -= clock();
+        qtm = qtmd_init(&mem_system, (struct mspack_file *) &infh,
+                        (struct mspack_file *) &outfh, window_bits, 4096);
+        err = qtm ? qtmd_decompress(qtm, (off_t) out_len) : MSPACK_ERR_NOMEMORY;
+        qtmd_free(qtm);
+        ticks += clock();
+    }
+    if (err) {
+        printf("%s: Quantum error %d\n", name, err);
+        failed = 1;
+        return;
+    }
+
+    secs = (double) ticks / CLOCKS_PER_SEC;
+    mb = (double) out_len * repeats / (1024.0 * 1024.0);
+    printf("%9.2f MB %8.3f s %9.2f MB/s ", mb, secs,
+           (secs > 0) ? mb / secs : 0.0);
+    if (symbols) {
+        printf("%7.2f ns/sym ", secs * 1e9 / ((double) symbols * repeats));
+    }
+    else {
+        printf("%7s ns/sym ", "-");
+    }
+    md5_buffer((const char *) out, out_len, md5);
+    for (i = 0; i < 16; i++) printf("%02x", md5[i]);
+    printf("  %s", name);
+    if (expect && memcmp(out, expect, out_len)) {
+        printf(" MISMATCH");
+        failed = 1;
+    }
+    printf("\n");
+    total_bytes += (off_t) out_len * repeats;
+    total_ticks += ticks;
+}
+
+/* compresses data at every window size, and decodes it */
+static void bench_all_windows(const char *name, unsigned char *data,
+                              size_t length)
+{
+    struct qtm_synth s;
+    unsigned char *out;
+    char label[300];
+    int wb;
+
+    if (!(out = (unsigned char *) malloc(length ? length : 1))) {
+        fprintf(stderr, "%s: out of memory\n", name);
+        failed = 1;
+        return;
+    }
+    for (wb = 10; wb <= 21; wb++) {
+        if (qtm_synth_compress(&s, data, length, wb)) {
+            fprintf(stderr, "%s: out of memory\n", name);
+            failed = 1;
+            break;
+        }
+        sprintf(label, "%.250s, %d bits", name, wb);
+        bench(label, s.data, s.length + QTM_SYNTH_PAD, out, length, wb,
+              s.symbols, data);
+        qtm_synth_free(&s);
+    }
+    free(out);
+}
+
+/* finds the Quantum folders in a cabinet. Each folder's data blocks are
+ * joined together, with the trailer byte cabd.c adds after each, to make
+ * one Quantum stream. This is decoded, and its output is compressed again
+ * at every window size */
+static void bench_cab(const char *filename, unsigned char *buf, size_t len) {
+    unsigned int num_folders, flags, i, j, num_blocks, csize, comp_type;
+    unsigned int head_res = 0, fold_res = 0, data_res = 0, found = 0;
+    size_t pos = cfhead_SIZEOF, data_pos, data_len, out_len;
+    unsigned char *data, *out;
+    char label[300];
+
+    if (len < cfhead_SIZEOF || memcmp(buf, "MSCF", 4)) goto bad;
+    num_folders = EndGetI16(&buf[cfhead_NumFolders]);
+    flags = EndGetI16(&buf[cfhead_Flags]);
+    if (flags & cfheadRESERVE_PRESENT) {
+        if (len < pos + cfheadext_SIZEOF) goto bad;
+        head_res = EndGetI16(&buf[pos + cfheadext_HeaderReserved]);
+        fold_res = buf[pos + cfheadext_FolderReserved];
+        data_res = buf[pos + cfheadext_DataReserved];
+        pos += cfheadext_SIZEOF + head_res;
+    }
+    /* skip previous and next cabinet names and disk names */
+    for (i = ((flags & cfheadPREV_CABINET) ? 2 : 0) +
+             ((flags & cfheadNEXT_CABINET) ? 2 : 0); i > 0; i--)
+    {
+        while (pos < len && buf[pos]) pos++;
+        pos++;
+    }
+
+    for (i = 0; i < num_folders; i++, pos += cffold_SIZEOF + fold_res) {
+        if (pos + cffold_SIZEOF > len) goto bad;
+        comp_type = EndGetI16(&buf[pos + cffold_CompType]);
+        if ((comp_type & cffoldCOMPTYPE_MASK) != cffoldCOMPTYPE_QUANTUM) continue;
+        num_blocks = EndGetI16(&buf[pos + cffold_NumBlocks]);
+        data_pos = EndGetI32(&buf[pos + cffold_DataOffset]);
+
+        data = (unsigned char *) malloc(num_blocks * (CAB_INPUTMAX + 1) +
+                                        QTM_SYNTH_PAD);
+        if (!data) goto bad;
+        data_len = out_len = 0;
+        for (j = 0; j < num_blocks; j++) {
+            if (data_pos + cfdata_SIZEOF + data_res > len) break;
+            csize = EndGetI16(&buf[data_pos + cfdata_CompressedSize]);
+            out_len += EndGetI16(&buf[data_pos + cfdata_UncompressedSize]);
+            data_pos += cfdata_SIZEOF + data_res;
+            if (data_pos + csize > len || csize > CAB_INPUTMAX) break;
+            memcpy(&data[data_len], &buf[data_pos], csize);
+            data_len += csize;
+            data[data_len++] = 0xFF;
+            data_pos += csize;
+        }
+        memset(&data[data_len], 0, QTM_SYNTH_PAD);
+        if (j < num_blocks || !(out = (unsigned char *) malloc(out_len + 1))) {
+            free(data);
+            goto bad;
+        }
+
+        sprintf(label, "%.250s, folder %u", filename, i);
+        bench(label, data, data_len + QTM_SYNTH_PAD, out, out_len,
+              (comp_type >> 8) & 0x1F, 0, NULL);
+        bench_all_windows(label, out, out_len);
+        free(out);
+        free(data);
+        found++;
+    }
+    if (found) return;
+bad:
+    fprintf(stderr, "%s: not a CAB file, or Quantum data not found\n",
+            filename);
+    failed = 1;
+}
+
+/* reads a file into memory */
+static unsigned char *load(const char *filename, size_t *len) {
+    unsigned char *buf = NULL;
+    FILE *fh;
+    long size;
+
+    *len = 0;
+    if ((fh = fopen(filename, "rb"))) {
+        if (!fseek(fh, 0, SEEK_END) && (size = ftell(fh)) > 0 &&
+            !fseek(fh, 0, SEEK_SET) && (buf = (unsigned char *) malloc(size)))
+        {
+            *len = fread(buf, 1, (size_t) size, fh);
+        }
+        fclose(fh);
+    }
+    if (*len == 0) {
+        fprintf(stderr, "%s: can't read file\n", filename);
+        free(buf);
+        failed = 1;
+        return NULL;
+    }
+    return buf;
+}
+
+int main(int argc, char *argv[]) {
+    size_t synth_len = 4 * 1024 * 1024, len;
+    unsigned char *buf;
+    double secs;
+    int err;
+
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    /* if self-test reveals an error */
+    MSPACK_SYS_SELFTEST(err);
+    if (err) return 1;
+    mem_fh_system(&mem_system);
+
+    for (argv++; argv[0] && argv[1] && argv[0][0] == '-'; argv += 2) {
+        if (!strcmp(argv[0], "-n")) {
+            repeats = atoi(argv[1]);
+            if (repeats < 1) repeats = 1;
+        }
+        else if (!strcmp(argv[0], "-s")) {
+            synth_len = (size_t) atol(argv[1]);
+        }
+        else break;
+    }
+
+    if (synth_len > 0) {
+        if ((buf = (unsigned char *) malloc(synth_len))) {
+            qtm_synth_data(buf, synth_len, 1);
+            bench_all_windows("synthetic", buf, synth_len);
+            free(buf);
+        }
+        else {
+            fprintf(stderr, "synthetic: out of memory\n");
+            failed = 1;
+        }
+    }
+
+    for (; *argv; argv++) {
+        if ((buf = load(*argv, &len))) {
+            bench_cab(*argv, buf, len);
+            free(buf);
+        }
+    }
+
+    secs = (double) total_ticks / CLOCKS_PER_SEC;
+    printf("%9.2f MB %8.3f s %9.2f MB/s  total\n",
+           (double) total_bytes / (1024.0 * 1024.0), secs,
+           (secs > 0) ? (double) total_bytes / (1024.0 * 1024.0) / secs : 0);
+    return failed;
+}
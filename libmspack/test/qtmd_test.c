@@ -0,0 +1,243 @@
+/* Quantum decompressor regression test suite */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <system.h>
+#include <qtm.h>
+#include <step.h>
+#include <md5.h>
+#include <qtm_synth.h>
+#include <mem_fh.h>
+
+unsigned int test_count = 0;
+#define TEST(x) do {\
+    test_count++; \
+    if ((x)) {printf("%s:%d SUCCESS %s\n",__func__,__LINE__,#x);} \
+    else {printf("%s:%d FAILED %s\n",__func__,__LINE__,#x);exit(1);} \
+} while (0)
+
+/* the reference vectors: VECTOR_LEN bytes of qtm_synth_data(), seed 1,
+ * compressed by qtm_synth_compress() with each window size. If the
+ * compressed MD5s change, the vectors have changed, not the decoder */
+#define VECTOR_LEN (400000)
+#define VECTOR_SEED (1)
+static const char *vector_data_md5 = "0de7f97fb108eb31e8c92edcdc1d7ac9";
+static const char *vector_md5[12] = {
+    "88247b0cc3a2f7e4a4efcbd28775004c", /* 10 bits */
+    "73d990b4c13ab068c84810dd37d07c7e", /* 11 bits */
+    "bc94852099d89646093f04d258aff32e", /* 12 bits */
+    "edcff0ccfa85855ec99c51d1f4f2da78", /* 13 bits */
+    "dd8ceeb75341be1132ca9f8610f2568f", /* 14 bits */
+    "686c562027f11e315aff21954389b861", /* 15 bits */
+    "66096d596d302ce4eb308b1e2e647554", /* 16 bits */
+    "f55f183c0db1737fc7c2b8a2ecfaa25e", /* 17 bits */
+    "07342eacfaa02acef168743349bf36b9", /* 18 bits */
+    "f13b6de0f146c88d042082e0968d1e4d", /* 19 bits */
+    "b633fbc282be1767da0996d6f78081de", /* 20 bits */
+    "ac6a88ca38198777b66d571dbd04992a"  /* 21 bits */
+};
+
+static void md5_hex(const void *data, size_t length, char *out) {
+    unsigned char md5[16];
+    int i;
+    md5_buffer((const char *) data, length, md5);
+    for (i = 0; i < 16; i++) sprintf(&out[i * 2], "%02x", md5[i]);
+}
+
+/* test that the reference vectors are what they should be, then that
+ * qtmd_decompress() decodes them exactly at every window size */
+void qtmd_vectors_test_01() {
+    static unsigned char data[VECTOR_LEN], out[VECTOR_LEN];
+    struct mspack_system sys = *mspack_default_system;
+    struct mem_file infh, outfh;
+    struct qtmd_stream *qtm;
+    struct qtm_synth s;
+    char md5[33];
+    int wb;
+
+    mem_fh_system(&sys);
+    qtm_synth_data(data, VECTOR_LEN, VECTOR_SEED);
+    md5_hex(data, VECTOR_LEN, md5);
+    TEST(strcmp(md5, vector_data_md5) == 0);
+
+    for (wb = 10; wb <= 21; wb++) {
+        TEST(qtm_synth_compress(&s, data, VECTOR_LEN, wb) == 0);
+        md5_hex(s.data, s.length, md5);
+        TEST(strcmp(md5, vector_md5[wb - 10]) == 0);
+
+        infh.data  = s.data; infh.length  = s.length + QTM_SYNTH_PAD;
+        outfh.data = out;    outfh.length = sizeof(out);
+        infh.posn = outfh.posn = 0;
+        memset(out, 0, sizeof(out));
+        qtm = qtmd_init(&sys, (struct mspack_file *) &infh,
+                        (struct mspack_file *) &outfh, wb, 4096);
+        TEST(qtm != NULL);
+        TEST(qtmd_decompress(qtm, VECTOR_LEN) == MSPACK_ERR_OK);
+        TEST(outfh.posn == VECTOR_LEN);
+        md5_hex(out, VECTOR_LEN, md5);
+        TEST(strcmp(md5, vector_data_md5) == 0);
+        qtmd_free(qtm);
+        qtm_synth_free(&s);
+    }
+}
+
+/* test that qtmd_step() decodes the reference vectors exactly too,
+ * when given input and output space a little at a time */
+void qtmd_vectors_test_02() {
+    static unsigned char data[VECTOR_LEN], out[VECTOR_LEN];
+    static const int wbs[3] = { 10, 15, 21 };
+    struct qtmd_stream *qtm;
+    struct mspack_step step;
+    struct qtm_synth s;
+    unsigned int given, in_len, n;
+    char md5[33];
+    int i, err;
+
+    qtm_synth_data(data, VECTOR_LEN, VECTOR_SEED);
+    for (i = 0; i < 3; i++) {
+        TEST(qtm_synth_compress(&s, data, VECTOR_LEN, wbs[i]) == 0);
+        in_len = (unsigned int) s.length + QTM_SYNTH_PAD;
+        qtm = qtmd_init(mspack_default_system, NULL, NULL, wbs[i], 4096);
+        TEST(qtm != NULL);
+        memset(out, 0, sizeof(out));
+        step.next_in  = s.data; step.avail_in  = 0;
+        step.next_out = out;    step.avail_out = 0;
+        step.end_of_input = 0;
+        given = 0;
+        do {
+            /* give output space 999 bytes at a time, but no more than the
+             * stream has, as Quantum streams don't say where they end */
+            if (step.avail_out == 0) {
+                n = (unsigned int) (&out[VECTOR_LEN] - step.next_out);
+                step.avail_out = (n > 999) ? 999 : n;
+            }
+            err = qtmd_step(qtm, &step);
+            if (err == MSPACK_STEP_NEED_INPUT) {
+                n = in_len - given;
+                if (n > 777) n = 777;
+                step.next_in  = &s.data[given];
+                step.avail_in = n;
+                given += n;
+                step.end_of_input = (given == in_len);
+            }
+        } while ((err == MSPACK_ERR_OK || err == MSPACK_STEP_NEED_INPUT) &&
+                 step.next_out < &out[VECTOR_LEN]);
+        TEST(err == MSPACK_ERR_OK);
+        TEST(step.next_out == &out[VECTOR_LEN]);
+        md5_hex(out, VECTOR_LEN, md5);
+        TEST(strcmp(md5, vector_data_md5) == 0);
+        qtmd_free(qtm);
+        qtm_synth_free(&s);
+    }
+}
+
+/* WRAP_LEN bytes of WRAP_TEXT repeated, compressed with a 1024 byte
+ * window, so long matches wrap around the end of the window. The stream
+ * is followed by a few zero bytes, as the decoder reads ahead */
+#define WRAP_TEXT "Quantum matches can wrap the window. "
+#define WRAP_LEN (3000)
+#define WRAP_BITS (10)
+static unsigned char wrap_stream[] = {
+    0xD1, 0x61, 0x62, 0x7E, 0x1A, 0x5F, 0x29, 0x26, 0xA4, 0x64, 0x4E, 0x7E,
+    0xAD, 0xE1, 0x85, 0xEF, 0x79, 0xA2, 0xBD, 0xB0, 0x3D, 0xA3, 0x6A, 0xCD,
+    0x46, 0x8D, 0x19, 0xFC, 0x65, 0xC4, 0x89, 0x05, 0x7C, 0xA8, 0xDF, 0xEA,
+    0x2F, 0xE4, 0xB7, 0xE9, 0x7F, 0x20, 0xF9, 0x07, 0xE8, 0x3E, 0x87, 0xE8,
+    0x3E, 0x83, 0xE4, 0x00, 0x52, 0x00, 0xFF,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static void wrap_expect(unsigned char *buf) {
+    int i;
+    for (i = 0; i < WRAP_LEN; i++) buf[i] = WRAP_TEXT[i % 37];
+}
+
+/* test that a match wrapping the end of a window smaller than a frame is
+ * decoded, however few bytes are asked for at a time */
+void qtmd_wrap_test_01() {
+    static const int chunks[4] = { 1, 7, 100, WRAP_LEN };
+    unsigned char expect[WRAP_LEN], out[WRAP_LEN];
+    struct mspack_system sys = *mspack_default_system;
+    struct mem_file infh, outfh;
+    struct qtmd_stream *qtm;
+    int i, n, done;
+
+    mem_fh_system(&sys);
+    wrap_expect(expect);
+    for (i = 0; i < 4; i++) {
+        infh.data  = wrap_stream; infh.length  = sizeof(wrap_stream);
+        outfh.data = out;         outfh.length = sizeof(out);
+        infh.posn = outfh.posn = 0;
+        memset(out, 0, sizeof(out));
+        qtm = qtmd_init(&sys, (struct mspack_file *) &infh,
+                        (struct mspack_file *) &outfh, WRAP_BITS, 4096);
+        TEST(qtm != NULL);
+        for (done = 0; done < WRAP_LEN; done += n) {
+            n = (WRAP_LEN - done < chunks[i]) ? WRAP_LEN - done : chunks[i];
+            if (qtmd_decompress(qtm, n) != MSPACK_ERR_OK) break;
+        }
+        TEST(done >= WRAP_LEN);
+        TEST(outfh.posn == WRAP_LEN);
+        TEST(memcmp(out, expect, WRAP_LEN) == 0);
+        qtmd_free(qtm);
+    }
+}
+
+/* test that qtmd_step() decodes wrapping matches too, with output space
+ * and input given a few bytes at a time, so frames are decoded again
+ * after running out of input part way through a wrapping match */
+void qtmd_wrap_test_02() {
+    unsigned char expect[WRAP_LEN], out[WRAP_LEN];
+    struct qtmd_stream *qtm;
+    struct mspack_step step;
+    unsigned int given, n;
+    int err;
+
+    wrap_expect(expect);
+    qtm = qtmd_init(mspack_default_system, NULL, NULL, WRAP_BITS, 4096);
+    TEST(qtm != NULL);
+    memset(out, 0, sizeof(out));
+    step.next_in  = wrap_stream; step.avail_in  = 0;
+    step.next_out = out;         step.avail_out = 0;
+    step.end_of_input = 0;
+    given = 0;
+    do {
+        if (step.avail_out == 0) {
+            n = (unsigned int) (&out[WRAP_LEN] - step.next_out);
+            step.avail_out = (n > 13) ? 13 : n;
+        }
+        err = qtmd_step(qtm, &step);
+        if (err == MSPACK_STEP_NEED_INPUT) {
+            n = sizeof(wrap_stream) - given;
+            if (n > 5) n = 5;
+            step.next_in  = &wrap_stream[given];
+            step.avail_in = n;
+            given += n;
+            step.end_of_input = (given == sizeof(wrap_stream));
+        }
+    } while ((err == MSPACK_ERR_OK || err == MSPACK_STEP_NEED_INPUT) &&
+             step.next_out < &out[WRAP_LEN]);
+    TEST(err == MSPACK_ERR_OK);
+    TEST(step.next_out == &out[WRAP_LEN]);
+    TEST(memcmp(out, expect, WRAP_LEN) == 0);
+    qtmd_free(qtm);
+}
+
+int main() {
+  int selftest;
+
+  MSPACK_SYS_SELFTEST(selftest);
+  TEST(selftest == MSPACK_ERR_OK);
+
+  qtmd_vectors_test_01();
+  qtmd_vectors_test_02();
+  qtmd_wrap_test_01();
+  qtmd_wrap_test_02();
+
+  printf("ALL %d TESTS PASSED.\n", test_count);
+  return 0;
+}
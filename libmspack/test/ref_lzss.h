@@ -0,0 +1,39 @@
+/* LZSS decoding as EXPAND.EXE does it, one byte at a time around a
+ * circular 4096 byte window of spaces, stopping at the end of input. pos
+ * is where in the window output starts: 4096-16 for SZDD, 4096-18 for
+ * KWAJ. Returns output length. Tests compare the LZSS decoders with it.
+ */
+
+#include <string.h>
+
+static size_t ref_lzss(unsigned char *in, size_t in_len, unsigned char *out,
+                       unsigned int pos)
+{
+    unsigned char window[4096];
+    unsigned int mpos, len, c, i;
+    size_t i_pos = 0, o_pos = 0;
+
+    memset(window, 0x20, sizeof(window));
+    while (i_pos < in_len) {
+        c = in[i_pos++];
+        for (i = 0x01; i & 0xFF; i <<= 1) {
+            if (c & i) {
+                if (i_pos >= in_len) return o_pos;
+                out[o_pos++] = window[pos] = in[i_pos++];
+                pos = (pos + 1) & 4095;
+            }
+            else {
+                if (i_pos + 2 > in_len) return o_pos;
+                mpos = in[i_pos] | ((in[i_pos + 1] & 0xF0) << 4);
+                len  = (in[i_pos + 1] & 0x0F) + 3;
+                i_pos += 2;
+                while (len--) {
+                    out[o_pos++] = window[pos] = window[mpos];
+                    pos = (pos + 1) & 4095;
+                    mpos = (mpos + 1) & 4095;
+                }
+            }
+        }
+    }
+    return o_pos;
+}
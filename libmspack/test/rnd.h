@@ -0,0 +1,9 @@
+/* a simple deterministic random number generator, for tests and benchmarks
+ * that need the same data every run. rnd() returns 16 bits at a time.
+ */
+
+static unsigned int seed = 1;
+static unsigned int rnd(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
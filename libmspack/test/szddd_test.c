@@ -0,0 +1,196 @@
+/* SZDD regression test suite */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mspack.h>
+#include <system.h>
+#include <mem_fh.h>
+#include <rnd.h>
+#include <ref_lzss.h>
+
+unsigned int test_count = 0;
+#define TEST(x) do {\
+    test_count++; \
+    if ((x)) {printf("%s:%d SUCCESS %s\n",__func__,__LINE__,#x);} \
+    else {printf("%s:%d FAILED %s\n",__func__,__LINE__,#x);exit(1);} \
+} while (0)
+
+/* an mspack_system with a fixed set of named files in memory. Each open()
+ * gets its own mem_file handle onto the named file, so different files can
+ * be used on different threads at once */
+#define NUM_FILES (40)
+struct named_file {
+    char name[16];
+    unsigned char *data;
+    size_t length, size;
+};
+static struct named_file named_files[NUM_FILES * 2];
+
+struct named_fh {
+    struct mem_file fh; /* must come first */
+    struct named_file *file;
+    int mode;
+};
+
+static struct mspack_file *m_open(struct mspack_system *self,
+                                  const char *filename, int mode)
+{
+    struct named_fh *fh;
+    int i;
+    for (i = 0; i < NUM_FILES * 2; i++) {
+        if (!strcmp(filename, named_files[i].name)) break;
+    }
+    if (i == NUM_FILES * 2 || !(fh = (struct named_fh *) malloc(sizeof(*fh)))) {
+        return NULL;
+    }
+    fh->file = &named_files[i];
+    fh->mode = mode;
+    fh->fh.data = fh->file->data;
+    fh->fh.posn = 0;
+    if (mode == MSPACK_SYS_OPEN_WRITE) {
+        /* writes can fill the whole buffer */
+        fh->file->length = 0;
+        fh->fh.length = fh->file->size;
+    }
+    else {
+        fh->fh.length = fh->file->length;
+    }
+    return (struct mspack_file *) fh;
+}
+static void m_close(struct mspack_file *file) {
+    struct named_fh *fh = (struct named_fh *) file;
+    if (fh->mode == MSPACK_SYS_OPEN_WRITE) fh->file->length = fh->fh.posn;
+    free(fh);
+}
+
+/* test that decompress_batch() expands a list of SZDD files the same as
+ * the reference decoder, with any number of threads, and reports the
+ * files that can't be expanded */
+void szddd_batch_test_01() {
+    static const int threads[4] = { 1, 2, 4, 100 };
+    struct msszddd_batch files[NUM_FILES];
+    struct mspack_system sys = *mspack_default_system;
+    struct msszdd_decompressor *szddd;
+    unsigned char *expect[NUM_FILES];
+    size_t expect_len[NUM_FILES], len, hdr_len, i;
+    int n, t;
+
+    TEST(mspack_version(MSPACK_VER_MSSZDDD) >= 2);
+
+    mem_fh_system(&sys);
+    sys.open = &m_open;  sys.close = &m_close;
+    TEST(szddd = mspack_create_szdd_decompressor(&sys));
+
+    for (n = 0; n < NUM_FILES; n++) {
+        struct named_file *in = &named_files[n];
+        struct named_file *out = &named_files[NUM_FILES + n];
+        len = (n % 10 == 0) ? 50000 : 1 + rnd() % 3000;
+        sprintf(in->name, "in%d", n);
+        sprintf(out->name, "out%d", n);
+        in->size = in->length = 14 + len;
+        out->size = len * 18;
+        TEST(in->data = (unsigned char *) malloc(in->size));
+        TEST(out->data = (unsigned char *) malloc(out->size));
+        TEST(expect[n] = (unsigned char *) malloc(out->size));
+
+        /* every third file is in the QBasic format */
+        if (n % 3 == 2) {
+            memcpy(in->data, "SZ \x88\xF0\x27\x33\xD1\0\0\0\0", 12);
+            hdr_len = 12;
+        }
+        else {
+            memcpy(in->data, "SZDD\x88\xF0\x27\x33\x41X\0\0\0\0", 14);
+            hdr_len = 14;
+        }
+        in->length = hdr_len + len;
+        for (i = hdr_len; i < in->length; i++) {
+            in->data[i] = (n & 1) ? (unsigned char) (rnd() & 0x9F)
+                                  : (unsigned char) rnd();
+        }
+        expect_len[n] = ref_lzss(&in->data[hdr_len], len, expect[n],
+                                 4096 - ((hdr_len == 12) ? 18 : 16));
+
+        files[n].input  = in->name;
+        files[n].output = out->name;
+    }
+
+    /* all files good */
+    for (t = 0; t < 4; t++) {
+        for (n = 0; n < NUM_FILES; n++) {
+            files[n].error = -1;
+            files[n].missing_char = '?';
+            named_files[NUM_FILES + n].length = 0;
+        }
+        TEST(szddd->decompress_batch(szddd, files, NUM_FILES, threads[t])
+             == MSPACK_ERR_OK);
+        TEST(szddd->last_error(szddd) == MSPACK_ERR_OK);
+        for (n = 0; n < NUM_FILES; n++) {
+            TEST(files[n].error == MSPACK_ERR_OK);
+            TEST(files[n].missing_char == ((n % 3 == 2) ? '\0' : 'X'));
+            TEST(named_files[NUM_FILES + n].length == expect_len[n]);
+            TEST(memcmp(named_files[NUM_FILES + n].data, expect[n],
+                        expect_len[n]) == 0);
+        }
+    }
+
+    /* some files bad: the first bad file's error is returned, and the
+     * other files are still expanded */
+    named_files[9].data[0] = 'X';
+    files[17].input = "missing";
+    files[25].output = "missing";
+    for (t = 0; t < 4; t++) {
+        for (n = 0; n < NUM_FILES; n++) {
+            files[n].error = -1;
+            files[n].missing_char = '?';
+            named_files[NUM_FILES + n].length = 0;
+        }
+        TEST(szddd->decompress_batch(szddd, files, NUM_FILES, threads[t])
+             == MSPACK_ERR_SIGNATURE);
+        TEST(szddd->last_error(szddd) == MSPACK_ERR_SIGNATURE);
+        for (n = 0; n < NUM_FILES; n++) {
+            if (n == 9) {
+                TEST(files[n].error == MSPACK_ERR_SIGNATURE);
+                TEST(files[n].missing_char == '\0');
+            }
+            else if (n == 17 || n == 25) {
+                TEST(files[n].error == MSPACK_ERR_OPEN);
+            }
+            else {
+                TEST(files[n].error == MSPACK_ERR_OK);
+                TEST(named_files[NUM_FILES + n].length == expect_len[n]);
+                TEST(memcmp(named_files[NUM_FILES + n].data, expect[n],
+                            expect_len[n]) == 0);
+            }
+        }
+    }
+
+    /* bad parameters */
+    TEST(szddd->decompress_batch(szddd, files, 0, 4) == MSPACK_ERR_OK);
+    TEST(szddd->decompress_batch(szddd, NULL, 1, 4) == MSPACK_ERR_ARGS);
+    TEST(szddd->decompress_batch(szddd, files, -1, 4) == MSPACK_ERR_ARGS);
+    TEST(szddd->decompress_batch(szddd, files, NUM_FILES, 0) == MSPACK_ERR_ARGS);
+
+    mspack_destroy_szdd_decompressor(szddd);
+    for (n = 0; n < NUM_FILES; n++) {
+        free(named_files[n].data);
+        free(named_files[NUM_FILES + n].data);
+        free(expect[n]);
+    }
+}
+
+int main() {
+  int selftest;
+
+  MSPACK_SYS_SELFTEST(selftest);
+  TEST(selftest == MSPACK_ERR_OK);
+
+  szddd_batch_test_01();
+
+  printf("ALL %d TESTS PASSED.\n", test_count);
+  return 0;
+}
@@ -0,0 +1,64 @@
+#!/usr/bin/perl -w
+use strict;
+use Compress::Raw::Zlib;
+
+# writes an MSZIP cabinet with one file of two 32k blocks. The file is
+# the same 32468 bytes repeated, so every match in the second block copies
+# from the first block's data, from a window position that decoding the
+# second block has already written over by the time it reaches it
+
+my $period = 32468;
+my ($seed, $chunk) = (1, '');
+for (1 .. $period) {
+    $seed = ($seed * 1103515245 + 12345) & 0xFFFFFFFF;
+    $chunk .= chr(0x20 + (($seed >> 16) % 0x5F));
+}
+my $data = substr($chunk x 3, 0, 65536);
+
+my $header = pack 'A4V5C2v5',
+   'MSCF', 0, 0, 0,   # signature, 0, cabinet size (fixup), 0,
+   0, 0, 3, 1,        # files offset (fixup), 0, format rev, format ver
+   1,                 # number of folders
+   1,                 # number of files
+   0, 1234, 0;        # flags, set id, set index
+
+my $folder = pack 'Vvv',
+    0, # data offset (fixup)
+    2, # number of data blocks
+    1; # compression method (MSZIP)
+
+my $file = pack 'V2v4Z*',
+    length($data), # uncompressed size
+    0,             # folder offset
+    0,             # folder index
+    0x226C,        # time
+    0x59BA,        # date
+    0x20,          # attribs
+    'crossblock.txt'; # filename
+
+# each block is deflated separately, with the previous block as its
+# dictionary, and starts with "CK"
+my @blocks;
+for my $i (0, 1) {
+    my %opts = (-WindowBits => -MAX_WBITS, -Level => Z_BEST_COMPRESSION);
+    $opts{-Dictionary} = substr($data, ($i - 1) * 32768, 32768) if $i;
+    my ($d, $status) = Compress::Raw::Zlib::Deflate->new(%opts);
+    die "deflate init: $status" unless $status == Z_OK;
+    my ($in, $out) = (substr($data, $i * 32768, 32768), '');
+    $d->deflate($in, $out) == Z_OK or die 'deflate';
+    $d->flush($out, Z_FINISH) == Z_OK or die 'flush';
+    $out = 'CK' . $out;
+    push @blocks, pack('Vvv', 0, length($out), 32768) . $out;
+}
+
+# fixup offsets
+my $files_offset  = length($header) + length($folder);
+my $blocks_offset = $files_offset + length($file);
+my $cab_length    = $blocks_offset + length(join '', @blocks);
+substr($header, 0x08, 4, pack 'V', $cab_length);
+substr($header, 0x10, 4, pack 'V', $files_offset);
+substr($folder, 0x00, 4, pack 'V', $blocks_offset);
+
+# print cab file to stdout
+binmode STDOUT;
+print $header, $folder, $file, @blocks;
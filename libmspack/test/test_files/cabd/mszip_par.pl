@@ -0,0 +1,88 @@
+#!/usr/bin/perl -w
+use strict;
+use Compress::Raw::Zlib;
+
+# writes an MSZIP cabinet with three files of two 32k blocks each, where
+# the fourth block, the second half of the second file, is damaged:
+#
+# mszip_par.pl bad   > mszip_par_bad.cab    its first byte is a block type
+#                                           of 3, which isn't allowed
+# mszip_par.pl short > mszip_par_short.cab  only the first half of its
+#                                           deflate data is there
+#
+# so blocks read ahead of the first file when decoding blocks in parallel
+# include the damaged one
+
+my $damage = shift || '';
+die "usage: $0 bad|short\n" unless $damage =~ /^(bad|short)$/;
+
+# each file is a different 10000 bytes of text, repeated
+my $seed = 1;
+my $data = '';
+for my $f (1 .. 3) {
+    my $chunk = '';
+    for (1 .. 10000) {
+        $seed = ($seed * 1103515245 + 12345) & 0xFFFFFFFF;
+        $chunk .= chr(0x20 + (($seed >> 16) % 0x5F));
+    }
+    $data .= substr($chunk x 7, 0, 65536);
+}
+
+my $header = pack 'A4V5C2v5',
+   'MSCF', 0, 0, 0,   # signature, 0, cabinet size (fixup), 0,
+   0, 0, 3, 1,        # files offset (fixup), 0, format rev, format ver
+   1,                 # number of folders
+   3,                 # number of files
+   0, 1234, 0;        # flags, set id, set index
+
+my $folder = pack 'Vvv',
+    0, # data offset (fixup)
+    6, # number of data blocks
+    1; # compression method (MSZIP)
+
+my $files = '';
+for my $f (0 .. 2) {
+    $files .= pack 'V2v4Z*',
+        65536,         # uncompressed size
+        $f * 65536,    # folder offset
+        0,             # folder index
+        0x226C,        # time
+        0x59BA,        # date
+        0x20,          # attribs
+        "file$f.txt";  # filename
+}
+
+# each block is deflated separately, with the previous block as its
+# dictionary, and starts with "CK"
+my @blocks;
+for my $i (0 .. 5) {
+    my %opts = (-WindowBits => -MAX_WBITS, -Level => Z_BEST_COMPRESSION);
+    $opts{-Dictionary} = substr($data, ($i - 1) * 32768, 32768) if $i;
+    my ($d, $status) = Compress::Raw::Zlib::Deflate->new(%opts);
+    die "deflate init: $status" unless $status == Z_OK;
+    my ($in, $out) = (substr($data, $i * 32768, 32768), '');
+    $d->deflate($in, $out) == Z_OK or die 'deflate';
+    $d->flush($out, Z_FINISH) == Z_OK or die 'flush';
+    if ($i == 3) {
+        if ($damage eq 'bad') {
+            substr($out, 0, 1, chr(0x07));
+        }
+        else {
+            $out = substr($out, 0, length($out) / 2);
+        }
+    }
+    $out = 'CK' . $out;
+    push @blocks, pack('Vvv', 0, length($out), 32768) . $out;
+}
+
+# fixup offsets
+my $files_offset  = length($header) + length($folder);
+my $blocks_offset = $files_offset + length($files);
+my $cab_length    = $blocks_offset + length(join '', @blocks);
+substr($header, 0x08, 4, pack 'V', $cab_length);
+substr($header, 0x10, 4, pack 'V', $files_offset);
+substr($folder, 0x00, 4, pack 'V', $blocks_offset);
+
+# print cab file to stdout
+binmode STDOUT;
+print $header, $folder, $files, @blocks;
@@ -199,7 +199,154 @@ sub chm_encints {
     }
 }
 
+# Create a CHM with one file in the uncompressed section and two in the
+# LZX section. The LZX stream is a single uncompressed block, so no LZX
+# compressor is needed
+sub chm_extract {
+    my $text = join '', map { "Line $_ of the test data.\n" } 1 .. 1000;
+    my $sec0_data = substr($text, 0, 5000);
+    my $lzx_data  = substr($text, 5000, 21000);
+
+    # LZX stream: no E8 translation, one uncompressed 32k block with
+    # R0-R2 = 1, then the data padded to the 32k frame
+    my $bits = '0' . '011' . sprintf('%024b', 32768) . '0000';
+    my $lzx = u2(oct('0b' . substr($bits, 0, 16)))
+        . u2(oct('0b' . substr($bits, 16, 16)))
+        . u4(1) x 3
+         . $lzx_data . ("\0" x (32768 - length $lzx_data));
+
+    my $control = u4(6)  # 0x00 length in dwords
+        . 'LZXC'         # 0x04 signature
+        . u4(2)          # 0x08 version
+        . u4(2)          # 0x0C reset interval (in 32k frames)
+        . u4(2)          # 0x10 window size (in 32k frames)
+        . u4(1)          # 0x14 cache size
+        . u4(0);         # 0x18 unknown
+    my $rtable = u4(2)   # 0x00 unknown
+        . u4(1)          # 0x04 number of entries
+        . u4(8)          # 0x08 entry size
+        . u4(0x28)       # 0x0C table offset
+        . u8(length $lzx_data) # 0x10 uncompressed length
+        . u8(length $lzx)      # 0x18 compressed length
+        . u8(32768)      # 0x20 frame length
+        . u8(0);         # 0x28 entry 0
+
+    my $ms = '::DataSpace/Storage/MSCompressed/';
+    my $sec0 = $sec0_data . $lzx . $control . $rtable;
+    my $off = length $sec0_data;
+    my @entries = (
+        entry('/sec0.txt', 0, 0, length $sec0_data),
+        entry('/lzx1.txt', 1, 0, 1000),
+        entry('/lzx2.txt', 1, 1000, length($lzx_data) - 1000),
+        entry($ms . 'Content', 0, $off, length $lzx),
+        entry($ms . 'ControlData', 0, $off + length $lzx, length $control),
+        entry($ms . 'Transform/{7FC28940-9D31-11D0-9B27-00A0C91E9C7C}/'
+              . 'InstanceData/ResetTable', 0,
+              $off + length($lzx) + length($control), length $rtable),
+    );
+
+    # the file length in the header must cover the uncompressed section
+    my $chm = chm(chunk(@entries));
+    my $hs0_offset = length hdr();
+    my $chm_len = unpack 'Q<', substr($chm, $hs0_offset + 0x08, 8);
+    substr($chm, $hs0_offset + 0x08, 8, u8($chm_len + length $sec0));
+    if (open my $fh, '>', 'extract.chm') {
+        binmode $fh;
+        print $fh $chm, $sec0;
+        close $fh;
+    }
+}
+
+# e8.chm has three files in an LZX section of four frames, with a reset
+# every two frames and Intel E8 translation on. Its data is 16 byte
+# records: an E8 call, a 4 byte relative offset, then 11 letters. The
+# calls are translated as the compressor would, with positions counting
+# from the last reset point
+sub chm_e8 {
+    my $filesize = 150000;
+    my $data = '';
+    for my $k (0 .. 131072 / 16 - 1) {
+        my $rel = ($k * 40503) % 300000 - 100000;
+        $data .= "\xE8" . u4($rel & 0xFFFFFFFF) . (chr(65 + $k % 26) x 11);
+    }
+
+    # translate each frame's calls, except in its last 10 bytes
+    for my $frame (0 .. 3) {
+        my $base = $frame * 32768;
+        my $curpos = ($frame % 2) * 32768;
+        my $i = 0;
+        while ($i < 32768 - 10) {
+            if (substr($data, $base + $i, 1) ne "\xE8") {
+                $i++;
+                next;
+            }
+            my $rel = unpack 'l<', substr($data, $base + $i + 1, 4);
+            my $pos = $curpos + $i;
+            if ($rel >= -$pos && $rel < $filesize) {
+                my $abs = ($rel < $filesize - $pos) ? $rel + $pos
+                                                    : $rel - $filesize;
+                substr($data, $base + $i + 1, 4, u4($abs & 0xFFFFFFFF));
+            }
+            $i += 5;
+        }
+    }
+
+    # LZX stream: each reset interval has the E8 header, then one
+    # uncompressed 64k block with R0-R2 = 1
+    my $bits = '1' . sprintf('%032b', $filesize)
+        . '011' . sprintf('%024b', 65536) . '0000';
+    my $hdr = join '', map { u2(oct('0b' . substr($bits, $_ * 16, 16))) } 0 .. 3;
+    my $interval = length($hdr) + 12;
+    my $lzx = $hdr . u4(1) x 3 . substr($data, 0, 65536)
+        . $hdr . u4(1) x 3 . substr($data, 65536, 65536);
+
+    my $control = u4(6)  # 0x00 length in dwords
+        . 'LZXC'         # 0x04 signature
+        . u4(2)          # 0x08 version
+        . u4(2)          # 0x0C reset interval (in 32k frames)
+        . u4(2)          # 0x10 window size (in 32k frames)
+        . u4(1)          # 0x14 cache size
+        . u4(0);         # 0x18 unknown
+    my $rtable = u4(2)   # 0x00 unknown
+        . u4(4)          # 0x04 number of entries
+        . u4(8)          # 0x08 entry size
+        . u4(0x28)       # 0x0C table offset
+        . u8(131072)     # 0x10 uncompressed length
+        . u8(length $lzx) # 0x18 compressed length
+        . u8(32768)      # 0x20 frame length
+        . u8(0)          # 0x28 entries, one per frame
+        . u8($interval + 32768)
+        . u8($interval + 65536)
+        . u8(2 * $interval + 65536 + 32768);
+
+    my $ms = '::DataSpace/Storage/MSCompressed/';
+    my $sec0 = $lzx . $control . $rtable;
+    my @entries = (
+        entry('/e8a.bin', 1, 0, 40000),
+        entry('/e8b.bin', 1, 40000, 60000),
+        entry('/e8c.bin', 1, 100000, 31072),
+        entry($ms . 'Content', 0, 0, length $lzx),
+        entry($ms . 'ControlData', 0, length $lzx, length $control),
+        entry($ms . 'Transform/{7FC28940-9D31-11D0-9B27-00A0C91E9C7C}/'
+              . 'InstanceData/ResetTable', 0,
+              length($lzx) + length($control), length $rtable),
+    );
+
+    # the file length in the header must cover the uncompressed section
+    my $chm = chm(chunk(@entries));
+    my $hs0_offset = length hdr();
+    my $chm_len = unpack 'Q<', substr($chm, $hs0_offset + 0x08, 8);
+    substr($chm, $hs0_offset + 0x08, 8, u8($chm_len + length $sec0));
+    if (open my $fh, '>', 'e8.chm') {
+        binmode $fh;
+        print $fh $chm, $sec0;
+        close $fh;
+    }
+}
+
 chm_sysname_overread();
 chm_unicode_u100();
 chm_encints_32bit();
 chm_encints_64bit();
+chm_extract();
+chm_e8();